@@ -8,6 +8,7 @@ module;
 #include "koopa.h"
 #include <cassert>
 #include <map>
+#include <set>
 #include <string>
 
 export module backend;
@@ -27,11 +28,19 @@ private:
   int local_frame_size = 0; ///< Size of local variable storage area.
   int ra_size = 0;          ///< Space reserved for the Return Address (4 bytes) if needed.
   int args_size = 0;        ///< Space reserved for outgoing arguments on the stack.
+  int edge_scratch = 0;     ///< Offset of the staging area for block arguments.
+  int branch_count = 0;     ///< Counter for labels of branches with arguments.
   // clang-format on
 
   // the offset of value relative to sp
   std::map<const koopa_raw_value_t, int> stkMap;
 
+  /// `@__rvv_*` routines called so far, emitted after all functions.
+  std::set<std::string> vector_routines;
+
+  /// Globals no instruction writes, emitted to `.rodata`.
+  std::set<koopa_raw_value_t> read_only;
+
 public:
   /**
    * @brief Entry point for code generation from a Koopa program.
@@ -64,9 +73,16 @@ private:
    */
   auto reset() -> void {
     stkMap.clear();
-    stk_frame_size = ra_size = args_size = local_frame_size = 0;
+    stk_frame_size = ra_size = args_size = local_frame_size = edge_scratch = 0;
   };
 
+  /**
+   * @brief Copies the arguments of a jump or branch edge into the stack
+   * slots of the target block's parameters.
+   */
+  auto emitEdgeArgs(koopa_raw_basic_block_t target, const koopa_raw_slice_t &args)
+      -> void;
+
   // access raw function
   auto visit(koopa_raw_function_t func) -> void;
 
@@ -8,7 +8,10 @@ module;
 #include <cassert>
 #include <fmt/core.h>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 export module ir.ast;
@@ -22,6 +25,45 @@ import ir.type;
  */
 export namespace ast {
 
+/**
+ * @brief A list of child nodes, stored in the arena of its tree.
+ */
+template <typename T> using List = std::pmr::vector<T *>;
+
+/**
+ * @brief Owns the memory of a syntax tree.
+ *
+ * Nodes and child lists are carved out of large blocks that are all released
+ * together with the arena, instead of being freed one by one. Node
+ * destructors never run, so a node keeps everything it owns in the arena as
+ * well: children as plain pointers and lists as `List`. Names are interned
+ * `Ident`s.
+ */
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  auto operator=(const Arena &) -> Arena & = delete;
+
+  /**
+   * @brief Constructs a `T` in the arena.
+   */
+  template <typename T, typename... Args> auto make(Args &&...args) -> T * {
+    return new (resource.allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Creates an empty list that grows in the arena.
+   */
+  template <typename T> auto list() -> List<T> * {
+    return make<List<T>>(&resource);
+  }
+
+private:
+  std::pmr::monotonic_buffer_resource resource{1 << 16};
+};
+
 /**
  * @brief Base class for all AST nodes.
  ** Represents the "entities that make up the program".
@@ -56,6 +98,21 @@ public:
    * @return The calculated integer value.
    */
   virtual auto CalcValue(ir::KoopaBuilder &builder) const -> int = 0;
+  /**
+   * @brief Checks whether `CalcValue` can evaluate the expression.
+   * @param builder The IR builder context.
+   * @return true if the value is known at compile time.
+   */
+  virtual auto isConstExpr(ir::KoopaBuilder &builder) const -> bool = 0;
+  /**
+   * @brief Generates IR that branches on the expression instead of
+   * producing its value (used for `if` / `while` conditions).
+   * @param builder The IR builder to use.
+   * @param true_label Target if the expression is non-zero.
+   * @param false_label Target if the expression is zero.
+   */
+  virtual auto condGen(ir::KoopaBuilder &builder, const std::string &true_label,
+                       const std::string &false_label) const -> void;
 };
 
 class LValAST;
@@ -80,13 +137,13 @@ enum class UnaryOp { Neg, Not };
  */
 class CompUnitAST : public BaseAST {
 public:
-  std::vector<std::unique_ptr<BaseAST>> children;
+  List<BaseAST> children;
   /**
    * @brief Constructs a compilation unit from a list of children
    * (decls/funcdefs).
    * @param _children List of top-level constructs.
    */
-  CompUnitAST(std::vector<std::unique_ptr<BaseAST>> _children)
+  CompUnitAST(List<BaseAST> _children)
       : children(std::move(_children)) {}
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
@@ -97,21 +154,21 @@ public:
  */
 class FuncParamAST : public BaseAST {
 public:
-  std::string btype;
-  std::string ident;
+  std::string_view btype;
+  Ident ident;
   bool is_const;
   bool is_ptr;
-  std::vector<std::unique_ptr<ExprAST>> indices;
+  List<ExprAST> indices;
   /**
    * @brief Constructs a function parameter.
    * @param _btype The type of the parameter (e.g., "int").
    * @param _ident The name of the parameter.
    * @param _is_const Whether the parameter is constant.
    */
-  FuncParamAST(std::string _btype, std::string _ident, bool _is_const,
-               bool _is_ptr, std::vector<std::unique_ptr<ExprAST>> _indices)
-      : btype(std::move(_btype)), ident(std::move(_ident)), is_const(_is_const),
-        is_ptr(_is_ptr), indices(std::move(_indices)) {}
+  FuncParamAST(std::string_view _btype, Ident _ident, bool _is_const,
+               bool _is_ptr, List<ExprAST> _indices)
+      : btype(_btype), ident(_ident), is_const(_is_const), is_ptr(_is_ptr),
+        indices(std::move(_indices)) {}
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
   auto toKoopa(ir::KoopaBuilder &builder) const -> std::string;
@@ -127,11 +184,10 @@ class DefAST : public BaseAST {};
  */
 class FuncDefAST : public DefAST {
 public:
-  ~FuncDefAST() override;
-  std::string btype;
-  std::string ident;
-  std::vector<std::unique_ptr<FuncParamAST>> params;
-  std::unique_ptr<BlockAST> block;
+  std::string_view btype;
+  Ident ident;
+  List<FuncParamAST> params;
+  BlockAST *block = nullptr;
   /**
    * @brief Constructs a function definition.
    * @param _btype The return type.
@@ -139,9 +195,8 @@ public:
    * @param _params The list of function parameters.
    * @param _block The function body.
    */
-  FuncDefAST(std::string _btype, std::string _ident,
-             std::vector<std::unique_ptr<FuncParamAST>> _params,
-             BaseAST *_block);
+  FuncDefAST(std::string_view _btype, Ident _ident,
+             List<FuncParamAST> _params, BaseAST *_block);
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
 };
@@ -153,14 +208,12 @@ public:
  */
 class ArrayDefAST : public DefAST {
 public:
-  ~ArrayDefAST() override;
   bool is_const;
-  std::string ident;
-  std::vector<std::unique_ptr<ExprAST>> array_suffix;
-  std::unique_ptr<InitValStmtAST> init_val;
-  ArrayDefAST(bool _is_const, std::string _ident,
-              std::vector<std::unique_ptr<ExprAST>> _array_suffix,
-              InitValStmtAST *_init_val);
+  Ident ident;
+  List<ExprAST> array_suffix;
+  InitValStmtAST *init_val = nullptr;
+  ArrayDefAST(bool _is_const, Ident _ident,
+              List<ExprAST> _array_suffix, InitValStmtAST *_init_val);
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
 };
@@ -171,18 +224,18 @@ public:
 class ScalarDefAST : public DefAST {
 public:
   bool is_const;
-  std::string ident;
-  std::unique_ptr<ExprAST> initVal;
+  Ident ident;
+  ExprAST *initVal = nullptr;
   /**
    * @brief Constructs a variable definition.
    * @param _is_const Whether the variable is constant.
    * @param _ident The name of the variable.
    * @param _initVal The initial value expression (optional).
    */
-  ScalarDefAST(bool _is_const, std::string _ident, BaseAST *_initVal)
-      : is_const(_is_const), ident(std::move(_ident)) {
+  ScalarDefAST(bool _is_const, Ident _ident, BaseAST *_initVal)
+      : is_const(_is_const), ident(_ident) {
     if (_initVal) {
-      initVal.reset(static_cast<ExprAST *>(_initVal));
+      initVal = static_cast<ExprAST *>(_initVal);
     }
   }
   auto dump(int depth) const -> void override;
@@ -205,14 +258,13 @@ class StmtAST : public BaseAST {};
 class BlockAST : public StmtAST {
 public:
   //* Semantically, it should be StmtAST, but for convenience, BaseAST is used.
-  std::vector<std::unique_ptr<BaseAST>> items;
+  List<BaseAST> items;
   bool createScope = true;
   /**
    * @brief Constructs a block.
    * @param _items The list of statements/declarations in the block.
    */
-  BlockAST(std::vector<std::unique_ptr<BaseAST>> _items)
-      : items(std::move(_items)) {}
+  BlockAST(List<BaseAST> _items) : items(std::move(_items)) {}
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
 };
@@ -223,14 +275,14 @@ public:
 class ExprStmtAST : public StmtAST {
 public:
   // return expr
-  std::unique_ptr<ExprAST> expr;
+  ExprAST *expr = nullptr;
   /**
    * @brief Constructs an expression statement.
    * @param _expr The expression to evaluate.
    */
   ExprStmtAST(BaseAST *_expr) {
     if (_expr) {
-      expr.reset(static_cast<ExprAST *>(_expr));
+      expr = static_cast<ExprAST *>(_expr);
     }
   }
   auto dump(int depth) const -> void override;
@@ -247,26 +299,25 @@ public:
  */
 class InitValStmtAST : public StmtAST {
 public:
-  std::unique_ptr<ExprAST> expr;
-  std::vector<std::unique_ptr<InitValStmtAST>> initialize_list;
+  ExprAST *expr = nullptr;
+  List<InitValStmtAST> initialize_list;
   /**
    * @brief Constructs an InitValStmtAST object.
    *
    * @param _expr Pointer to a BaseAST that will be statically cast to ExprAST.
    * It represents the primary initialization expression.
-   * @param _initialize_list Vector of unique pointers to InitValStmtAST for
-   * nested initialization. This list is moved into the member to avoid copying.
+   * @param _initialize_list Nested initializers. The list is moved into the
+   * member to avoid copying.
    */
-  InitValStmtAST(BaseAST *_expr,
-                 std::vector<std::unique_ptr<InitValStmtAST>> _initialize_list)
+  InitValStmtAST(BaseAST *_expr, List<InitValStmtAST> _initialize_list)
       : initialize_list(std::move(_initialize_list)) {
-    expr.reset(static_cast<ExprAST *>(_expr));
+    expr = static_cast<ExprAST *>(_expr);
   }
 
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
-  auto flatten(std::shared_ptr<type::Type>, ir::KoopaBuilder &) const
-      -> std::vector<std::string>;
+  auto flatten(std::shared_ptr<type::Type>, ir::KoopaBuilder &,
+               bool fold = false) const -> std::vector<std::string>;
 };
 /** @} */
 
@@ -276,10 +327,8 @@ public:
  */
 class AssignStmtAST : public StmtAST {
 public:
-  // Solved the problem of forward declaration in smart pointers
-  ~AssignStmtAST() override;
-  std::unique_ptr<LValAST> lval;
-  std::unique_ptr<ExprAST> expr;
+  LValAST *lval = nullptr;
+  ExprAST *expr = nullptr;
   /**
    * @brief Constructs an assignment statement.
    * @param _lval The left-hand side variable.
@@ -296,17 +345,16 @@ public:
 class DeclAST : public StmtAST {
 public:
   bool is_const;
-  std::string btype;
-  std::vector<std::unique_ptr<DefAST>> defs;
+  std::string_view btype;
+  List<DefAST> defs;
   /**
    * @brief Constructs a declaration node.
    * @param _is_const Whether the variables are constant.
    * @param _btype The type of the variables.
    * @param _defs The list of variable definitions.
    */
-  DeclAST(bool _is_const, std::string _btype,
-          std::vector<std::unique_ptr<DefAST>> _defs)
-      : is_const(_is_const), btype(std::move(_btype)), defs(std::move(_defs)) {}
+  DeclAST(bool _is_const, std::string_view _btype, List<DefAST> _defs)
+      : is_const(_is_const), btype(_btype), defs(std::move(_defs)) {}
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
 };
@@ -318,14 +366,14 @@ public:
  */
 class ReturnStmtAST : public StmtAST {
 public:
-  std::unique_ptr<ExprAST> expr;
+  ExprAST *expr = nullptr;
   /**
    * @brief Constructs a return statement.
    * @param _expr The return value expression (optional).
    */
   ReturnStmtAST(BaseAST *_expr) {
     if (_expr) {
-      expr.reset(static_cast<ExprAST *>(_expr));
+      expr = static_cast<ExprAST *>(_expr);
     }
   }
   auto dump(int depth) const -> void override;
@@ -337,9 +385,9 @@ public:
  */
 class IfStmtAST : public StmtAST {
 public:
-  std::unique_ptr<ExprAST> cond;
-  std::unique_ptr<StmtAST> thenS;
-  std::unique_ptr<StmtAST> elseS;
+  ExprAST *cond = nullptr;
+  StmtAST *thenS = nullptr;
+  StmtAST *elseS = nullptr;
   /**
    * @brief Constructs an if statement.
    * @param _cond The condition expression.
@@ -347,9 +395,9 @@ public:
    * @param _elseS The statement to execute if false (optional).
    */
   IfStmtAST(BaseAST *_cond, BaseAST *_thenS, BaseAST *_elseS) {
-    cond.reset(static_cast<ExprAST *>(_cond));
-    thenS.reset(static_cast<StmtAST *>(_thenS));
-    elseS.reset(static_cast<StmtAST *>(_elseS));
+    cond = static_cast<ExprAST *>(_cond);
+    thenS = static_cast<StmtAST *>(_thenS);
+    elseS = static_cast<StmtAST *>(_elseS);
   }
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
@@ -360,16 +408,16 @@ public:
  */
 class WhileStmtAST : public StmtAST {
 public:
-  std::unique_ptr<ExprAST> cond;
-  std::unique_ptr<StmtAST> body;
+  ExprAST *cond = nullptr;
+  StmtAST *body = nullptr;
   /**
    * @brief Constructs a while statement.
    * @param _cond The loop condition.
    * @param _body The loop body.
    */
   WhileStmtAST(BaseAST *_cond, BaseAST *_body) {
-    cond.reset(static_cast<ExprAST *>(_cond));
-    body.reset(static_cast<StmtAST *>(_body));
+    cond = static_cast<ExprAST *>(_cond);
+    body = static_cast<StmtAST *>(_body);
   }
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
@@ -402,21 +450,23 @@ public:
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
   auto CalcValue(ir::KoopaBuilder &builder) const -> int override;
+  auto isConstExpr(ir::KoopaBuilder &builder) const -> bool override;
 };
 
 class LValAST : public ExprAST {
 public:
-  std::string ident;
-  std::vector<std::unique_ptr<ExprAST>> indices;
+  Ident ident;
+  List<ExprAST> indices;
   /**
    * @brief Constructs an LVal node.
    * @param _ident The variable name.
    */
-  LValAST(std::string _ident, std::vector<std::unique_ptr<ExprAST>> _indices)
-      : ident(std::move(_ident)), indices(std::move(_indices)) {};
+  LValAST(Ident _ident, List<ExprAST> _indices)
+      : ident(_ident), indices(std::move(_indices)) {};
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
   auto CalcValue(ir::KoopaBuilder &builder) const -> int override;
+  auto isConstExpr(ir::KoopaBuilder &builder) const -> bool override;
 };
 
 /**
@@ -424,24 +474,25 @@ public:
  */
 class FuncCallAST : public ExprAST {
 public:
-  std::string ident;
-  std::vector<std::unique_ptr<ExprAST>> args;
+  Ident ident;
+  List<ExprAST> args;
   /**
    * @brief Constructs a function call.
    * @param _ident The function name.
    * @param _args The list of expression arguments.
    */
-  FuncCallAST(std::string _ident, std::vector<std::unique_ptr<ExprAST>> _args)
-      : ident(std::move(_ident)), args(std::move(_args)) {}
+  FuncCallAST(Ident _ident, List<ExprAST> _args)
+      : ident(_ident), args(std::move(_args)) {}
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
   auto CalcValue(ir::KoopaBuilder &builder) const -> int override;
+  auto isConstExpr(ir::KoopaBuilder &builder) const -> bool override;
 };
 
 class UnaryExprAST : public ExprAST {
 public:
   UnaryOp op;
-  std::unique_ptr<ExprAST> rhs;
+  ExprAST *rhs = nullptr;
 
   /**
    * @brief Constructs a unary expression.
@@ -450,20 +501,23 @@ public:
    */
   UnaryExprAST(UnaryOp _op, BaseAST *_rhs) : op(_op) {
     if (_rhs) {
-      rhs.reset(static_cast<ExprAST *>(_rhs));
+      rhs = static_cast<ExprAST *>(_rhs);
     }
   }
 
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
   auto CalcValue(ir::KoopaBuilder &builder) const -> int override;
+  auto isConstExpr(ir::KoopaBuilder &builder) const -> bool override;
+  auto condGen(ir::KoopaBuilder &builder, const std::string &true_label,
+               const std::string &false_label) const -> void override;
 };
 
 class BinaryExprAST : public ExprAST {
 public:
   BinaryOp op;
-  std::unique_ptr<ExprAST> lhs;
-  std::unique_ptr<ExprAST> rhs;
+  ExprAST *lhs = nullptr;
+  ExprAST *rhs = nullptr;
 
   /**
    * @brief Constructs a binary expression.
@@ -473,16 +527,19 @@ public:
    */
   BinaryExprAST(BinaryOp _op, BaseAST *_lhs, BaseAST *_rhs) : op(_op) {
     if (_lhs) {
-      lhs.reset(static_cast<ExprAST *>(_lhs));
+      lhs = static_cast<ExprAST *>(_lhs);
     }
     if (_rhs) {
-      rhs.reset(static_cast<ExprAST *>(_rhs));
+      rhs = static_cast<ExprAST *>(_rhs);
     }
   }
 
   auto dump(int depth) const -> void override;
   auto codeGen(ir::KoopaBuilder &builder) const -> std::string override;
   auto CalcValue(ir::KoopaBuilder &builder) const -> int override;
+  auto isConstExpr(ir::KoopaBuilder &builder) const -> bool override;
+  auto condGen(ir::KoopaBuilder &builder, const std::string &true_label,
+               const std::string &false_label) const -> void override;
 };
 
 }; // namespace ast
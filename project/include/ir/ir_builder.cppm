@@ -35,6 +35,8 @@ class KoopaBuilder {
 private:
   // clang-format off
   std::string buffer;            ///< The IR text buffer.
+  std::string hoisted;           ///< Globals emitted from inside a function.
+  size_t hoist_pos = 0;          ///< Where `hoisted` goes: after the library decls.
   int count_reg = 0;             ///< Counter for local virtual registers (%0, %1, ...).
   int count_name = 0;            ///< Counter for uniquely naming local variables.
   int count_label = 0;           ///< Counter for basic block labels.
@@ -60,23 +62,24 @@ public:
       buffer.append("decl @starttime()\n");
       buffer.append("decl @stoptime()\n\n");
 
-      _symtab.defineGlobal("getint", "", type::IntType::get(), SymbolKind::Func,
-                           false);
-      _symtab.defineGlobal("getch", "", type::IntType::get(), SymbolKind::Func,
-                           false);
-      _symtab.defineGlobal("getarray", "", type::IntType::get(),
+      _symtab.defineGlobal(intern("getint"), "", type::IntType::get(),
                            SymbolKind::Func, false);
-      _symtab.defineGlobal("putint", "", type::VoidType::get(),
+      _symtab.defineGlobal(intern("getch"), "", type::IntType::get(),
                            SymbolKind::Func, false);
-      _symtab.defineGlobal("putch", "", type::VoidType::get(), SymbolKind::Func,
-                           false);
-      _symtab.defineGlobal("putarray", "", type::VoidType::get(),
+      _symtab.defineGlobal(intern("getarray"), "", type::IntType::get(),
                            SymbolKind::Func, false);
-      _symtab.defineGlobal("starttime", "", type::VoidType::get(),
+      _symtab.defineGlobal(intern("putint"), "", type::VoidType::get(),
                            SymbolKind::Func, false);
-      _symtab.defineGlobal("stoptime", "", type::VoidType::get(),
+      _symtab.defineGlobal(intern("putch"), "", type::VoidType::get(),
+                           SymbolKind::Func, false);
+      _symtab.defineGlobal(intern("putarray"), "", type::VoidType::get(),
+                           SymbolKind::Func, false);
+      _symtab.defineGlobal(intern("starttime"), "", type::VoidType::get(),
+                           SymbolKind::Func, false);
+      _symtab.defineGlobal(intern("stoptime"), "", type::VoidType::get(),
                            SymbolKind::Func, false);
     }();
+    hoist_pos = buffer.size();
   }
 
   /**
@@ -84,6 +87,12 @@ public:
    */
   auto append(std::string_view str) -> void { buffer += str; }
 
+  /**
+   * @brief Emits a global definition ahead of all functions, so that code
+   * generation can add globals while in the middle of a function body.
+   */
+  auto appendGlobal(std::string_view str) -> void { hoisted += str; }
+
   /**
    * @brief Generates a new unique virtual register name.
    * @return std::string e.g., "%12"
@@ -174,6 +183,12 @@ public:
    * @return std::string The generated content.
    */
 
-  [[nodiscard]] auto build() -> std::string { return std::move(buffer); }
+  [[nodiscard]] auto build() -> std::string {
+    if (!hoisted.empty()) {
+      buffer.insert(hoist_pos, hoisted + "\n");
+      hoisted.clear();
+    }
+    return std::move(buffer);
+  }
 };
 } // namespace ir
\ No newline at end of file
@@ -4,15 +4,19 @@
  *
  * This file provides the infrastructure for lexical scoping and symbol tracking
  * during the AST-to-IR generation phase. It supports nested scopes, constant
- * tracking, and IR name mapping.
+ * tracking, and IR name mapping. Identifiers are interned once, so scopes are
+ * keyed on integer ids rather than on strings.
  */
 
 module;
 
-#include <map>
+#include <deque>
+#include <fmt/core.h>
 #include <memory>
 #include <ranges>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 export module symbol_table;
@@ -20,6 +24,74 @@ export module symbol_table;
 import ir.type;
 import log;
 
+/**
+ * @brief An interned identifier. Equal names have equal ids.
+ */
+export struct Ident {
+  int id; ///< Index into the interner's table.
+
+  /**
+   * @brief The source text of the identifier.
+   */
+  auto str() const -> std::string_view;
+
+  auto operator==(const Ident &) const -> bool = default;
+};
+
+/**
+ * @brief Stores every distinct identifier of the program once.
+ */
+export class Interner {
+private:
+  std::deque<std::string> names;                ///< Text, indexed by id.
+  std::unordered_map<std::string_view, int> ids; ///< Views of `names`.
+
+public:
+  /**
+   * @brief Returns the id of `text`, assigning the next one if it is new.
+   */
+  auto intern(std::string_view text) -> Ident {
+    if (auto it = ids.find(text); it != ids.end()) {
+      return {it->second};
+    }
+    int id = static_cast<int>(names.size());
+    ids.emplace(names.emplace_back(text), id);
+    return {id};
+  }
+
+  /**
+   * @brief The text of an interned identifier.
+   */
+  auto name(Ident ident) const -> std::string_view { return names[ident.id]; }
+};
+
+/**
+ * @brief The interner shared by the lexer and code generation.
+ */
+export auto interner() -> Interner & {
+  static Interner instance;
+  return instance;
+}
+
+/**
+ * @brief Shorthand for `interner().intern(text)`.
+ */
+export auto intern(std::string_view text) -> Ident {
+  return interner().intern(text);
+}
+
+auto Ident::str() const -> std::string_view { return interner().name(*this); }
+
+/**
+ * @brief Formats an identifier as its text.
+ */
+template <>
+struct fmt::formatter<Ident> : fmt::formatter<std::string_view> {
+  auto format(Ident ident, fmt::format_context &ctx) const {
+    return fmt::formatter<std::string_view>::format(ident.str(), ctx);
+  }
+};
+
 /**
  * @brief Categorizes the type of symbol.
  */
@@ -28,13 +100,14 @@ export enum class SymbolKind { Var, Func };
 /**
  * @brief Represents a single symbol in the source code.
  */
-struct Symbol {
-  std::string name;                 ///< Source name (e.g., "x")
+export struct Symbol {
+  Ident name;                       ///< Source name (e.g., "x")
   std::string irName;               ///< IR-level name (e.g., "@x_1")
   std::shared_ptr<type::Type> type; ///< Data type of the symbol
   SymbolKind kind;                  ///< Variable or Function
   bool is_const;                    ///< True if it's a compile-time constant
   int constValue; ///< The value of the constant, if applicable
+  std::vector<int> constElems; ///< Row-major elements of a constant array
 };
 
 /**
@@ -47,9 +120,10 @@ export class SymbolTable {
 private:
   //* scopes[0] indicates global scope
   /**
-   * @brief A stack of maps, where each map represents a lexical scope.
+   * @brief A stack of maps, where each map represents a lexical scope and
+   * is keyed on identifier ids.
    */
-  std::vector<std::map<std::string, Symbol>> scopes;
+  std::vector<std::unordered_map<int, Symbol>> scopes;
 
 public:
   /**
@@ -92,32 +166,34 @@ public:
    * @param kind    Var or Func.
    * @param is_const Whether it's constant.
    * @param val     Initial value if constant.
+   * @param elems   Flattened elements if it's a constant array.
    */
-  auto define(const std::string &name, const std::string &irName,
+  auto define(Ident name, const std::string &irName,
               std::shared_ptr<type::Type> type, SymbolKind kind, bool is_const,
-              int val = 0) -> void {
+              int val = 0, std::vector<int> elems = {}) -> void {
 
-    if (scopes.back().contains(name)) {
-      Log::panic("Semantic Error: Redefinition of " + name);
+    if (scopes.back().contains(name.id)) {
+      Log::panic(fmt::format("Semantic Error: Redefinition of {}", name));
     }
 
-    Symbol sym{name, irName, type, kind, is_const, val};
-    scopes.back()[name] = sym;
+    Symbol sym{name, irName, type, kind, is_const, val, std::move(elems)};
+    scopes.back().emplace(name.id, std::move(sym));
   }
 
   /**
    * @brief Defines a new symbol specifically in the global scope.
    */
-  auto defineGlobal(const std::string &name, const std::string &irName,
+  auto defineGlobal(Ident name, const std::string &irName,
                     std::shared_ptr<type::Type> type, SymbolKind kind,
-                    bool is_const, int val = 0) -> void {
+                    bool is_const, int val = 0, std::vector<int> elems = {})
+      -> void {
 
-    if (scopes[0].contains(name)) {
-      Log::panic("Semantic Error: Redefinition of " + name);
+    if (scopes[0].contains(name.id)) {
+      Log::panic(fmt::format("Semantic Error: Redefinition of {}", name));
     }
 
-    Symbol sym{name, irName, type, kind, is_const, val};
-    scopes[0][name] = sym;
+    Symbol sym{name, irName, type, kind, is_const, val, std::move(elems)};
+    scopes[0].emplace(name.id, std::move(sym));
   }
 
   /**
@@ -126,9 +202,9 @@ public:
    * @param name The source name to look up.
    * @return Symbol* Pointer to the symbol if found, else nullptr.
    */
-  auto lookup(const std::string &name) -> Symbol * {
+  auto lookup(Ident name) -> Symbol * {
     for (auto &scope : scopes | std::views::reverse) {
-      auto it = scope.find(name);
+      auto it = scope.find(name.id);
       if (it != scope.end()) {
         return &(it->second);
       }
@@ -0,0 +1,546 @@
+/**
+ * @file analysis.cppm
+ * @brief Analyses over the optimizer IR: dominators, post-dominators,
+ * natural loops, induction variables, pointer aliasing, the call graph, the
+ * side effects of functions and the ranges of integer values.
+ *
+ * Analyses are snapshots: they describe the function as it was when they
+ * were computed and must be rebuilt after a pass changes the CFG. The
+ * `AnalysisManager` caches the CFG analyses of every function until a pass
+ * invalidates them.
+ */
+
+module;
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+export module opt.analysis;
+
+import opt.ir;
+
+export namespace opt {
+
+/**
+ * @brief Dominator tree, built with the Cooper-Harvey-Kennedy algorithm.
+ *
+ * Only blocks reachable from the entry are part of the tree.
+ */
+class DominatorTree {
+public:
+  explicit DominatorTree(const Function &func);
+
+  /**
+   * @brief The immediate dominator, nullptr for the entry block.
+   */
+  auto idom(const BasicBlock *bb) const -> BasicBlock *;
+
+  /**
+   * @brief Blocks immediately dominated by `bb`.
+   */
+  auto children(const BasicBlock *bb) const -> const std::vector<BasicBlock *> &;
+
+  /**
+   * @brief Whether `a` dominates `b` (every block dominates itself).
+   */
+  auto dominates(const BasicBlock *a, const BasicBlock *b) const -> bool;
+
+  auto isReachable(const BasicBlock *bb) const -> bool {
+    return index.contains(bb);
+  }
+
+  /**
+   * @brief Reachable blocks in reverse post-order.
+   */
+  auto order() const -> const std::vector<BasicBlock *> & { return rpo; }
+
+private:
+  std::vector<BasicBlock *> rpo;
+  std::unordered_map<const BasicBlock *, int> index; ///< Position in `rpo`.
+  std::vector<int> idoms;                            ///< By RPO index.
+  std::vector<std::vector<BasicBlock *>> kids;       ///< By RPO index.
+  std::vector<std::pair<int, int>> interval;         ///< Tree DFS in/out.
+};
+
+/**
+ * @brief Post-dominator tree, the dominator tree of the reversed CFG.
+ *
+ * The tree is rooted at a virtual exit that every `ret` block jumps to.
+ * Only blocks reachable from the entry that can reach a `ret` are part of
+ * it; blocks stuck in an infinite loop post-dominate nothing.
+ */
+class PostDominatorTree {
+public:
+  explicit PostDominatorTree(const Function &func);
+
+  /**
+   * @brief The immediate post-dominator, nullptr if it is the virtual exit.
+   */
+  auto ipdom(const BasicBlock *bb) const -> BasicBlock *;
+
+  /**
+   * @brief Blocks immediately post-dominated by `bb`.
+   */
+  auto children(const BasicBlock *bb) const -> const std::vector<BasicBlock *> &;
+
+  /**
+   * @brief Blocks immediately post-dominated by the virtual exit.
+   */
+  auto roots() const -> const std::vector<BasicBlock *> & { return kids[0]; }
+
+  /**
+   * @brief Whether every path from `b` to a `ret` passes through `a`
+   * (every block post-dominates itself).
+   */
+  auto postDominates(const BasicBlock *a, const BasicBlock *b) const -> bool;
+
+  auto isReachable(const BasicBlock *bb) const -> bool {
+    return index.contains(bb);
+  }
+
+private:
+  std::vector<BasicBlock *> rpo; ///< Of the reversed CFG, nullptr first.
+  std::unordered_map<const BasicBlock *, int> index; ///< Position in `rpo`.
+  std::vector<int> idoms;                            ///< By RPO index.
+  std::vector<std::vector<BasicBlock *>> kids;       ///< By RPO index.
+  std::vector<std::pair<int, int>> interval;         ///< Tree DFS in/out.
+};
+
+/**
+ * @brief A natural loop: a header plus every block that reaches one of its
+ * back edges without passing through the header.
+ */
+class Loop {
+public:
+  BasicBlock *header = nullptr;
+  Loop *parent = nullptr;                        ///< Enclosing loop.
+  std::vector<Loop *> subLoops;                  ///< Directly nested loops.
+  std::vector<BasicBlock *> blocks;              ///< In reverse post-order.
+  std::unordered_set<const BasicBlock *> members; ///< Same as `blocks`.
+
+  auto contains(const BasicBlock *bb) const -> bool {
+    return members.contains(bb);
+  }
+
+  /**
+   * @brief Whether the value is defined outside the loop (constants,
+   * globals and arguments always are).
+   */
+  auto isInvariant(const Value *val) const -> bool {
+    return !(val->isInst() || val->op == Op::BlockArg) ||
+           !contains(val->parent);
+  }
+
+  /**
+   * @brief Nesting depth, 1 for outermost loops.
+   */
+  auto depth() const -> int;
+
+  /**
+   * @brief Loop blocks with an edge back to the header.
+   */
+  auto latches() const -> std::vector<BasicBlock *>;
+
+  /**
+   * @brief Blocks outside the loop that are targeted from inside it.
+   */
+  auto exitBlocks() const -> std::vector<BasicBlock *>;
+
+  /**
+   * @brief Loop blocks with an edge leaving the loop.
+   */
+  auto exitingBlocks() const -> std::vector<BasicBlock *>;
+
+  /**
+   * @brief Whether a value defined in the loop is used outside of it.
+   */
+  auto hasOutsideUses() const -> bool;
+};
+
+/**
+ * @brief The loop nest forest of a function.
+ */
+class LoopInfo {
+public:
+  LoopInfo(const Function &func, const DominatorTree &domTree);
+
+  /**
+   * @brief The innermost loop containing `bb`, or nullptr.
+   */
+  auto loopFor(const BasicBlock *bb) const -> Loop *;
+
+  /**
+   * @brief All loops, inner loops before the loops containing them.
+   */
+  auto postOrder() const -> std::vector<Loop *>;
+
+  auto topLevel() const -> const std::vector<Loop *> & { return roots; }
+  auto empty() const -> bool { return loops.empty(); }
+
+private:
+  std::vector<std::unique_ptr<Loop>> loops;
+  std::vector<Loop *> roots;
+  std::unordered_map<const BasicBlock *, Loop *> innermost;
+};
+
+/**
+ * @brief The function analyses a pass keeps valid.
+ *
+ * All of them only depend on the CFG, so a pass that does not add, remove
+ * or retarget edges preserves every one.
+ */
+class PreservedAnalyses {
+public:
+  enum Kind : unsigned {
+    Dominators = 1 << 0,
+    PostDominators = 1 << 1,
+    Loops = 1 << 2,
+  };
+
+  static auto none() -> PreservedAnalyses { return PreservedAnalyses(0); }
+  static auto all() -> PreservedAnalyses {
+    return PreservedAnalyses(Dominators | PostDominators | Loops);
+  }
+
+  auto preserve(Kind kind) -> PreservedAnalyses & {
+    mask |= kind;
+    return *this;
+  }
+  auto preserves(Kind kind) const -> bool { return (mask & kind) != 0; }
+
+private:
+  explicit PreservedAnalyses(unsigned _mask) : mask(_mask) {}
+
+  unsigned mask;
+};
+
+/**
+ * @brief Computes the CFG analyses of functions on demand and caches them
+ * until a pass invalidates them.
+ *
+ * References handed out stay valid until the next `invalidate` of the same
+ * function that drops the analysis. A pass that changes the CFG halfway
+ * through must invalidate before asking again.
+ */
+class AnalysisManager {
+public:
+  /**
+   * @brief How often analyses were computed and served from the cache,
+   * summed over every function.
+   */
+  struct Statistics {
+    long computed = 0;
+    long cached = 0;
+    long invalidated = 0; ///< Analyses dropped.
+  };
+
+  auto domTree(const Function &func) -> const DominatorTree &;
+  auto postDomTree(const Function &func) -> const PostDominatorTree &;
+  auto loops(const Function &func) -> const LoopInfo &;
+
+  /**
+   * @brief Drops the analyses of `func` that `kept` does not list.
+   */
+  auto invalidate(const Function &func,
+                  PreservedAnalyses kept = PreservedAnalyses::none()) -> void;
+
+  /**
+   * @brief Drops the analyses of every function, as module passes may
+   * rewrite, add or delete any of them.
+   */
+  auto clear() -> void;
+
+  auto statistics() const -> const Statistics & { return stats; }
+
+private:
+  struct Entry {
+    std::unique_ptr<DominatorTree> domTree;
+    std::unique_ptr<PostDominatorTree> postDomTree;
+    std::unique_ptr<LoopInfo> loops;
+  };
+  std::unordered_map<const Function *, Entry> entries;
+  Statistics stats;
+};
+
+/**
+ * @brief A scalar `alloc` that a loop advances by a constant step exactly
+ * once per iteration.
+ */
+struct InductionVariable {
+  Value *slot;   ///< The `alloc`, which is only ever loaded and stored.
+  Value *update; ///< `store (add (load slot), step), slot`.
+  int step;      ///< Never 0.
+};
+
+/**
+ * @brief The induction variables of every loop in a function.
+ *
+ * The update must be the only store to the slot anywhere in the loop
+ * (subloops included), lie outside all subloops and dominate every latch.
+ */
+class InductionInfo {
+public:
+  InductionInfo(const Function &func, const LoopInfo &loops,
+                const DominatorTree &domTree);
+
+  /**
+   * @brief Induction variables of `loop`.
+   */
+  auto of(const Loop *loop) const -> const std::vector<InductionVariable> &;
+
+  /**
+   * @brief The induction variable of `loop` kept in `slot`, or nullptr.
+   */
+  auto find(const Loop *loop, const Value *slot) const
+      -> const InductionVariable *;
+
+  /**
+   * @brief Whether `val` is an `i32` `alloc` used only as the address of
+   * loads and stores, so that no other pointer can reach it.
+   */
+  auto isPrivateScalar(const Value *val) const -> bool {
+    return scalars.contains(val);
+  }
+
+private:
+  std::unordered_set<const Value *> scalars;
+  std::unordered_map<const Loop *, std::vector<InductionVariable>> ivs;
+  std::vector<InductionVariable> none;
+};
+
+/**
+ * @brief The value last stored to `slot` on the way into a loop, walking
+ * back from its entering block through single-predecessor blocks; nullptr
+ * if no store is found.
+ */
+auto entryValue(BasicBlock *entering, const Value *slot) -> Value *;
+
+/**
+ * @brief How two memory accesses may overlap.
+ */
+enum class AliasResult {
+  NoAlias,   ///< They never touch the same bytes.
+  MayAlias,  ///< Nothing is known.
+  MustAlias, ///< They always access the same location.
+};
+
+/**
+ * @brief Where a pointer points: a base pointer plus the byte offsets at
+ * which its pointee may start.
+ *
+ * The base is an *identified object* (`alloc` or `global alloc`) or a
+ * pointer of unknown origin (a parameter, a block argument or a loaded
+ * pointer). Indices are assumed to stay in bounds: a dynamic `getelemptr`
+ * index still confines the pointer to the array it indexes, while a dynamic
+ * `getptr` index leaves the offset unbounded.
+ */
+struct MemoryLocation {
+  Value *base = nullptr;
+  int lo = 0;          ///< Smallest start offset.
+  int hi = 0;          ///< Largest start offset.
+  bool bounded = true; ///< Whether `lo` and `hi` are known.
+  int size = 0;        ///< Bytes of the pointee.
+
+  /**
+   * @brief The start offset, if it is known exactly.
+   */
+  auto offset() const -> std::optional<int> {
+    return bounded && lo == hi ? std::optional(lo) : std::nullopt;
+  }
+};
+
+/**
+ * @brief Alias queries between the pointers of one function.
+ *
+ * Two accesses are disjoint when their bases cannot reach the same object
+ * (two distinct identified objects, or a local whose address never leaves
+ * the function and any other base), or when their byte ranges from the same
+ * base do not overlap. Locations and query results are cached, so the
+ * analysis must be rebuilt once pointers are rewritten.
+ */
+class AliasAnalysis {
+public:
+  /**
+   * @brief Query outcomes, summed over every instance.
+   */
+  struct Statistics {
+    long queries = 0;
+    long noAlias = 0;
+    long mayAlias = 0;
+    long mustAlias = 0;
+    long cached = 0; ///< Answered from the cache.
+  };
+
+  explicit AliasAnalysis(const Function &func);
+
+  auto alias(Value *a, Value *b) -> AliasResult;
+
+  auto location(Value *ptr) -> const MemoryLocation &;
+
+  /**
+   * @brief Whether `base` is a local whose address is never passed to a
+   * call, returned, stored or bound to a block parameter, so that only
+   * pointers derived from it in this function can reach it.
+   */
+  auto isPrivate(const Value *base) const -> bool {
+    return base->op == Op::Alloc && !escaping.contains(base);
+  }
+
+  /**
+   * @brief Whether pointers based on `a` and `b` may reach the same object.
+   */
+  auto mayShareObject(const Value *a, const Value *b) const -> bool;
+
+  static auto statistics() -> Statistics &;
+
+private:
+  std::unordered_map<const Value *, MemoryLocation> locations;
+  std::unordered_set<const Value *> escaping;
+  std::map<std::pair<const Value *, const Value *>, AliasResult> results;
+};
+
+/**
+ * @brief Whether `val` is an `alloc` or a `global alloc`.
+ */
+auto isIdentifiedObject(const Value *val) -> bool;
+
+/**
+ * @brief Direct call relations between the functions of a module.
+ */
+class CallGraph {
+public:
+  explicit CallGraph(const Module &module);
+
+  /**
+   * @brief Distinct functions called by `func`.
+   */
+  auto callees(const Function *func) const -> const std::vector<Function *> &;
+
+  /**
+   * @brief Number of call sites targeting `func`.
+   */
+  auto callSites(const Function *func) const -> int;
+
+  /**
+   * @brief Strongly connected components in bottom-up order: every
+   * component comes after all components it calls into.
+   */
+  auto sccs() const -> const std::vector<std::vector<Function *>> & {
+    return components;
+  }
+
+  /**
+   * @brief Whether `a` and `b` belong to the same component.
+   */
+  auto sameSCC(const Function *a, const Function *b) const -> bool {
+    return sccIndex.at(a) == sccIndex.at(b);
+  }
+
+  /**
+   * @brief Whether `func` can (indirectly) call itself.
+   */
+  auto isRecursive(const Function *func) const -> bool;
+
+private:
+  std::unordered_map<const Function *, std::vector<Function *>> edges;
+  std::unordered_map<const Function *, int> sites;
+  std::vector<std::vector<Function *>> components;
+  std::unordered_map<const Function *, int> sccIndex;
+};
+
+/**
+ * @brief What a call to a function may do to memory visible to its caller,
+ * ordered from weakest to strongest.
+ */
+enum class Purity {
+  Pure,     ///< Result depends on the arguments only.
+  ReadOnly, ///< May read globals or memory reached through arguments.
+  Writing,  ///< May write memory or perform I/O.
+};
+
+/**
+ * @brief Interprocedural side-effect summary of every function.
+ *
+ * Components of the call graph are visited bottom-up, so each function sees
+ * the final summary of its callees; the members of a recursive component
+ * share one summary. Loads and stores whose address derives from a local
+ * `alloc` are invisible to callers. Declared functions (the `getint` /
+ * `putint` family of the runtime library) are assumed to be `Writing`.
+ */
+class SideEffectInfo {
+public:
+  explicit SideEffectInfo(const CallGraph &calls);
+
+  auto of(const Function *func) const -> Purity { return summary.at(func); }
+
+  auto isPure(const Function *func) const -> bool {
+    return of(func) == Purity::Pure;
+  }
+
+  /**
+   * @brief Whether calling `func` may write memory or perform I/O.
+   */
+  auto writesMemory(const Function *func) const -> bool {
+    return of(func) == Purity::Writing;
+  }
+
+private:
+  std::unordered_map<const Function *, Purity> summary;
+};
+
+/**
+ * @brief A closed interval of `i32` values, in 64 bits so that bounds can be
+ * computed without wrapping.
+ */
+struct Interval {
+  long lo = INT32_MIN;
+  long hi = INT32_MAX;
+
+  static auto full() -> Interval { return {}; }
+  static auto constant(long val) -> Interval { return {val, val}; }
+
+  auto isFull() const -> bool { return lo == INT32_MIN && hi == INT32_MAX; }
+  auto isEmpty() const -> bool { return lo > hi; }
+  auto isConstant() const -> bool { return lo == hi; }
+  auto isNonNegative() const -> bool { return lo >= 0; }
+
+  auto operator==(const Interval &) const -> bool = default;
+};
+
+/**
+ * @brief Interval ranges of the integer values of a function.
+ *
+ * A forward dataflow over the CFG tracks the ranges of private scalar
+ * `alloc`s (only ever loaded and stored) and of SSA values. Branch
+ * conditions narrow both along their edges: in `if (i < n)` the true edge
+ * knows `i <= max(n) - 1`. Block states are joined at merges and widened
+ * after a few visits, so loop counters settle at e.g. `[0, INT32_MAX]`
+ * before the loop test narrows them again inside the body.
+ *
+ * Arithmetic that may overflow `i32` yields the full range.
+ */
+class ValueRanges {
+public:
+  ValueRanges(const Function &func, const DominatorTree &domTree);
+
+  /**
+   * @brief The range of operand `index` of `inst`, where `inst` uses it.
+   */
+  auto operand(const Value *inst, size_t index) const -> Interval;
+
+  /**
+   * @brief The range of the value `inst` computes.
+   */
+  auto result(const Value *inst) const -> Interval;
+
+private:
+  std::unordered_map<const Value *, Interval> results;
+  std::unordered_map<const Value *, std::vector<Interval>> operands;
+};
+
+} // namespace opt
@@ -0,0 +1,440 @@
+/**
+ * @file ir.cppm
+ * @brief Mutable in-memory Koopa IR used by the optimizer.
+ *
+ * The front end emits Koopa IR as text. When optimizations are enabled the
+ * text is parsed by libkoopa, lifted into the structures below (which, unlike
+ * the raw program, can be rewritten in place), transformed by the passes in
+ * `opt.passes`, and printed back to text for the backend.
+ *
+ * ### Ownership
+ * - `Module` owns functions, global allocations and interned constants.
+ * - `Function` owns its parameters and basic blocks (front = entry block).
+ * - `BasicBlock` owns its block parameters and instructions.
+ *
+ * Every operand is a non-owning `Value *`. Passes must make sure a value has
+ * no remaining uses before erasing it.
+ */
+
+module;
+
+#include "koopa.h"
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+export module opt.ir;
+
+import ir.type;
+
+export namespace opt {
+
+class Value;
+class BasicBlock;
+class Function;
+class Module;
+
+/**
+ * @brief The kind of a value: constants, references and instructions.
+ */
+// clang-format off
+enum class Op {
+  // constants & references
+  Integer, ZeroInit, Undef, Aggregate, FuncArg, BlockArg, GlobalAlloc,
+  // instructions
+  Alloc, Load, Store, GetPtr, GetElemPtr, Binary, Call,
+  // terminators
+  Branch, Jump, Return
+};
+
+/**
+ * @brief Binary operators, spelled as in the Koopa text format.
+ */
+enum class BinOp {
+  Ne, Eq, Gt, Lt, Ge, Le,
+  Add, Sub, Mul, Div, Mod,
+  And, Or, Xor, Shl, Shr, Sar
+};
+// clang-format on
+
+/**
+ * @brief A control flow edge carried by `jump` / `br`.
+ */
+struct Edge {
+  BasicBlock *target = nullptr; ///< Destination block.
+  std::vector<Value *> args;    ///< Arguments bound to the target's params.
+};
+
+/**
+ * @brief A Koopa value: a constant, an argument reference or an instruction.
+ *
+ * Operand layout per op:
+ * | Op | operands | extra |
+ * | :--- | :--- | :--- |
+ * | `Load` | `{src}` | |
+ * | `Store` | `{value, dest}` | |
+ * | `GetPtr` / `GetElemPtr` | `{src, index}` | |
+ * | `Binary` | `{lhs, rhs}` | `binop` |
+ * | `Call` | arguments | `callee` |
+ * | `Branch` | `{cond}` | `edges = {true, false}` |
+ * | `Jump` | `{}` | `edges = {target}` |
+ * | `Return` | `{}` or `{value}` | |
+ * | `Aggregate` | elements | |
+ * | `GlobalAlloc` | `{init}` | |
+ * | `Integer` | | `imm` = value |
+ * | `FuncArg` / `BlockArg` | | `imm` = index |
+ */
+class Value {
+public:
+  // clang-format off
+  Op op;
+  std::shared_ptr<type::Type> ty;  ///< Result type (`VoidType` for unit).
+  std::string name;                ///< Symbol name ("@x_1", "%0"), may be empty.
+  std::vector<Value *> operands;   ///< Used values, see the table above.
+  std::vector<Edge> edges;         ///< Successor edges of `jump` / `br`.
+  BasicBlock *parent = nullptr;    ///< Owning block (instructions, block args).
+  Function *callee = nullptr;      ///< Callee of `call`.
+  BinOp binop = BinOp::Add;        ///< Operator of `Binary`.
+  int imm = 0;                     ///< Integer value or argument index.
+  // clang-format on
+
+  Value(Op _op, std::shared_ptr<type::Type> _ty,
+        std::vector<Value *> _operands = {})
+      : op(_op), ty(std::move(_ty)), operands(std::move(_operands)) {}
+
+  auto isInt() const -> bool { return op == Op::Integer; }
+  auto isInt(int val) const -> bool { return op == Op::Integer && imm == val; }
+  auto isInst() const -> bool { return op >= Op::Alloc; }
+  auto isTerminator() const -> bool { return op >= Op::Branch; }
+
+  /**
+   * @brief Whether executing the instruction is observable besides its
+   * result: memory writes, calls and control transfers.
+   */
+  auto hasSideEffects() const -> bool {
+    return op == Op::Store || op == Op::Call || isTerminator();
+  }
+
+  /**
+   * @brief Visits every used value by reference, including edge arguments,
+   * so callers can both inspect and rewrite operands.
+   */
+  template <typename F> auto forEachUse(F &&fn) -> void {
+    for (auto &use : operands) {
+      fn(use);
+    }
+    for (auto &edge : edges) {
+      for (auto &arg : edge.args) {
+        fn(arg);
+      }
+    }
+  }
+};
+
+/**
+ * @brief A basic block: optional parameters plus a list of instructions
+ * terminated by `br`, `jump` or `ret`.
+ */
+class BasicBlock {
+public:
+  using iterator = std::list<std::unique_ptr<Value>>::iterator;
+
+  // clang-format off
+  std::string name;                           ///< Label, e.g. "%while_entry_1".
+  Function *parent = nullptr;                 ///< Owning function.
+  std::vector<std::unique_ptr<Value>> params; ///< Block arguments.
+  std::list<std::unique_ptr<Value>> insts;    ///< Instructions in order.
+  // clang-format on
+
+  BasicBlock(std::string _name) : name(std::move(_name)) {}
+
+  /**
+   * @brief Returns the terminator, or nullptr if the block is not closed.
+   */
+  auto terminator() const -> Value * {
+    if (insts.empty() || !insts.back()->isTerminator()) {
+      return nullptr;
+    }
+    return insts.back().get();
+  }
+
+  /**
+   * @brief Successor blocks in edge order (may contain duplicates).
+   */
+  auto succs() const -> std::vector<BasicBlock *> {
+    std::vector<BasicBlock *> res;
+    if (auto term = terminator()) {
+      for (const auto &edge : term->edges) {
+        res.push_back(edge.target);
+      }
+    }
+    return res;
+  }
+
+  /**
+   * @brief Inserts an instruction before `pos` and takes ownership of it.
+   */
+  auto insert(iterator pos, std::unique_ptr<Value> inst) -> Value * {
+    inst->parent = this;
+    return insts.insert(pos, std::move(inst))->get();
+  }
+
+  auto append(std::unique_ptr<Value> inst) -> Value * {
+    return insert(insts.end(), std::move(inst));
+  }
+
+  /**
+   * @brief Inserts an instruction right before the terminator (or at the end
+   * if the block is still open).
+   */
+  auto insertBeforeTerminator(std::unique_ptr<Value> inst) -> Value * {
+    auto pos = insts.end();
+    if (terminator()) {
+      pos = std::prev(pos);
+    }
+    return insert(pos, std::move(inst));
+  }
+
+  /**
+   * @brief Finds the position of an instruction owned by this block.
+   */
+  auto find(const Value *inst) -> iterator {
+    for (auto it = insts.begin(); it != insts.end(); ++it) {
+      if (it->get() == inst) {
+        return it;
+      }
+    }
+    return insts.end();
+  }
+
+  /**
+   * @brief Unlinks an instruction and hands its ownership to the caller.
+   */
+  auto detach(const Value *inst) -> std::unique_ptr<Value> {
+    auto it = find(inst);
+    auto res = std::move(*it);
+    insts.erase(it);
+    res->parent = nullptr;
+    return res;
+  }
+
+  /**
+   * @brief Destroys an instruction. It must not have any remaining use.
+   */
+  auto erase(const Value *inst) -> void { detach(inst); }
+
+  /**
+   * @brief Appends a new block parameter of the given type.
+   */
+  auto addParam(std::shared_ptr<type::Type> ty) -> Value * {
+    auto param = std::make_unique<Value>(Op::BlockArg, std::move(ty));
+    param->parent = this;
+    param->imm = static_cast<int>(params.size());
+    params.push_back(std::move(param));
+    return params.back().get();
+  }
+};
+
+/**
+ * @brief A function definition or declaration (no blocks).
+ */
+class Function {
+public:
+  using iterator = std::list<std::unique_ptr<BasicBlock>>::iterator;
+
+  // clang-format off
+  std::string name;                               ///< e.g. "@main".
+  std::shared_ptr<type::Type> retTy;              ///< `IntType` or `VoidType`.
+  std::vector<std::unique_ptr<Value>> params;     ///< `FuncArg` values.
+  std::list<std::unique_ptr<BasicBlock>> blocks;  ///< Front is the entry block.
+  Module *parent = nullptr;                       ///< Owning module.
+  int count_label = 0;                            ///< Counter for fresh labels.
+  // clang-format on
+
+  Function(std::string _name, std::shared_ptr<type::Type> _retTy)
+      : name(std::move(_name)), retTy(std::move(_retTy)) {}
+
+  auto isDecl() const -> bool { return blocks.empty(); }
+  auto entry() const -> BasicBlock * { return blocks.front().get(); }
+
+  /**
+   * @brief Creates a block with a fresh label `%<prefix>_opt<N>`.
+   *
+   * @param prefix Label stem, e.g. "preheader".
+   * @param before Insert position; appended at the end if nullptr.
+   */
+  auto newBlock(std::string_view prefix, BasicBlock *before = nullptr)
+      -> BasicBlock *;
+
+  /**
+   * @brief Destroys a block. No remaining edge may target it.
+   */
+  auto eraseBlock(BasicBlock *bb) -> void;
+
+  /**
+   * @brief Finds the position of a block owned by this function.
+   */
+  auto find(const BasicBlock *bb) -> iterator;
+
+  /**
+   * @brief Computes the predecessor lists of all blocks.
+   *
+   * A predecessor appears once per edge, so a `br` with identical targets
+   * contributes twice.
+   */
+  auto preds() const -> std::unordered_map<BasicBlock *, std::vector<BasicBlock *>>;
+
+  /**
+   * @brief Counts the instructions of all blocks.
+   */
+  auto instCount() const -> size_t;
+};
+
+/**
+ * @brief A whole Koopa program.
+ */
+class Module {
+public:
+  // clang-format off
+  std::vector<std::unique_ptr<Value>> globals;   ///< `GlobalAlloc` values.
+  std::list<std::unique_ptr<Function>> funcs;    ///< Declarations and definitions.
+  // clang-format on
+
+  /**
+   * @brief Returns the interned integer constant `val`.
+   */
+  auto getInt(int val) -> Value *;
+
+  /**
+   * @brief Creates a `zeroinit` constant of the given type.
+   */
+  auto getZeroInit(std::shared_ptr<type::Type> ty) -> Value *;
+
+  /**
+   * @brief Creates an `undef` constant of the given type.
+   */
+  auto getUndef(std::shared_ptr<type::Type> ty) -> Value *;
+
+  /**
+   * @brief Creates an aggregate constant `{e0, e1, ...}`.
+   */
+  auto getAggregate(std::shared_ptr<type::Type> ty, std::vector<Value *> elems)
+      -> Value *;
+
+  /**
+   * @brief Looks a function up by its IR name (e.g. "@main").
+   */
+  auto findFunc(std::string_view name) const -> Function *;
+
+  /**
+   * @brief Counts the instructions of all function bodies.
+   */
+  auto instCount() const -> size_t;
+
+  /**
+   * @brief Prints the module in the Koopa text format.
+   */
+  auto toKoopa() const -> std::string;
+
+  /**
+   * @brief Lifts a raw program produced by libkoopa.
+   */
+  static auto fromRaw(const koopa_raw_program_t &raw) -> std::unique_ptr<Module>;
+
+private:
+  std::map<int, std::unique_ptr<Value>> ints;  ///< Interned integers.
+  std::vector<std::unique_ptr<Value>> consts;  ///< Other constants.
+};
+
+/** @name Type Helpers
+ *  @{
+ */
+/**
+ * @brief Structural type equality (types are not fully interned).
+ */
+auto sameType(const std::shared_ptr<type::Type> &a,
+              const std::shared_ptr<type::Type> &b) -> bool;
+
+/**
+ * @brief The pointee type of a pointer type.
+ */
+auto pointee(const std::shared_ptr<type::Type> &ty)
+    -> std::shared_ptr<type::Type>;
+
+/**
+ * @brief The size in bytes of a type on the 32-bit target.
+ */
+auto sizeOf(const std::shared_ptr<type::Type> &ty) -> int;
+/** @} */
+
+/** @name Instruction Factories
+ *  @brief Create detached instructions with correctly inferred types.
+ *  @{
+ */
+auto makeAlloc(std::shared_ptr<type::Type> ty, std::string name)
+    -> std::unique_ptr<Value>;
+auto makeLoad(Value *src) -> std::unique_ptr<Value>;
+auto makeStore(Value *val, Value *dest) -> std::unique_ptr<Value>;
+auto makeGetPtr(Value *src, Value *index) -> std::unique_ptr<Value>;
+auto makeGetElemPtr(Value *src, Value *index) -> std::unique_ptr<Value>;
+auto makeBinary(BinOp op, Value *lhs, Value *rhs) -> std::unique_ptr<Value>;
+auto makeCall(Function *callee, std::vector<Value *> args)
+    -> std::unique_ptr<Value>;
+auto makeBranch(Value *cond, BasicBlock *t, BasicBlock *f)
+    -> std::unique_ptr<Value>;
+auto makeJump(BasicBlock *target, std::vector<Value *> args = {})
+    -> std::unique_ptr<Value>;
+auto makeReturn(Value *val) -> std::unique_ptr<Value>;
+
+/**
+ * @brief Copies an instruction; operands and edges still refer to the
+ * original values and blocks.
+ */
+auto cloneInst(const Value &inst) -> std::unique_ptr<Value>;
+/** @} */
+
+/** @name Function Utilities
+ *  @{
+ */
+/**
+ * @brief Rewrites every use of `from` inside `func` to `to`.
+ */
+auto replaceAllUses(Function &func, Value *from, Value *to) -> void;
+
+/**
+ * @brief Rewrites all uses according to `mapping` in a single sweep.
+ */
+auto replaceAllUses(Function &func,
+                    const std::unordered_map<Value *, Value *> &mapping)
+    -> void;
+
+/**
+ * @brief Maps every value used in `func` to the instructions using it.
+ */
+auto collectUsers(Function &func)
+    -> std::unordered_map<Value *, std::vector<Value *>>;
+
+/**
+ * @brief Blocks reachable from the entry, in reverse post-order.
+ */
+auto reversePostOrder(const Function &func) -> std::vector<BasicBlock *>;
+
+/**
+ * @brief Evaluates `lhs op rhs` with the target's 32-bit semantics.
+ * @return false if the operation traps (division by zero).
+ */
+auto foldBinary(BinOp op, int lhs, int rhs, int &res) -> bool;
+
+/**
+ * @brief The Koopa spelling of a binary operator ("add", "ne", ...).
+ */
+auto binOpName(BinOp op) -> std::string_view;
+/** @} */
+
+} // namespace opt
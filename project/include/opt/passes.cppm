@@ -0,0 +1,377 @@
+/**
+ * @file passes.cppm
+ * @brief Optimization passes over the in-memory Koopa IR.
+ *
+ * Every pass rewrites a function (or the whole module) in place and reports
+ * whether it changed anything, so pipelines can iterate to a fixpoint.
+ * Function passes that need the dominator tree or loops take them from an
+ * `AnalysisManager`; the pipeline invalidates whatever a changing pass does
+ * not preserve.
+ */
+
+module;
+
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+export module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+export namespace opt {
+
+/**
+ * @brief Optimizer settings, filled in from the command line.
+ */
+struct Options {
+  // clang-format off
+  int inlineThreshold = 60;       ///< `-inline-threshold=N`: cost limit outside loops.
+  int inlineRecursionDepth = 1;   ///< `-inline-recursion-depth=N`: recursive unfolding.
+  int inlineCallerLimit = 6000;   ///< `-inline-caller-limit=N`: caller size cap.
+  int unrollFactor = 4;           ///< `-unroll-factor=N`: copies per partial unroll.
+  int unrollLimit = 256;          ///< `-unroll-full-limit=N`: unrolled loop size cap.
+  int specializeBudget = 400;     ///< `-specialize-budget=N`: instructions added by clones.
+  int tileSize = 16;              ///< `-tile-size=N`: iterations per tile, 0 disables tiling.
+  int cacheSize = 32768;          ///< `-cache-size=N`: data cache bytes assumed by tiling.
+  bool vectorize = false;         ///< `-march=rv32imv`: use the vector extension.
+  int level = 2;                  ///< `-O<N>`: preset pipeline, `-perf` is `-O2`.
+  std::string passes;             ///< `-passes=a,b,c`: pipeline replacing the preset.
+  bool timePasses = false;        ///< `-time-passes`: report the cost of every pass.
+  std::set<std::string, std::less<>> remarks; ///< `-Rpass=<name>`: passes that report.
+  // clang-format on
+
+  auto wantsRemarks(std::string_view pass) const -> bool {
+    return remarks.contains(pass);
+  }
+};
+
+/**
+ * @brief Applies a single optimizer flag such as `-inline-threshold=100`.
+ * @return false if `arg` is not an optimizer flag.
+ */
+auto parseOption(Options &options, std::string_view arg) -> bool;
+
+/**
+ * @brief Inlines calls bottom-up over the call graph's SCCs.
+ *
+ * The cost of a call site is the callee's size, discounted for constant
+ * arguments and for callees with a single call site; the threshold grows
+ * with the loop depth of the call. Recursive callees are unfolded up to
+ * `inlineRecursionDepth` times. Functions left without callers (other than
+ * `@main`) are deleted.
+ *
+ * @return true if the module changed.
+ */
+auto inlineFunctions(Module &module, const Options &options) -> bool;
+
+/**
+ * @brief Interprocedural constant propagation.
+ *
+ * A parameter that receives the same constant at every call site, possibly
+ * through parameters of the callers, is replaced by it in the callee (loads
+ * of the slot the parameter was copied to included), and the callee is
+ * constant folded.
+ *
+ * @return true if the module changed.
+ */
+auto propagateConstantArgs(Module &module) -> bool;
+
+/**
+ * @brief Clones callees for hot call sites passing constants.
+ *
+ * A call site is hot when it lies in a loop or the callee is recursive and
+ * passes the constants on to itself. Call sites with the same constants
+ * share a clone; clones add at most `specializeBudget` instructions.
+ *
+ * @return true if the module changed.
+ */
+auto specializeFunctions(Module &module, const Options &options) -> bool;
+
+/**
+ * @brief Turns self-recursive calls in tail position into a loop.
+ *
+ * The entry block's code moves to a loop header whose block parameters
+ * replace the function parameters; tail calls jump back to it with their
+ * arguments. Calls passing the address of a local are kept.
+ *
+ * @return true if the function changed.
+ */
+auto eliminateTailCalls(Function &func) -> bool;
+
+/**
+ * @brief Turns scalar globals accessed by a single non-recursive function
+ * into locals of it.
+ *
+ * The global's address must not escape, and the function must be `@main`
+ * or store to the global before every load of it, so that no value is
+ * carried from one call to the next.
+ *
+ * @return true if the module changed.
+ */
+auto localizeGlobals(Module &module) -> bool;
+
+/**
+ * @brief Deletes calls to functions without side effects whose result is
+ * unused, and reuses the result of a dominating pure call with the same
+ * arguments.
+ *
+ * @return true if the module changed.
+ */
+auto eliminatePureCalls(Module &module) -> bool;
+
+/**
+ * @brief Deletes all blocks not reachable from the entry block.
+ * @return true if any block was deleted.
+ */
+auto removeUnreachableBlocks(Function &func) -> bool;
+
+/**
+ * @brief Aggressive dead code elimination.
+ *
+ * Deletes blocks unreachable from the entry, then marks everything that
+ * (transitively) feeds a side effect as live and sweeps the rest, including
+ * unused block parameters and the edge arguments bound to them.
+ *
+ * @return true if the function changed.
+ */
+auto eliminateDeadCode(Function &func) -> bool;
+
+/**
+ * @brief CFG simplification and jump threading.
+ *
+ * Folds constant and two-way-identical branches, forwards edges through
+ * blocks that only `jump`, threads edges through blocks whose branch
+ * condition is known on that edge, and merges blocks into their single
+ * predecessor, iterating until nothing changes.
+ *
+ * @return true if the function changed.
+ */
+auto simplifyCFG(Function &func) -> bool;
+
+/**
+ * @brief Redundant load elimination and store-to-load forwarding.
+ *
+ * Loads of a location whose value is known on every path, from an earlier
+ * load or store, are replaced by that value. Distinct objects never alias,
+ * and calls only clobber memory if the callee may write it.
+ *
+ * @return true if the function changed.
+ */
+auto eliminateRedundantLoads(Function &func, AnalysisManager &am) -> bool;
+
+/**
+ * @brief Dead store elimination.
+ *
+ * Deletes stores whose location is overwritten on every path before it is
+ * read, or never read again: non-escaping locals die at `ret`. A loop that
+ * fills a local subarray element by element kills earlier stores to it,
+ * such as the zeros of an `= {}` initializer.
+ *
+ * @return true if the function changed.
+ */
+auto eliminateDeadStores(Function &func, AnalysisManager &am) -> bool;
+
+/**
+ * @brief Algebraic simplification of binary instructions.
+ *
+ * Folds constants, removes identities such as `add %x, 0` and double
+ * negations, reassociates constants, turns multiplication by powers of two
+ * into shifts and tests of comparisons into the comparisons themselves, and
+ * brings operands into a canonical order. A worklist runs the rules until
+ * none applies.
+ *
+ * @return true if the function changed.
+ */
+auto combineInstructions(Function &func) -> bool;
+
+/**
+ * @brief Value range propagation.
+ *
+ * Folds integer instructions whose range holds a single value, such as
+ * comparisons decided by an enclosing branch, and turns division and
+ * remainder of non-negative values by powers of two into shifts and masks.
+ *
+ * @return true if the function changed.
+ */
+auto simplifyWithRanges(Function &func, AnalysisManager &am) -> bool;
+
+/**
+ * @brief Partial redundancy elimination by lazy code motion.
+ *
+ * Inserts arithmetic and address computations on the edges where they are
+ * missing so that computations repeated on some paths, loop invariants
+ * included, become fully redundant and can be removed. Insertions are placed
+ * as late as possible to keep the new values short-lived. May split edges.
+ *
+ * @return true if the function changed.
+ */
+auto eliminatePartialRedundancies(Function &func, AnalysisManager &am)
+    -> bool;
+
+/**
+ * @brief Loop-invariant code motion.
+ *
+ * Gives every natural loop a preheader and hoists pure instructions, loads
+ * from memory the loop never writes and calls to side-effect free functions
+ * into it, innermost loops first.
+ *
+ * @return true if the function changed.
+ */
+auto hoistLoopInvariants(Function &func, AnalysisManager &am) -> bool;
+
+/**
+ * @brief Strength reduction of address computations indexed by induction
+ * variables.
+ *
+ * `base[i + c]` with an invariant base becomes a load of a pointer slot that
+ * the loop advances alongside `i`. Induction variables left without other
+ * uses are deleted, moving the exit test to another induction variable with
+ * the same step if needed.
+ *
+ * @return true if the function changed.
+ */
+auto strengthReduceLoops(Function &func, AnalysisManager &am) -> bool;
+
+/**
+ * @brief Unrolls innermost counted loops.
+ *
+ * A loop is counted when its only exit test compares a scalar counter,
+ * stepped by a constant once per iteration, against a loop-invariant bound.
+ * With a constant trip count the loop is unrolled completely if the result
+ * stays below `unrollLimit` instructions, and otherwise `unrollFactor`
+ * times after peeling the remainder iterations. With an unknown trip count
+ * a top-tested loop gets an unrolled copy guarded by a runtime check, and
+ * the original loop runs the remaining iterations.
+ *
+ * @return true if the function changed.
+ */
+auto unrollLoops(Function &func, AnalysisManager &am, const Options &options)
+    -> bool;
+
+/**
+ * @brief Interchange and tiling of perfect two-level loop nests.
+ *
+ * Swaps the loops of a nest over constant ranges when the inner loop then
+ * walks memory with smaller strides, provided no dependence is reordered.
+ * An inner loop that still strides by whole cache lines while the outer
+ * loop reuses them, and touches more than `cacheSize` bytes of such lines,
+ * is split into tiles of `tileSize` iterations run by a new outermost loop.
+ *
+ * @return true if the function changed.
+ */
+auto optimizeLoopNests(Function &func, AnalysisManager &am,
+                       const Options &options) -> bool;
+
+/**
+ * @brief Replaces simple array loops by calls to RVV vector routines.
+ *
+ * Only runs when `vectorize` is set. Elementwise `add` / `sub` / `mul` and
+ * copy loops, sums and dot products over `i32` arrays indexed by a counter
+ * stepping by 1 become a call to a `@__rvv_*` declaration whose body the
+ * backend emits. Sources that may overlap the destination are checked at
+ * run time, falling back to the scalar loop.
+ *
+ * @return true if the function changed.
+ */
+auto vectorizeLoops(Function &func, AnalysisManager &am, const Options &options)
+    -> bool;
+
+/**
+ * @brief Scalar replacement of small local arrays.
+ *
+ * An array of at most 16 elements that is only indexed by constants and
+ * whose element addresses are only loaded from and stored to is split into
+ * one `alloc i32` per element.
+ *
+ * @return true if the function changed.
+ */
+auto splitLocalArrays(Function &func) -> bool;
+
+/** @name Loop Utilities
+ *  @{
+ */
+/**
+ * @brief Returns the loop's preheader, creating one if needed.
+ *
+ * A preheader is the unique block outside the loop that jumps to the header
+ * and nowhere else. A new one takes over all entering edges and forwards
+ * their arguments to the header.
+ */
+auto getOrInsertPreheader(Function &func, const Loop &loop) -> BasicBlock *;
+/** @} */
+
+/**
+ * @brief Where a pass runs.
+ */
+enum class PassKind {
+  Module,   ///< Once over the whole module.
+  Function, ///< Once per function definition.
+  Loop,     ///< Once per function with loops, over its loop forest.
+};
+
+/**
+ * @brief A registered pass, as named in `-passes=`.
+ */
+struct Pass;
+
+/**
+ * @brief Runs a pipeline of named passes.
+ *
+ * Consecutive function and loop passes form a group that runs one function
+ * at a time, so the analyses of a function stay cached between them. A
+ * module pass runs on its own and drops every cached analysis. Within a
+ * group, a pass is skipped on a function that has not changed since the
+ * pass last left it unchanged.
+ */
+class PassManager {
+public:
+  explicit PassManager(const Options &_options) : options(_options) {}
+
+  /**
+   * @brief Appends the passes of a comma-separated list such as
+   * `inline,simplifycfg,dce`.
+   * @return false if a name is unknown, adding nothing.
+   */
+  auto addPipeline(std::string_view pipeline) -> bool;
+
+  auto run(Module &module) -> void;
+
+private:
+  /// What the passes of one name cost (`-time-passes`).
+  struct Timing {
+    std::string_view name;
+    double seconds = 0;
+    long insts = 0; ///< Instructions added (negative if removed).
+    long bytes = 0; ///< Heap growth.
+    int runs = 0;
+  };
+
+  const Options &options;
+  std::vector<const Pass *> passes;
+  AnalysisManager am;
+  std::vector<Timing> timings;
+
+  auto runGroup(Module &module, const std::vector<const Pass *> &group)
+      -> void;
+
+  template <typename Size, typename Body>
+  auto measure(const Pass &pass, Size size, Body body) -> bool;
+
+  auto reportTimings() const -> void;
+};
+
+/**
+ * @brief The pipeline of `-O<level>`, for levels 0 to 2.
+ */
+auto presetPipeline(int level) -> std::string_view;
+
+/**
+ * @brief Runs `options.passes`, or the preset pipeline of `options.level`;
+ * this is what `-perf` does.
+ */
+auto optimize(Module &module, const Options &options = {}) -> void;
+
+} // namespace opt
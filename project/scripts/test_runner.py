@@ -14,9 +14,21 @@ BUILD_DIR = os.path.abspath("debug/test_temp")
 
 TEST_DIRS = [
     os.path.abspath("tests/resources/functional"),
-    os.path.abspath("tests/resources/hidden_functional")
+    os.path.abspath("tests/resources/hidden_functional"),
+    os.path.abspath("tests/resources/optimizer")
 ]
 
+# Compiler flags per mode. Every flag set of a mode runs each test once.
+COMPILE_FLAGS = {
+    "koopa": ["-koopa"],
+    "riscv": ["-riscv"],
+    "perf": ["-perf", "-O1"],
+    "rvv": ["-perf -march=rv32imv"],
+}
+
+# qemu with the vector extension, for code built with -march=rv32imv
+QEMU_RVV = "qemu-riscv32-static -cpu rv32,v=true,vlen=128"
+
 # ===========================================
 
 class Colors:
@@ -56,9 +68,11 @@ def run_cmd(cmd, input_str=None):
     except subprocess.TimeoutExpired:
         return "", "Timeout", -1
 
-def run_test_case(mode, src_file):
+def run_test_case(mode, src_file, compile_flag):
     base_name = os.path.basename(src_file)
     name_no_ext = os.path.splitext(base_name)[0]
+    if len(COMPILE_FLAGS[mode]) > 1:
+        name_no_ext += compile_flag.split()[0].replace("-", "_")
 
     # 文件路径
     input_file = src_file.replace(".sy", ".in")
@@ -77,7 +91,6 @@ def run_test_case(mode, src_file):
     print(f"Testing {name_no_ext} ... ", end='', flush=True)
 
     # 编译阶段 (SysY -> IR/ASM)
-    compile_flag = "-koopa" if mode == "koopa" else "-riscv"
     output_target = output_koopa if mode == "koopa" else output_asm
     
     cmd_compile = f"{COMPILER_PATH} {compile_flag} {src_file} -o {output_target}"
@@ -107,12 +120,13 @@ def run_test_case(mode, src_file):
             return False
         cmd_run = f"{output_exe}"
         
-    elif mode == "riscv":
-        # ./compiler -riscv hello.c -o hello.S
+    else:
+        # ./compiler -riscv hello.c -o hello.S   (or -perf, -O1, -perf -march=rv32imv)
         # clang hello.S -c -o hello.o -target riscv32-unknown-linux-elf -march=rv32im -mabi=ilp32
         # ld.lld hello.o -L$CDE_LIBRARY_PATH/riscv32 -lsysy -o hello
         # qemu-riscv32-static hello
-        cmd_asm = f"clang {output_asm} -c -o {output_obj} -target riscv32-unknown-linux-elf -march=rv32im -mabi=ilp32"
+        march = "rv32imv" if mode == "rvv" else "rv32im"
+        cmd_asm = f"clang {output_asm} -c -o {output_obj} -target riscv32-unknown-linux-elf -march={march} -mabi=ilp32"
         out, err, ret = run_cmd(cmd_asm)
         if ret != 0:
             print(f"{Colors.FAIL}Assemble Error{Colors.ENDC}")
@@ -126,7 +140,8 @@ def run_test_case(mode, src_file):
             print(err)
             return False
             
-        cmd_run = f"qemu-riscv32-static {output_exe}"
+        qemu = QEMU_RVV if mode == "rvv" else "qemu-riscv32-static"
+        cmd_run = f"{qemu} {output_exe}"
 
     # 先检查输出值是否匹配
     out, err, ret = run_cmd(cmd_run, stdin_content)
@@ -149,7 +164,7 @@ def run_test_case(mode, src_file):
 
 def main():
     parser = argparse.ArgumentParser(description="SysY Compiler Test Script")
-    parser.add_argument('mode', choices=['koopa', 'riscv'], help="Test mode")
+    parser.add_argument('mode', choices=list(COMPILE_FLAGS), help="Test mode: koopa, riscv, perf (-perf and -O1) or rvv (-march=rv32imv under qemu with V)")
     parser.add_argument('--file', help="Run specific test file", default=None)
     args = parser.parse_args()
 
@@ -173,9 +188,10 @@ def main():
     print(f"Compiler: {COMPILER_PATH}")
     
     for f in test_files:
-        total += 1
-        if run_test_case(args.mode, f):
-            passed += 1
+        for flag in COMPILE_FLAGS[args.mode]:
+            total += 1
+            if run_test_case(args.mode, f, flag):
+                passed += 1
             
     print("="*30)
     color = Colors.OKGREEN if passed == total else Colors.FAIL
@@ -97,6 +97,12 @@
  * results.
  * - `stk_frame_size`: Total size of the current stack frame, aligned to 16
  * bytes (RISC-V calling convention).
+ *
+ * ### Vector Routines
+ * With `-march=rv32imv` the optimizer turns simple array loops into calls
+ * to `@__rvv_*` declarations. Their bodies are emitted once per program as
+ * leaf functions that strip-mine the arrays with `vsetvli` (`e32`, `m8`),
+ * enabling the `v` extension only for themselves via `.option arch`.
  */
 
 module;
@@ -104,7 +110,9 @@ module;
 #include "koopa.h"
 #include <cassert>
 #include <fmt/core.h>
+#include <map>
 #include <ranges>
+#include <set>
 #include <span>
 #include <string>
 
@@ -136,6 +144,85 @@ template <typename ptrType> auto make_span(const koopa_raw_slice_t &slice) {
       reinterpret_cast<const ptrType *>(slice.buffer), slice.len);
 }
 
+/**
+ * @brief Finds the globals that no instruction can write.
+ *
+ * A global is read-only when its address, and every pointer derived from it
+ * with `getelemptr` / `getptr`, is only loaded from: never a `store`
+ * destination, and never stored, passed to a call or bound to a block
+ * parameter, where it could be written through. Tables such as the copies
+ * of local `const` arrays qualify.
+ */
+auto readOnlyGlobals(const koopa_raw_program_t &program)
+    -> std::set<koopa_raw_value_t> {
+  auto insts = [&](auto &&fn) {
+    for (const auto func : make_span<koopa_raw_function_t>(program.funcs)) {
+      for (const auto bb : make_span<koopa_raw_basic_block_t>(func->bbs)) {
+        for (const auto inst : make_span<koopa_raw_value_t>(bb->insts)) {
+          fn(inst);
+        }
+      }
+    }
+  };
+
+  // the global each derived pointer points into
+  std::map<koopa_raw_value_t, koopa_raw_value_t> root;
+  for (const auto value : make_span<koopa_raw_value_t>(program.values)) {
+    root[value] = value;
+  }
+  // block order need not follow dominance, so repeat until nothing is added
+  for (size_t known = 0; known != root.size();) {
+    known = root.size();
+    insts([&](koopa_raw_value_t inst) {
+      koopa_raw_value_t src = nullptr;
+      if (inst->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
+        src = inst->kind.data.get_elem_ptr.src;
+      } else if (inst->kind.tag == KOOPA_RVT_GET_PTR) {
+        src = inst->kind.data.get_ptr.src;
+      }
+      if (auto it = root.find(src); src && it != root.end()) {
+        root.emplace(inst, it->second);
+      }
+    });
+  }
+
+  std::set<koopa_raw_value_t> written;
+  auto escape = [&](koopa_raw_value_t val) {
+    if (auto it = root.find(val); val && it != root.end()) {
+      written.insert(it->second);
+    }
+  };
+  auto escapeAll = [&](const koopa_raw_slice_t &vals) {
+    for (const auto val : make_span<koopa_raw_value_t>(vals)) {
+      escape(val);
+    }
+  };
+  insts([&](koopa_raw_value_t inst) {
+    const auto &kind = inst->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_STORE:
+      escape(kind.data.store.value);
+      escape(kind.data.store.dest);
+      break;
+    case KOOPA_RVT_CALL: escapeAll(kind.data.call.args); break;
+    case KOOPA_RVT_JUMP: escapeAll(kind.data.jump.args); break;
+    case KOOPA_RVT_BRANCH:
+      escapeAll(kind.data.branch.true_args);
+      escapeAll(kind.data.branch.false_args);
+      break;
+    case KOOPA_RVT_RETURN: escape(kind.data.ret.value); break;
+    default: break;
+    }
+  });
+
+  std::set<koopa_raw_value_t> res;
+  for (const auto value : make_span<koopa_raw_value_t>(program.values)) {
+    if (!written.contains(value)) {
+      res.insert(value);
+    }
+  }
+  return res;
+}
 
 /**
  * @brief Calculates the size (in bytes) of a given Koopa type.
@@ -230,6 +317,84 @@ auto emitSw(std::string &buffer, std::string_view src, std::string_view base,
   }
 }
 
+/**
+ * @brief Assembly of the vector routine `name` (without `@__rvv_`).
+ *
+ * Arguments arrive in `a0`-`a3` as declared by the optimizer: `vv_<op>` and
+ * `vx_<op>` take `(dst, a, b or x, n)`, `redsum` takes `(a, n)`, `dot` and
+ * `disjoint` take `(a, b, n)`. Only `t0`, `t1` and vector registers are
+ * clobbered, all of which are caller-saved.
+ */
+auto vectorRoutine(std::string_view name) -> std::string {
+  std::string res = fmt::format("\n  .text\n__rvv_{}:\n", name);
+  if (name == "disjoint") {
+    // p[0..n) and q[0..n) are the same or do not overlap
+    res += "  slli a2, a2, 2\n"
+           "  add t0, a0, a2\n"
+           "  add t1, a1, a2\n"
+           "  sltu t0, a1, t0\n"
+           "  sltu t1, a0, t1\n"
+           "  and t0, t0, t1\n"
+           "  xor t1, a0, a1\n"
+           "  seqz t1, t1\n"
+           "  seqz t0, t0\n"
+           "  or a0, t0, t1\n"
+           "  ret\n";
+    return res;
+  }
+  if (name == "redsum" || name == "dot") {
+    bool dot = name == "dot";
+    auto n = dot ? "a2" : "a1";
+    res += "  vsetivli zero, 1, e32, m1, ta, ma\n"
+           "  vmv.s.x v24, zero\n";
+    res += fmt::format("  blez {}, 2f\n", n);
+    res += fmt::format("1:\n  vsetvli t0, {}, e32, m8, ta, ma\n", n);
+    res += "  vle32.v v8, (a0)\n";
+    if (dot) {
+      res += "  vle32.v v16, (a1)\n"
+             "  vmul.vv v8, v8, v16\n";
+    }
+    res += "  vredsum.vs v24, v8, v24\n";
+    res += fmt::format("  sub {0}, {0}, t0\n", n);
+    res += "  slli t0, t0, 2\n"
+           "  add a0, a0, t0\n";
+    if (dot) {
+      res += "  add a1, a1, t0\n";
+    }
+    res += fmt::format("  bnez {}, 1b\n", n);
+    res += "2:\n"
+           "  vmv.x.s a0, v24\n"
+           "  ret\n";
+    return res;
+  }
+
+  // vv_<op> / vx_<op>: dst[k] = a[k] op b[k] / a[k] op x
+  bool scalar = name.starts_with("vx_");
+  auto op = name.substr(3);
+  res += "  blez a3, 2f\n"
+         "1:\n"
+         "  vsetvli t0, a3, e32, m8, ta, ma\n"
+         "  vle32.v v8, (a1)\n";
+  if (scalar) {
+    res += fmt::format("  v{}.vx v8, v8, a2\n", op);
+  } else {
+    res += "  vle32.v v16, (a2)\n";
+    res += fmt::format("  v{}.vv v8, v8, v16\n", op);
+  }
+  res += "  vse32.v v8, (a0)\n"
+         "  sub a3, a3, t0\n"
+         "  slli t0, t0, 2\n"
+         "  add a0, a0, t0\n"
+         "  add a1, a1, t0\n";
+  if (!scalar) {
+    res += "  add a2, a2, t0\n";
+  }
+  res += "  bnez a3, 1b\n"
+         "2:\n"
+         "  ret\n";
+  return res;
+}
+
 } // namespace backend
 
 using namespace backend;
@@ -244,6 +409,7 @@ using namespace std::views;
  * @param program The root node of the Koopa IR.
  */
 auto TargetCodeGen::visit(const koopa_raw_program_t &program) -> void {
+  read_only = readOnlyGlobals(program);
   for (const auto value : make_span<koopa_raw_value_t>(program.values)) {
     visit(value);
   }
@@ -251,6 +417,14 @@ auto TargetCodeGen::visit(const koopa_raw_program_t &program) -> void {
   for (const auto func : make_span<koopa_raw_function_t>(program.funcs)) {
     visit(func);
   }
+
+  if (!vector_routines.empty()) {
+    buffer += "\n  .option push\n  .option arch, +v\n";
+    for (const auto &name : vector_routines) {
+      buffer += vectorRoutine(name);
+    }
+    buffer += "  .option pop\n";
+  }
 }
 
 /**
@@ -269,8 +443,24 @@ auto TargetCodeGen::visit(koopa_raw_function_t func) -> void {
 
   // --- Stack Frame Calculation (Pre-pass) ---
   bool has_callee = false;
+  int edge_args = 0;
   for (const auto bb : make_span<koopa_raw_basic_block_t>(func->bbs)) {
+    // Block parameters live in stack slots like instruction results.
+    for (const auto param : make_span<koopa_raw_value_t>(bb->params)) {
+      stkMap[param] = local_frame_size;
+      local_frame_size += 4;
+    }
+
     for (const auto inst : make_span<koopa_raw_value_t>(bb->insts)) {
+      if (inst->kind.tag == KOOPA_RVT_JUMP) {
+        edge_args = std::max<int>(edge_args, inst->kind.data.jump.args.len);
+      } else if (inst->kind.tag == KOOPA_RVT_BRANCH) {
+        const auto &branch = inst->kind.data.branch;
+        edge_args = std::max<int>(
+            {edge_args, static_cast<int>(branch.true_args.len),
+             static_cast<int>(branch.false_args.len)});
+      }
+
       // If this function calls another, we need to save RA and potentially
       // allocate space for outgoing arguments.
       if (inst->kind.tag == KOOPA_RVT_CALL) {
@@ -295,6 +485,10 @@ auto TargetCodeGen::visit(koopa_raw_function_t func) -> void {
     }
   }
 
+  // Edge arguments are staged here first, as a parallel copy.
+  edge_scratch = local_frame_size;
+  local_frame_size += edge_args > 1 ? edge_args * 4 : 0;
+
   // RISC-V convention: first 8 args are in a0-a7, rest on stack.
   // args_size here becomes the number of 4-byte slots needed for outgoing args.
   args_size = std::max<int>(args_size - 8, 0) * 4;
@@ -323,6 +517,7 @@ auto TargetCodeGen::visit(koopa_raw_function_t func) -> void {
   for (auto &[key, val] : stkMap) {
     val += args_size;
   }
+  edge_scratch += args_size;
 
   // --- Parameter Handling ---
 
@@ -431,8 +626,9 @@ auto TargetCodeGen::visit(koopa_raw_value_t value) -> void {
   }
 
   case KOOPA_RVT_GLOBAL_ALLOC: {
-    // Global variable allocation in the .data section.
-    buffer += "  .data\n";
+    // Global variable allocation in the .data section, or in .rodata if
+    // nothing writes it.
+    buffer += read_only.contains(value) ? "  .section .rodata\n" : "  .data\n";
     buffer += fmt::format("  .global {}\n", value->name + 1);
     buffer += fmt::format("{}:\n", value->name + 1);
     visit(kind.data.global_alloc);
@@ -474,9 +670,21 @@ auto TargetCodeGen::visit(koopa_raw_value_t value) -> void {
  */
 auto TargetCodeGen::visit(const koopa_raw_branch_t &branch) -> void {
   load_to(branch.cond, "t0");
-  // bnez: branch if not equal to zero.
-  buffer += fmt::format("  bnez t0, {}\n", branch.true_bb->name + 1);
+  if (branch.true_args.len == 0 && branch.false_args.len == 0) {
+    // bnez: branch if not equal to zero.
+    buffer += fmt::format("  bnez t0, {}\n", branch.true_bb->name + 1);
+    buffer += fmt::format("  j {}\n", branch.false_bb->name + 1);
+    return;
+  }
+
+  // Each edge passes its own arguments, so the true edge gets a stub.
+  auto stub = fmt::format(".Lbr_args_{}", branch_count++);
+  buffer += fmt::format("  bnez t0, {}\n", stub);
+  emitEdgeArgs(branch.false_bb, branch.false_args);
   buffer += fmt::format("  j {}\n", branch.false_bb->name + 1);
+  buffer += fmt::format("{}:\n", stub);
+  emitEdgeArgs(branch.true_bb, branch.true_args);
+  buffer += fmt::format("  j {}\n", branch.true_bb->name + 1);
 }
 
 /**
@@ -485,10 +693,40 @@ auto TargetCodeGen::visit(const koopa_raw_branch_t &branch) -> void {
  * @param jump The Koopa jump instruction data.
  */
 auto TargetCodeGen::visit(const koopa_raw_jump_t &jump) -> void {
+  emitEdgeArgs(jump.target, jump.args);
   std::string target_name = jump.target->name + 1;
   buffer += fmt::format("  j {}\n", target_name);
 }
 
+/**
+ * @brief Passes the arguments of a control-flow edge.
+ *
+ * An argument may be one of the target's own parameters (e.g. swapped on a
+ * loop back edge), so with several arguments all of them are read into the
+ * staging area before any parameter slot is written.
+ *
+ * @param target The block the edge leads to.
+ * @param args The values bound to the target's parameters.
+ */
+auto TargetCodeGen::emitEdgeArgs(koopa_raw_basic_block_t target,
+                                 const koopa_raw_slice_t &args) -> void {
+  auto values = make_span<koopa_raw_value_t>(args);
+  auto params = make_span<koopa_raw_value_t>(target->params);
+  if (values.size() == 1) {
+    load_to(values[0], "t0");
+    emitSw(buffer, "t0", "sp", stkMap[params[0]]);
+    return;
+  }
+  for (const auto [i, value] : values | enumerate) {
+    load_to(value, "t0");
+    emitSw(buffer, "t0", "sp", edge_scratch + static_cast<int>(i) * 4);
+  }
+  for (const auto [i, param] : params | enumerate) {
+    emitLw(buffer, "t0", "sp", edge_scratch + static_cast<int>(i) * 4);
+    emitSw(buffer, "t0", "sp", stkMap[param]);
+  }
+}
+
 /**
  * @brief Generates assembly for a load instruction.
  *
@@ -577,6 +815,7 @@ auto TargetCodeGen::load_to(const koopa_raw_value_t &value,
   case KOOPA_RVT_GET_PTR:
   case KOOPA_RVT_CALL:
   case KOOPA_RVT_FUNC_ARG_REF:
+  case KOOPA_RVT_BLOCK_ARG_REF:
   case KOOPA_RVT_BINARY:
   case KOOPA_RVT_LOAD: {
     int offset = stkMap[value];
@@ -616,7 +855,11 @@ auto TargetCodeGen::visit(const koopa_raw_call_t &call) -> void {
     ++i;
   }
   // The callee's name starts with '@', so skip first char.
-  buffer += fmt::format("  call {}\n", call.callee->name + 1);
+  std::string_view callee = call.callee->name + 1;
+  if (callee.starts_with("__rvv_")) {
+    vector_routines.emplace(callee.substr(6));
+  }
+  buffer += fmt::format("  call {}\n", callee);
 }
 
 /**
@@ -660,18 +903,25 @@ auto TargetCodeGen::visit(const koopa_raw_global_alloc_t &global_alloc)
  *
  * Compute address of `src[index]`.
  * `src` is expected to be a pointer to an array (e.g., `[[i32, 10], 5]*`).
- * The stride is the size of the array's element type.
+ * The stride is the size of the array's element type; a constant index
+ * folds into a single `addi`.
  *
  * @param get_elem_ptr The Koopa GEP instruction data.
  */
 auto TargetCodeGen::visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
     -> void {
   load_to(get_elem_ptr.src, "t0");
-  load_to(get_elem_ptr.index, "t1");
 
   auto stride =
       get_type_size(get_elem_ptr.src->ty->data.pointer.base->data.array.base);
 
+  if (get_elem_ptr.index->kind.tag == KOOPA_RVT_INTEGER) {
+    emitAddi(buffer, "t0", "t0",
+             get_elem_ptr.index->kind.data.integer.value *
+                 static_cast<int>(stride));
+    return;
+  }
+  load_to(get_elem_ptr.index, "t1");
   buffer += fmt::format("  li t2, {}\n", stride);
   buffer += "  mul t1, t1, t2\n";
   buffer += "  add t0, t0, t1\n";
@@ -682,17 +932,23 @@ auto TargetCodeGen::visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr)
  *
  * Compute address of `src + index`.
  * `src` is a pointer (e.g., `i32*`).
- * The stride is the size of the type pointed to.
+ * The stride is the size of the type pointed to; a constant index folds into
+ * a single `addi`.
  *
  * @param get_ptr The Koopa getptr instruction data.
  */
 auto TargetCodeGen::visit(const koopa_raw_get_ptr_t &get_ptr) -> void {
 
   load_to(get_ptr.src, "t0");
-  load_to(get_ptr.index, "t1");
 
   auto stride = get_type_size(get_ptr.src->ty->data.pointer.base);
 
+  if (get_ptr.index->kind.tag == KOOPA_RVT_INTEGER) {
+    emitAddi(buffer, "t0", "t0",
+             get_ptr.index->kind.data.integer.value * static_cast<int>(stride));
+    return;
+  }
+  load_to(get_ptr.index, "t1");
   buffer += fmt::format("  li t2, {}\n", stride);
   buffer += "  mul t1, t1, t2\n";
   buffer += "  add t0, t0, t1\n";
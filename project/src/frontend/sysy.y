@@ -10,6 +10,7 @@
 #include <vector>
 
 import ir.ast;
+import symbol_table;
 
 // code in this will be inserted into sysy.lex.hpp
 }
@@ -29,36 +30,38 @@ int yylex();
 /**
  * @brief Error reporting function for Bison.
  */
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *str);
+void yyerror(BaseAST *&ast, Arena &arena, const char *str);
 
 // code in this will be inserted into sysy.lex.cpp
 %}
 
 /**
- * @brief Parameter passed to yyparse.
+ * @brief Parameters passed to yyparse: the resulting tree and the arena that
+ * holds it.
  */
-%parse-param { std::unique_ptr<ast::BaseAST> &ast }
+%parse-param { ast::BaseAST *&ast } { ast::Arena &arena }
 
 /**
  * @brief Semantic value types.
  */
 %union {
-  std::string *str_val;
+  const char *str_val;
+  Ident ident_val;
   int int_val;
   ast::BaseAST *ast_val;
   ast::InitValStmtAST *init_val;
-  std::vector<std::unique_ptr<ast::BaseAST>> *items_val;
-  std::vector<std::unique_ptr<ast::DefAST>> *defs_val;
-  std::vector<std::unique_ptr<ast::BaseAST>> *children_val;
-  std::vector<std::unique_ptr<ast::FuncParamAST>> *funcParams_val;
-  std::vector<std::unique_ptr<ast::ExprAST>> *args_val;
-  std::vector<std::unique_ptr<ast::InitValStmtAST>> *initialize_list_val;
+  ast::List<ast::BaseAST> *items_val;
+  ast::List<ast::DefAST> *defs_val;
+  ast::List<ast::BaseAST> *children_val;
+  ast::List<ast::FuncParamAST> *funcParams_val;
+  ast::List<ast::ExprAST> *args_val;
+  ast::List<ast::InitValStmtAST> *initialize_list_val;
 }
 
 // terminal letters are written in uppercase.
 %token VOID INT RETURN OR AND EQ NE LE GE PRIORITY 
 %token CONST IF ELSE WHILE BREAK CONTINUE
-%token <str_val> IDENT
+%token <ident_val> IDENT
 %token <int_val> INT_CONST
 
 %type <str_val> Btype
@@ -98,9 +101,7 @@ LVal          ::= IDENT {"[" Exp "]"};
  */
 CompUnit 
   : CompUnitItemList {
-    auto comp_unit = new CompUnitAST(std::move(*$1));
-    ast = std::unique_ptr<BaseAST>(static_cast<BaseAST *>(comp_unit));
-    delete $1;
+    ast = arena.make<CompUnitAST>(std::move(*$1));
   };
 
 /**
@@ -108,13 +109,12 @@ CompUnit
  */
 CompUnitItemList
   : CompUnitItem {
-    // unique_ptr automatic takeover of ownership of $1
-    $$ = new std::vector<std::unique_ptr<BaseAST>>();
-    $$->push_back(std::unique_ptr<BaseAST>($1));
+    $$ = arena.list<BaseAST>();
+    $$->push_back($1);
   }
   | CompUnitItemList CompUnitItem {
     $$ = $1;
-    $$->push_back(std::unique_ptr<BaseAST>($2));
+    $$->push_back($2);
   };
 
 CompUnitItem 
@@ -130,16 +130,10 @@ CompUnitItem
  */
 FuncDef
   : Btype IDENT '(' ')' Block {
-    auto params = std::vector<std::unique_ptr<FuncParamAST>>();
-    $$ = new FuncDefAST(std::move(*$1), std::move(*$2), std::move(params), $5);
-    delete $1;
-    delete $2;
+    $$ = arena.make<FuncDefAST>($1, $2, List<FuncParamAST>(), $5);
   }
   | Btype IDENT '(' FuncFParams ')' Block {
-    $$ = new FuncDefAST(std::move(*$1), std::move(*$2), std::move(*$4), $6);
-    delete $1;
-    delete $2;
-    delete $4;
+    $$ = arena.make<FuncDefAST>($1, $2, std::move(*$4), $6);
   };
 
 /**
@@ -147,41 +141,31 @@ FuncDef
  */
 FuncFParams 
   : FuncFParam {
-    $$ = new std::vector<std::unique_ptr<FuncParamAST>>();
-    $$->push_back(std::unique_ptr<FuncParamAST>(static_cast<FuncParamAST *>($1)));
+    $$ = arena.list<FuncParamAST>();
+    $$->push_back(static_cast<FuncParamAST *>($1));
   }
   | FuncFParams ',' FuncFParam {
     $$ = $1;
-    $$->push_back(std::unique_ptr<FuncParamAST>(static_cast<FuncParamAST *>($3)));
+    $$->push_back(static_cast<FuncParamAST *>($3));
   };
 
 FuncFParam
   : Btype IDENT {
-    $$ = new FuncParamAST(std::move(*$1), std::move(*$2), false, false, {});
-    delete $1;
-    delete $2;
+    $$ = arena.make<FuncParamAST>($1, $2, false, false, List<ExprAST>());
   }
   | Btype IDENT ParamArraySuffix {
-    $$ = new FuncParamAST(std::move(*$1), std::move(*$2), false, true, std::move(*$3));
-    delete $1;
-    delete $2;
-    delete $3;
+    $$ = arena.make<FuncParamAST>($1, $2, false, true, std::move(*$3));
   }
   | CONST Btype IDENT {
-    $$ = new FuncParamAST(std::move(*$2), std::move(*$3), true, false, {});
-    delete $2;
-    delete $3;
+    $$ = arena.make<FuncParamAST>($2, $3, true, false, List<ExprAST>());
   }
   | CONST Btype IDENT ParamArraySuffix {
-    $$ = new FuncParamAST(std::move(*$2), std::move(*$3), true, true, std::move(*$4));
-    delete $2;
-    delete $3;
-    delete $4;
+    $$ = arena.make<FuncParamAST>($2, $3, true, true, std::move(*$4));
   };
 
 ParamArraySuffix
   : '[' ']' {
-    $$ = new std::vector<std::unique_ptr<ExprAST>>();
+    $$ = arena.list<ExprAST>();
     $$->push_back(nullptr);
   }
   | '[' ']' ArraySuffix {
@@ -194,18 +178,17 @@ ParamArraySuffix
  */
 Block
   : '{' BlockItemList '}' {
-    $$ = new BlockAST(std::move(*$2));
-    delete $2;
+    $$ = arena.make<BlockAST>(std::move(*$2));
   };
 
 /* block item list can be empty */
 BlockItemList
   : {
-    $$ = new std::vector<std::unique_ptr<BaseAST>>();
+    $$ = arena.list<BaseAST>();
   }
   | BlockItemList BlockItem {
     $$ = $1;
-    $$->push_back(std::unique_ptr<BaseAST>($2));
+    $$->push_back($2);
   };
 
 /**
@@ -225,20 +208,18 @@ Decl
  * @brief Constant declaration.
  */ConstDecl
   : CONST Btype ConstDefList ';' {
-    $$ = new DeclAST(true, std::move(*$2), std::move(*$3));
-    delete $2;
-    delete $3;
+    $$ = arena.make<DeclAST>(true, $2, std::move(*$3));
   };
 
 ConstDefList
   : ConstDef {
-    $$ = new std::vector<std::unique_ptr<DefAST>>();
+    $$ = arena.list<DefAST>();
     // this is a pointer , so we don't need move optimize.
-    $$->push_back(std::unique_ptr<DefAST>(static_cast<DefAST *>($1)));
+    $$->push_back(static_cast<DefAST *>($1));
   }
   | ConstDefList ',' ConstDef {
     $$ = $1;
-    $$->push_back(std::unique_ptr<DefAST>(static_cast<DefAST *>($3)));
+    $$->push_back(static_cast<DefAST *>($3));
   };
 
 /**
@@ -247,13 +228,10 @@ ConstDefList
 ConstDef 
   : IDENT '=' Expr {
     // @param is_const, ident, exprAST
-    $$ = new ScalarDefAST(true, std::move(*$1), $3);
-    delete $1;
+    $$ = arena.make<ScalarDefAST>(true, $1, $3);
   }
   | IDENT ArraySuffix '=' InitVal {
-    $$ = new ArrayDefAST(true, std::move(*$1), std::move(*$2), $4);
-    delete $1;
-    delete $2;
+    $$ = arena.make<ArrayDefAST>(true, $1, std::move(*$2), $4);
   };
 
 /**
@@ -261,22 +239,22 @@ ConstDef
  */
 ArraySuffix
   : '[' Expr ']' {
-    $$ = new std::vector<std::unique_ptr<ExprAST>>();
-    $$->push_back(std::unique_ptr<ExprAST>(static_cast<ExprAST *>($2)));
+    $$ = arena.list<ExprAST>();
+    $$->push_back(static_cast<ExprAST *>($2));
   }
   | ArraySuffix '[' Expr ']' {
     $$ = $1;
-    $$->push_back(std::unique_ptr<ExprAST>(static_cast<ExprAST *>($3)));
+    $$->push_back(static_cast<ExprAST *>($3));
   };
 
 InitializeList
   : InitVal {
-    $$ = new std::vector<std::unique_ptr<InitValStmtAST>>();
-    $$->push_back(std::unique_ptr<InitValStmtAST>($1));
+    $$ = arena.list<InitValStmtAST>();
+    $$->push_back($1);
   }
   | InitializeList ',' InitVal {
     $$ = $1;
-    $$->push_back(std::unique_ptr<InitValStmtAST>($3));
+    $$->push_back($3);
   };
 
 // {1, 2, {2, 0}}
@@ -285,15 +263,14 @@ InitializeList
  */
 InitVal
   : Expr {
-    $$ = new InitValStmtAST($1, {});
+    $$ = arena.make<InitValStmtAST>($1, List<InitValStmtAST>());
     // delete $1;
   }
   | '{' '}' {
-    $$ = new InitValStmtAST(nullptr, {});
+    $$ = arena.make<InitValStmtAST>(nullptr, List<InitValStmtAST>());
   }
   | '{' InitializeList '}' {
-    $$ = new InitValStmtAST(nullptr, std::move(*$2));
-    delete $2;
+    $$ = arena.make<InitValStmtAST>(nullptr, std::move(*$2));
   };
 
 /**
@@ -301,19 +278,17 @@ InitVal
  */
 VarDecl
   : Btype VarDefList ';' {
-    $$ = new DeclAST(false, std::move(*$1), std::move(*$2));
-    delete $1;
-    delete $2;
+    $$ = arena.make<DeclAST>(false, $1, std::move(*$2));
   };
 
 VarDefList
   : VarDef {
-    $$ = new std::vector<std::unique_ptr<DefAST>>();
-    $$->push_back(std::unique_ptr<DefAST>(static_cast<DefAST *>($1)));
+    $$ = arena.list<DefAST>();
+    $$->push_back(static_cast<DefAST *>($1));
   };
   | VarDefList ',' VarDef {
     $$ = $1;
-    $$->push_back(std::unique_ptr<DefAST>(static_cast<DefAST *>($3)));
+    $$->push_back(static_cast<DefAST *>($3));
   };
 
 /**
@@ -321,22 +296,16 @@ VarDefList
  */
 VarDef 
   : IDENT '=' Expr {
-    $$ = new ScalarDefAST(false, std::move(*$1), $3);
-    delete $1;
+    $$ = arena.make<ScalarDefAST>(false, $1, $3);
   };
   | IDENT {
-    $$ = new ScalarDefAST(false, std::move(*$1), nullptr);
-    delete $1;
+    $$ = arena.make<ScalarDefAST>(false, $1, nullptr);
   }  
   | IDENT ArraySuffix {
-    $$ = new ArrayDefAST(false, std::move(*$1), std::move(*$2), nullptr);
-    delete $1;
-    delete $2;
+    $$ = arena.make<ArrayDefAST>(false, $1, std::move(*$2), nullptr);
   }
   | IDENT ArraySuffix '=' InitVal {
-    $$ = new ArrayDefAST(false, std::move(*$1), std::move(*$2), $4);
-    delete $1;
-    delete $2;
+    $$ = arena.make<ArrayDefAST>(false, $1, std::move(*$2), $4);
     // delete $4;
   };
 
@@ -346,45 +315,45 @@ VarDef        ::= IDENT ["[" ConstExp "]"]
 */
 
 Btype
-  : INT { $$ = new std::string("int"); }
-  | VOID { $$ = new std::string("void"); };
+  : INT { $$ = "int"; }
+  | VOID { $$ = "void"; };
 
 /**
  * @brief Statements (assignment, block, expression, if, while, break, continue, return).
  */
 Stmt
   : LVal '=' Expr ';' {
-    $$ = new AssignStmtAST($1, $3);
+    $$ = arena.make<AssignStmtAST>($1, $3);
   }
   | Block {
     $$ = $1;
   }
   | Expr ';' {
-    $$ = new ExprStmtAST($1);
+    $$ = arena.make<ExprStmtAST>($1);
   }
   | ';' {
-    $$ = new ExprStmtAST(nullptr);
+    $$ = arena.make<ExprStmtAST>(nullptr);
   }
   | RETURN Expr ';' {
-    $$ = new ReturnStmtAST($2);
+    $$ = arena.make<ReturnStmtAST>($2);
   }
   | RETURN ';' {
-    $$ = new ReturnStmtAST(nullptr);
+    $$ = arena.make<ReturnStmtAST>(nullptr);
   }
   | BREAK ';' {
-    $$ = new BreakStmtAST();
+    $$ = arena.make<BreakStmtAST>();
   }
   | CONTINUE ';' {
-    $$ = new ContinueStmtAST();
+    $$ = arena.make<ContinueStmtAST>();
   }
   | WHILE '(' Expr ')' Stmt {
-    $$ = new WhileStmtAST($3, $5);
+    $$ = arena.make<WhileStmtAST>($3, $5);
   }
   | IF '(' Expr ')' Stmt %prec LOWER_ELSE {
-    $$ = new IfStmtAST($3, $5, nullptr);
+    $$ = arena.make<IfStmtAST>($3, $5, nullptr);
   }
   | IF '(' Expr ')' Stmt ELSE Stmt {
-    $$ = new IfStmtAST($3, $5, $7);
+    $$ = arena.make<IfStmtAST>($3, $5, $7);
   };
 
 /**
@@ -397,63 +366,59 @@ Expr
   /* unary expression */
   /*  function call */
   | IDENT '(' ')' {
-    auto args = std::vector<std::unique_ptr<ExprAST>>();
-    $$ = new FuncCallAST(std::move(*$1), std::move(args));
-    delete $1;
+    $$ = arena.make<FuncCallAST>($1, List<ExprAST>());
   }
   | IDENT '(' FuncRParams ')' {
-    $$ = new FuncCallAST(std::move(*$1), std::move(*$3));
-    delete $1;
-    delete $3;
+    $$ = arena.make<FuncCallAST>($1, std::move(*$3));
   }
   | '!' Expr {
-    $$ = new UnaryExprAST(UnaryOp::Not, $2);
+    $$ = arena.make<UnaryExprAST>(UnaryOp::Not, $2);
   }
   | '+' Expr %prec PRIORITY {
     $$ = $2;
   }
   | '-' Expr %prec PRIORITY {
-    $$ = new UnaryExprAST(UnaryOp::Neg, $2);
+    $$ = arena.make<UnaryExprAST>(UnaryOp::Neg, $2);
   }
   /* binary expression */
   | Expr '+' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Add, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Add, $1, $3);
   }
   | Expr '-' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Sub, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Sub, $1, $3);
   }
   | Expr '*' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Mul, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Mul, $1, $3);
   }
   | Expr '/' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Div, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Div, $1, $3);
   }
   | Expr '<' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Lt, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Lt, $1, $3);
   }
   | Expr '>' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Gt, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Gt, $1, $3);
   }
   | Expr '%' Expr {
-    $$ = new BinaryExprAST(BinaryOp::Mod, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Mod, $1, $3);
   }
   | Expr LE Expr {
-    $$ = new BinaryExprAST(BinaryOp::Le, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Le, $1, $3);
   }
   | Expr GE Expr {
-    $$ = new BinaryExprAST(BinaryOp::Ge, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Ge, $1, $3);
   }
   | Expr EQ Expr {
-    $$ = new BinaryExprAST(BinaryOp::Eq, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Eq, $1, $3);
   }
   | Expr NE Expr {
-    $$ = new BinaryExprAST(BinaryOp::Ne, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Ne, $1, $3);
   }
   | Expr AND Expr {
-    $$ = new BinaryExprAST(BinaryOp::And, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::And, $1, $3);
   }
   | Expr OR Expr {
-    $$ = new BinaryExprAST(BinaryOp::Or, $1, $3);
+    $$ = arena.make<BinaryExprAST>(BinaryOp::Or, $1, $3);
   };
 
 /**
@@ -461,7 +426,7 @@ Expr
  */
 Number
   : INT_CONST {
-    $$ = new NumberAST($1);
+    $$ = arena.make<NumberAST>($1);
   };
 
 /**
@@ -469,13 +434,10 @@ Number
  */
 LVal 
   : IDENT {
-    $$ = new LValAST(std::move(*$1), {});
-    delete $1;
+    $$ = arena.make<LValAST>($1, List<ExprAST>());
   }
   | IDENT ArraySuffix {
-    $$ = new LValAST(std::move(*$1), std::move(*$2));
-    delete $1;
-    delete $2;
+    $$ = arena.make<LValAST>($1, std::move(*$2));
   };
 
 /**
@@ -483,17 +445,17 @@ LVal
  */
 FuncRParams 
   : Expr {
-    $$ = new std::vector<std::unique_ptr<ExprAST>>();
-    $$->push_back(std::unique_ptr<ExprAST>(static_cast<ExprAST *>($1)));
+    $$ = arena.list<ExprAST>();
+    $$->push_back(static_cast<ExprAST *>($1));
   }
   | FuncRParams ',' Expr {
     $$ = $1;
-    $$->push_back(std::unique_ptr<ExprAST>(static_cast<ExprAST *>($3)));
+    $$->push_back(static_cast<ExprAST *>($3));
   };
 
 %%
 
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *str) {
+void yyerror(BaseAST *&ast, Arena &, const char *str) {
   Log::panic(str);
   if(ast) ast->dump(0);
 }
\ No newline at end of file
@@ -19,11 +19,6 @@ import log;
 using namespace ast;
 using namespace detail;
 
-// Destructors to solve the problem of forward declaration with smart pointers
-AssignStmtAST::~AssignStmtAST() = default;
-FuncDefAST::~FuncDefAST() = default;
-ArrayDefAST::~ArrayDefAST() = default;
-
 /**
  * @brief Constructs a FuncDefAST node.
  * @param _btype Return type of the function.
@@ -31,11 +26,10 @@ ArrayDefAST::~ArrayDefAST() = default;
  * @param _params List of function parameters.
  * @param _block Pointer to the block AST representing function body.
  */
-FuncDefAST::FuncDefAST(std::string _btype, std::string _ident,
-                       std::vector<std::unique_ptr<FuncParamAST>> _params,
-                       BaseAST *_block)
-    : btype(std::move(_btype)), ident(std::move(_ident)),
-      params(std::move(_params)), block(static_cast<BlockAST *>(_block)) {}
+FuncDefAST::FuncDefAST(std::string_view _btype, Ident _ident,
+                       List<FuncParamAST> _params, BaseAST *_block)
+    : btype(_btype), ident(_ident), params(std::move(_params)),
+      block(static_cast<BlockAST *>(_block)) {}
 
 /**
  * @brief Constructs an AssignStmtAST node.
@@ -44,10 +38,10 @@ FuncDefAST::FuncDefAST(std::string _btype, std::string _ident,
  */
 AssignStmtAST::AssignStmtAST(BaseAST *_lval, BaseAST *_expr) {
   if (_lval) {
-    lval.reset(static_cast<LValAST *>(_lval));
+    lval = static_cast<LValAST *>(_lval);
   }
   if (_expr) {
-    expr.reset(static_cast<ExprAST *>(_expr));
+    expr = static_cast<ExprAST *>(_expr);
   }
 }
 
@@ -58,10 +52,10 @@ AssignStmtAST::AssignStmtAST(BaseAST *_lval, BaseAST *_expr) {
  * @param _array_suffix List of expressions defining array dimensions.
  * @param _init_val Optional initialization value(s).
  */
-ArrayDefAST::ArrayDefAST(bool _is_const, std::string _ident,
-                         std::vector<std::unique_ptr<ExprAST>> _array_suffix,
+ArrayDefAST::ArrayDefAST(bool _is_const, Ident _ident,
+                         List<ExprAST> _array_suffix,
                          InitValStmtAST *_init_val)
-    : is_const(_is_const), ident(std::move(_ident)),
+    : is_const(_is_const), ident(_ident),
       array_suffix(std::move(_array_suffix)), init_val(_init_val) {}
 
 /**
@@ -28,6 +28,7 @@ module;
 #include <fmt/core.h>
 #include <map>
 #include <memory>
+#include <optional>
 #include <ranges>
 #include <string>
 #include <vector>
@@ -37,11 +38,101 @@ module ir.ast;
 import ir_builder;
 import ir.type;
 import log;
+import symbol_table;
 
 using namespace ast;
 using namespace detail;
 using namespace std::views;
 
+namespace {
+
+/**
+ * @brief Formats flattened elements as a Koopa aggregate of `root`, e.g.
+ * `{{1, 2}, {3, 4}}`.
+ */
+auto aggregateInit(std::shared_ptr<type::Type> root,
+                   const std::vector<std::string> &elems) -> std::string {
+  int idx = 0;
+  return [&](this auto &&self, std::shared_ptr<type::Type> type) -> std::string {
+    auto arr_type = std::dynamic_pointer_cast<type::ArrayType>(type);
+    if (!arr_type) {
+      return elems[idx++];
+    }
+    std::string res = "{";
+    for (int i : iota(0, arr_type->len)) {
+      if (i > 0) {
+        res += ", ";
+      }
+      res += self(arr_type->base);
+    }
+    return res + "}";
+  }(root);
+}
+
+/**
+ * @brief Parses the elements of a folded initializer list.
+ */
+auto toInts(const std::vector<std::string> &elems) -> std::vector<int> {
+  std::vector<int> res;
+  res.reserve(elems.size());
+  for (const auto &elem : elems) {
+    res.push_back(std::stoi(elem));
+  }
+  return res;
+}
+
+/**
+ * @brief Looks up an element of a constant array at compile time.
+ *
+ * @return The element, or nullopt unless the indices are constant, in
+ * bounds, and select a single integer.
+ */
+auto constElement(const Symbol &sym, const List<ExprAST> &indices,
+                  ir::KoopaBuilder &builder) -> std::optional<int> {
+  auto cur_type = sym.type;
+  size_t offset = 0;
+  for (const auto &idx : indices) {
+    auto arr_type = std::dynamic_pointer_cast<type::ArrayType>(cur_type);
+    if (!arr_type || !idx->isConstExpr(builder)) {
+      return std::nullopt;
+    }
+    int val = idx->CalcValue(builder);
+    if (val < 0 || val >= arr_type->len) {
+      return std::nullopt;
+    }
+    cur_type = arr_type->base;
+    // row-major: skip `val` sub-arrays of the remaining dimensions
+    size_t stride = 1;
+    for (auto t = cur_type; t->is_array();) {
+      auto sub = std::static_pointer_cast<type::ArrayType>(t);
+      stride *= sub->len;
+      t = sub->base;
+    }
+    offset += val * stride;
+  }
+  if (!cur_type->is_int() || offset >= sym.constElems.size()) {
+    return std::nullopt;
+  }
+  return sym.constElems[offset];
+}
+
+/**
+ * @brief Gives a local constant array a global copy the first time it is
+ * indexed by a runtime value, instead of rebuilding it on every call.
+ */
+auto materialize(Symbol &sym, ir::KoopaBuilder &builder) -> void {
+  std::vector<std::string> elems;
+  for (int val : sym.constElems) {
+    elems.push_back(std::to_string(val));
+  }
+  sym.irName = builder.newVar(sym.name.str());
+  builder.appendGlobal(fmt::format("global {} = alloc {}, {}\n", sym.irName,
+                                   sym.type->toKoopa(),
+                                   aggregateInit(sym.type, elems)));
+}
+
+} // namespace
+
 /**
  * @brief Generates IR for a compilation unit (the top-level node).
  *
@@ -137,7 +228,7 @@ auto FuncDefAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   //   return (s == "int" ? "i32" : "");
   // };
   builder.append(fmt::format("{} @", (block ? "fun" : "decl")));
-  builder.append(ident);
+  builder.append(ident.str());
   builder.append("(");
   for (const auto &param : params) {
     // builder.append(
@@ -203,6 +294,8 @@ auto FuncDefAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
  * 3. Allocation:
  *    - Global: Allocates in `.data` section, handles initialization.
  *    - Local: Allocates on stack, handles initialization via `getelemptr` and `store`.
+ *    - Local constant: Allocates nothing; the elements live in the symbol
+ *      table until a runtime index needs a global copy.
  * 4. Initialization: Flattens the initializer list and fills the array.
  *
  * @param builder The IR builder context.
@@ -228,41 +321,33 @@ auto ArrayDefAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
     //! [Caution] : Since global variables do not have naming conflicts, we
     //! will consistently use ident without the prefix.
     //! So this avoids naming conflicts between global and local arrays.
-    std::string ir_name = builder.newVar(ident);
+    std::string ir_name = builder.newVar(ident.str());
+    std::vector<std::string> flatten_initialize_list;
     if (init_val == nullptr) {
       builder.append(fmt::format("global {} = alloc {}, zeroinit\n", ir_name,
                                  ir_array_suffix));
     } else {
-      builder.append(
-          fmt::format("global {} = alloc {}, ", ir_name, ir_array_suffix));
-      auto flatten_initialize_list = init_val->flatten(arr_type, builder);
-
-      int idx = 0;
-      auto result = [&](this auto &&self,
-                        std::shared_ptr<type::Type> type) -> std::string {
-        auto arr_type = std::dynamic_pointer_cast<type::ArrayType>(type);
-        if (arr_type) {
-          std::string res = "{";
-
-          for (int i : iota(0, arr_type->len)) {
-            if (i > 0) {
-              res += ", ";
-            }
-            res += self(arr_type->base);
-          }
-
-          return res + "}";
-        }
-        return flatten_initialize_list[idx++];
-      }(arr_type);
-
-      builder.append(result + "\n");
+      flatten_initialize_list = init_val->flatten(arr_type, builder);
+      builder.append(fmt::format("global {} = alloc {}, {}\n", ir_name,
+                                 ir_array_suffix,
+                                 aggregateInit(arr_type, flatten_initialize_list)));
     }
 
     builder.symtab().defineGlobal(ident, ir_name, arr_type, SymbolKind::Var,
-                                  is_const);
+                                  is_const, 0,
+                                  is_const ? toInts(flatten_initialize_list)
+                                           : std::vector<int>{});
+  } else if (is_const) {
+    // Reads with constant indices fold to the element; the first runtime
+    // index emits a global copy (see `LValAST::codeGen`).
+    std::vector<std::string> flatten_initialize_list;
+    if (init_val != nullptr) {
+      flatten_initialize_list = init_val->flatten(arr_type, builder, true);
+    }
+    builder.symtab().define(ident, "", arr_type, SymbolKind::Var, true, 0,
+                            toInts(flatten_initialize_list));
   } else {
-    auto addr = builder.newVar(ident);
+    auto addr = builder.newVar(ident.str());
     // builder.append(fmt::format("[debug]: {}\n", ir_array_suffix));
     builder.append(fmt::format("  {} = alloc {}\n", addr, ir_array_suffix));
 
@@ -287,7 +372,7 @@ auto ArrayDefAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
         builder.append(fmt::format("  store {}, {}\n", value, ptr));
       }(arr_type, addr);
     }
-    builder.symtab().define(ident, addr, arr_type, SymbolKind::Var, is_const);
+    builder.symtab().define(ident, addr, arr_type, SymbolKind::Var, false);
   }
 
   return "";
@@ -320,7 +405,7 @@ auto ScalarDefAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
       builder.symtab().defineGlobal(ident, "", type::IntType::get(),
                                     SymbolKind::Var, true, val);
     } else {
-      std::string addr = builder.newVar(ident);
+      std::string addr = builder.newVar(ident.str());
       if (not has_init) {
         builder.append(fmt::format("global {} = alloc i32, zeroinit\n", addr));
       } else {
@@ -340,7 +425,7 @@ auto ScalarDefAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
                               true, val);
     } else {
       // btype var = value
-      std::string addr = builder.newVar(ident);
+      std::string addr = builder.newVar(ident.str());
       builder.append(fmt::format("  {} = alloc i32\n", addr));
       builder.symtab().define(ident, addr, type::IntType::get(),
                               SymbolKind::Var, false);
@@ -429,11 +514,12 @@ auto InitValStmtAST::codeGen([[maybe_unused]] ir::KoopaBuilder &builder) const
  *
  * @param targetType The expected Type (Int or Array) for the current level.
  * @param builder The IR builder used to generate code for expressions.
+ * @param fold Evaluate the elements at compile time, as for globals.
  * @return std::vector<std::string> A flat list of IR constants or register
  * names.
  */
 auto InitValStmtAST::flatten(std::shared_ptr<type::Type> targetType,
-                             ir::KoopaBuilder &builder) const
+                             ir::KoopaBuilder &builder, bool fold) const
     -> std::vector<std::string> {
 
   // Helper to cast Type to ArrayType
@@ -452,8 +538,8 @@ auto InitValStmtAST::flatten(std::shared_ptr<type::Type> targetType,
    * @param idx Reference to the cursor in the current list.
    */
   auto result = [&](this auto &&flatten_impl, std::shared_ptr<type::Type> type,
-                    const std::vector<std::unique_ptr<InitValStmtAST>> &list,
-                    int &idx) -> std::vector<std::string> {
+                    const List<InitValStmtAST> &list, int &idx)
+      -> std::vector<std::string> {
     // Base Case: Target is a simple Integer
     if (type->is_int()) {
       // If no more data is provided, SysY requires implicit
@@ -472,7 +558,7 @@ auto InitValStmtAST::flatten(std::shared_ptr<type::Type> targetType,
 
       // Move the cursor after consuming one scalar value.
       idx++;
-      if (builder.symtab().isGlobalScope()) {
+      if (fold || builder.symtab().isGlobalScope()) {
         int val = node->expr->CalcValue(builder);
         return {std::to_string(val)};
       } else {
@@ -491,7 +577,7 @@ auto InitValStmtAST::flatten(std::shared_ptr<type::Type> targetType,
       // Scenario 1: The input list is exhausted before the array is full.
       if (ssize(list) <= idx) {
         int dummy = 0;
-        static const std::vector<std::unique_ptr<InitValStmtAST>> empty;
+        static const List<InitValStmtAST> empty;
         // Recursively fill the remaining slots with "0".
         tmp_res = flatten_impl(arr_type->base, empty, dummy);
         result.insert(result.end(), tmp_res.begin(), tmp_res.end());
@@ -644,15 +730,15 @@ auto ReturnStmtAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
 /**
  * @brief Generates IR for an if statement, including optional else.
  *
- * Uses basic blocks and 'br' (branching) instructions to implement the logic.
- * Handles label allocation and basic block termination with 'jump'
+ * Uses basic blocks and 'br' (branching) instructions to implement the logic;
+ * the condition branches straight to the then/else labels. Handles label
+ * allocation and basic block termination with 'jump'
  * instructions.
  *
  * @param builder The IR builder context.
  * @return An empty string.
  */
 auto IfStmtAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
-  std::string cond_reg = cond->codeGen(builder);
   int id = builder.allocLabelId();
   // clang-format off
   std::string then_label = builder.newLabel("then", id);
@@ -660,13 +746,7 @@ auto IfStmtAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   std::string end_label  = builder.newLabel("end",  id);
   // clang-format on
 
-  if (elseS) {
-    builder.append(
-        fmt::format("  br {}, {}, {}\n", cond_reg, then_label, else_label));
-  } else {
-    builder.append(
-        fmt::format("  br {}, {}, {}\n", cond_reg, then_label, end_label));
-  }
+  cond->condGen(builder, then_label, elseS ? else_label : end_label);
 
   // not jump
   builder.append(fmt::format("{}:\n", then_label));
@@ -711,9 +791,7 @@ auto WhileStmtAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   builder.append(fmt::format("  jump {}\n", entry_label));
 
   builder.append(fmt::format("{}:\n", entry_label));
-  std::string cond_reg = cond->codeGen(builder);
-  builder.append(
-      fmt::format("  br {}, {}, {}\n", cond_reg, body_label, end_label));
+  cond->condGen(builder, body_label, end_label);
 
   builder.append(fmt::format("{}:\n", body_label));
   if (body) {
@@ -777,7 +855,8 @@ auto NumberAST::codeGen([[maybe_unused]] ir::KoopaBuilder &builder) const
  * @brief Generates IR for an L-value (variable access).
  *
  * Loads the variable's value from its memory address into a new register.
- * If the variable is a constant, its value is returned directly.
+ * If the variable is a constant, or an element of a constant array at
+ * constant indices, its value is returned directly.
  *
  * @param builder The IR builder context.
  * @return The register name or constant value.
@@ -793,6 +872,14 @@ auto LValAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   if (sym->is_const && indices.empty() && sym->type->is_int()) {
     return std::to_string(sym->constValue);
   }
+  if (sym->is_const && sym->type->is_array()) {
+    if (auto elem = constElement(*sym, indices, builder)) {
+      return std::to_string(*elem);
+    }
+    if (sym->irName.empty()) {
+      materialize(*sym, builder);
+    }
+  }
 
   std::string cur_ptr = sym->irName;
   auto cur_type = sym->type;
@@ -879,6 +966,22 @@ auto FuncCallAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   return ret_reg;
 }
 
+/**
+ * @brief Generates IR that branches on the value of an expression.
+ *
+ * The generic case materializes the value and branches on it once.
+ *
+ * @param builder The IR builder context.
+ * @param true_label Target if the value is non-zero.
+ * @param false_label Target if the value is zero.
+ */
+auto ExprAST::condGen(ir::KoopaBuilder &builder, const std::string &true_label,
+                      const std::string &false_label) const -> void {
+  std::string cond_reg = codeGen(builder);
+  builder.append(
+      fmt::format("  br {}, {}, {}\n", cond_reg, true_label, false_label));
+}
+
 /**
  * @brief Generates IR for unary expressions.
  *
@@ -904,11 +1007,31 @@ auto UnaryExprAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   return ret_reg;
 }
 
+/**
+ * @brief Generates IR that branches on a unary expression.
+ *
+ * Logical NOT swaps the targets instead of computing `eq 0, rhs`.
+ *
+ * @param builder The IR builder context.
+ * @param true_label Target if the value is non-zero.
+ * @param false_label Target if the value is zero.
+ */
+auto UnaryExprAST::condGen(ir::KoopaBuilder &builder,
+                           const std::string &true_label,
+                           const std::string &false_label) const -> void {
+  if (op == UnaryOp::Not) {
+    rhs->condGen(builder, false_label, true_label);
+    return;
+  }
+  ExprAST::condGen(builder, true_label, false_label);
+}
+
 /**
  * @brief Generates IR for binary expressions.
  *
  * Includes special handling for short-circuiting logical operations (AND, OR)
- * using branching and temporary memory storage.
+ * using branching and temporary memory storage; this path is only taken when
+ * the value itself is needed (conditions go through `condGen`).
  *
  * @param builder The IR builder context.
  * @return The register name holding the result.
@@ -998,6 +1121,39 @@ auto BinaryExprAST::codeGen(ir::KoopaBuilder &builder) const -> std::string {
   return ret_reg;
 }
 
+/**
+ * @brief Generates IR that branches on a binary expression.
+ *
+ * `&&` and `||` short-circuit by branching directly to the targets: the
+ * right operand gets its own block and no boolean is materialized. Other
+ * operators branch on their value.
+ *
+ * @param builder The IR builder context.
+ * @param true_label Target if the value is non-zero.
+ * @param false_label Target if the value is zero.
+ */
+auto BinaryExprAST::condGen(ir::KoopaBuilder &builder,
+                            const std::string &true_label,
+                            const std::string &false_label) const -> void {
+  if (op != BinaryOp::And && op != BinaryOp::Or) {
+    ExprAST::condGen(builder, true_label, false_label);
+    return;
+  }
+
+  int id = builder.allocLabelId();
+  std::string rhs_label;
+  if (op == BinaryOp::And) {
+    rhs_label = builder.newLabel("and_rhs", id);
+    lhs->condGen(builder, rhs_label, false_label);
+  } else {
+    rhs_label = builder.newLabel("or_rhs", id);
+    lhs->condGen(builder, true_label, rhs_label);
+  }
+
+  builder.append(fmt::format("{}:\n", rhs_label));
+  rhs->condGen(builder, true_label, false_label);
+}
+
 /**
  * @brief Evaluates a literal number at compile time.
  * @param builder The IR builder context.
@@ -1011,7 +1167,8 @@ auto NumberAST::CalcValue([[maybe_unused]] ir::KoopaBuilder &builder) const
 /**
  * @brief Evaluates an L-value at compile time.
  *
- * Only permitted for constant variables.
+ * Only permitted for constant variables and elements of constant arrays at
+ * constant indices.
  *
  * @param builder The IR builder context.
  * @return The constant value of the variable.
@@ -1028,6 +1185,15 @@ auto LValAST::CalcValue(ir::KoopaBuilder &builder) const -> int {
                            "constant expression",
                            ident));
   }
+  if (sym->type->is_array()) {
+    auto elem = constElement(*sym, indices, builder);
+    if (!elem) {
+      Log::panic(fmt::format("Element of '{}' is not a constant, cannot be "
+                             "used in constant expression",
+                             ident));
+    }
+    return *elem;
+  }
   return sym->constValue;
 }
 
@@ -1098,4 +1264,54 @@ auto BinaryExprAST::CalcValue(ir::KoopaBuilder &builder) const -> int {
   case BinaryOp::Or: return lhs_val || rhs_val;
   default: return 0;
   }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief A literal number is always constant.
+ */
+auto NumberAST::isConstExpr([[maybe_unused]] ir::KoopaBuilder &builder) const
+    -> bool {
+  return true;
+}
+
+/**
+ * @brief Checks whether an L-value names a constant or a constant array
+ * element at constant indices.
+ */
+auto LValAST::isConstExpr(ir::KoopaBuilder &builder) const -> bool {
+  auto sym = builder.symtab().lookup(ident);
+  if (!sym || !sym->is_const) {
+    return false;
+  }
+  if (sym->type->is_array()) {
+    return constElement(*sym, indices, builder).has_value();
+  }
+  return sym->type->is_int() && indices.empty();
+}
+
+/**
+ * @brief Function calls are never constant expressions.
+ */
+auto FuncCallAST::isConstExpr([[maybe_unused]] ir::KoopaBuilder &builder) const
+    -> bool {
+  return false;
+}
+
+/**
+ * @brief A unary expression is constant if its operand is.
+ */
+auto UnaryExprAST::isConstExpr(ir::KoopaBuilder &builder) const -> bool {
+  return rhs->isConstExpr(builder);
+}
+
+/**
+ * @brief A binary expression is constant if both operands are, and it does
+ * not divide by zero.
+ */
+auto BinaryExprAST::isConstExpr(ir::KoopaBuilder &builder) const -> bool {
+  if (!lhs->isConstExpr(builder) || !rhs->isConstExpr(builder)) {
+    return false;
+  }
+  bool divides = op == BinaryOp::Div || op == BinaryOp::Mod;
+  return !divides || rhs->CalcValue(builder) != 0;
+}
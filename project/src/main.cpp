@@ -5,7 +5,8 @@
  * The compiler pipeline consists of:
  * 1. Lexing & Parsing (Flex/Bison) -> AST
  * 2. IR Generation (AST::codeGen) -> Koopa IR
- * 3. Backend (TargetCodeGen::visit) -> RISC-V Assembly
+ * 3. Optimization (`-perf` / `-O<n>` only, opt::optimize) -> Koopa IR
+ * 4. Backend (TargetCodeGen::visit) -> RISC-V Assembly
  */
 
 import log;
@@ -13,6 +14,8 @@ import ir_builder;
 import ir.ast;
 import koopawrapper;
 import backend;
+import opt.ir;
+import opt.passes;
 
 #include <cassert>
 #include <cstdio>
@@ -25,12 +28,13 @@ import backend;
 
 // for lexer & bison
 extern FILE *yyin;
-extern int yyparse(std::unique_ptr<ast::BaseAST> &ast);
+extern int yyparse(ast::BaseAST *&ast, ast::Arena &arena);
 
 struct Config {
   std::string mode;
   std::string input_file;
   std::string output_file;
+  opt::Options options;
 };
 
 auto helpMessage() -> void {
@@ -44,7 +48,22 @@ auto helpMessage() -> void {
   fmt::print("  {:<16} {}\n", "-koopa", "Compile SysY to Koopa IR");
   fmt::print("  {:<16} {}\n", "-riscv", "Compile SysY to RISC-V assembly");
   fmt::print("  {:<16} {}\n", "-perf", "Compile with performance optimizations");
+  fmt::print("  {:<16} {}\n", "-O0, -O1, -O2", "Like -perf with no, light or all optimizations (-perf is -O2)");
   fmt::print("  {:<16} {}\n", "-o <file>", "Place the output into <file>");
+  fmt::print("\n");
+  fmt::print(fmt::emphasis::bold | fmt::fg(fmt::color::cyan), "Optimizer options (-perf): \n");
+  fmt::print("  {:<28} {}\n", "-inline-threshold=<n>", "Max inlining cost outside loops (default 60)");
+  fmt::print("  {:<28} {}\n", "-inline-recursion-depth=<n>", "Max unfolding of recursive calls (default 1)");
+  fmt::print("  {:<28} {}\n", "-inline-caller-limit=<n>", "Max instructions of a caller (default 6000)");
+  fmt::print("  {:<28} {}\n", "-unroll-factor=<n>", "Copies of a partially unrolled loop (default 4)");
+  fmt::print("  {:<28} {}\n", "-unroll-full-limit=<n>", "Max instructions of an unrolled loop (default 256)");
+  fmt::print("  {:<28} {}\n", "-specialize-budget=<n>", "Max instructions added by specialized clones (default 400)");
+  fmt::print("  {:<28} {}\n", "-tile-size=<n>", "Iterations per tile of a blocked loop nest, 0 disables (default 16)");
+  fmt::print("  {:<28} {}\n", "-cache-size=<n>", "Data cache bytes assumed by loop tiling (default 32768)");
+  fmt::print("  {:<28} {}\n", "-march=rv32imv", "Vectorize simple array loops with RVV 1.0 (default rv32im)");
+  fmt::print("  {:<28} {}\n", "-passes=<a,b,...>", "Run these passes instead of the -O pipeline");
+  fmt::print("  {:<28} {}\n", "-time-passes", "Report time, instruction and heap growth per pass");
+  fmt::print("  {:<28} {}\n", "-Rpass=<pass>", "Report decisions of <pass>, e.g. inline; aa counts alias queries, analysis counts cached analyses");
   // clang-format on
 
   fmt::print(fmt::emphasis::bold,
@@ -52,14 +71,18 @@ auto helpMessage() -> void {
 };
 
 auto parseArgs(int argc, const char *argv[]) -> Config {
-  if (argc != 2 && argc != 5) {
+  std::vector<std::string_view> Args(argv + 1, argv + argc);
+  Config config;
+
+  // optimizer flags may be mixed in anywhere and do not count below
+  std::erase_if(Args, [&](std::string_view arg) {
+    return opt::parseOption(config.options, arg);
+  });
+  if (Args.size() != 1 && Args.size() != 4) {
     helpMessage();
     Log::panic("The number of input parameters must be five or two.");
   }
 
-  std::vector<std::string_view> Args(argv + 1, argv + argc);
-  Config config;
-
   for (int i = 0; i < ssize(Args); ++i) {
 
     if (Args[i] == "-h" || Args[i] == "--help") {
@@ -69,6 +92,10 @@ auto parseArgs(int argc, const char *argv[]) -> Config {
 
     if (Args[i] == "-koopa" || Args[i] == "-riscv" || Args[i] == "-perf") {
       config.mode = Args[i];
+    } else if (Args[i] == "-O0" || Args[i] == "-O1" || Args[i] == "-O2") {
+      // -perf with a preset pipeline
+      config.mode = "-perf";
+      config.options.level = Args[i][2] - '0';
     } else if (Args[i] == "-o" && i + 1 < ssize(Args)) {
       config.output_file = Args[++i];
     } else {
@@ -89,8 +116,10 @@ auto main(int argc, const char *argv[]) -> int {
     Log::panic("Invalid input!");
   }
 
-  std::unique_ptr<ast::BaseAST> ast;
-  auto ret = yyparse(ast);
+  // the whole tree lives in the arena and is released with it
+  ast::Arena arena;
+  ast::BaseAST *ast = nullptr;
+  auto ret = yyparse(ast, arena);
   if (ret) {
     Log::panic("Parsing failed!");
   }
@@ -103,15 +132,24 @@ auto main(int argc, const char *argv[]) -> int {
   ir::KoopaBuilder irBuilder;
   ast->codeGen(irBuilder);
 
-  const std::string ir = irBuilder.build();
+  std::string ir = irBuilder.build();
   if (config.mode == "-koopa") {
     auto out = fmt::output_file(config.output_file);
     out.print("{}", ir);
     fmt::print(fmt::fg(fmt::color::cyan), "[Success] Parse koopa succeed!\n");
   }
 
-  // 3. Generate RISC-V assembly from Koopa IR
-  if (config.mode == "-riscv") {
+  // 3. Optimize the Koopa IR: lift it, rewrite it, and print it back
+  if (config.mode == "-perf") {
+    backend::KoopaWrapper wrapper(ir);
+    auto module = opt::Module::fromRaw(wrapper.getRaw());
+    opt::optimize(*module, config.options);
+    ir = module->toKoopa();
+    fmt::print(fmt::fg(fmt::color::cyan), "[Success] Optimize koopa succeed!\n");
+  }
+
+  // 4. Generate RISC-V assembly from Koopa IR
+  if (config.mode == "-riscv" || config.mode == "-perf") {
     backend::KoopaWrapper wrapper(ir);
     backend::TargetCodeGen generator;
     generator.visit(wrapper.getRaw());
@@ -0,0 +1,135 @@
+/**
+ * @file adce.cpp
+ * @brief Aggressive (mark-and-sweep) dead code elimination.
+ *
+ * Unlike a use-count based DCE, which can only peel dead values from the
+ * leaves, ADCE assumes every value is dead until proven otherwise:
+ *
+ * 1. **Unreachable blocks**: blocks the entry cannot reach (e.g. `%end_N`
+ *    after an `if` whose arms both `return`) are deleted outright.
+ * 2. **Mark**: instructions with side effects (`store`, `call`, terminators)
+ *    are the roots. Their operands are live, and so on transitively. Edge
+ *    arguments only become live once the block parameter they bind does.
+ * 3. **Sweep**: every unmarked instruction and block parameter is erased,
+ *    which also drops dead cycles that a use-count DCE would keep alive.
+ */
+
+module;
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+
+using namespace opt;
+
+auto opt::removeUnreachableBlocks(Function &func) -> bool {
+  auto order = reversePostOrder(func);
+  std::unordered_set<BasicBlock *> reachable(order.begin(), order.end());
+
+  bool changed = false;
+  for (auto it = func.blocks.begin(); it != func.blocks.end();) {
+    if (reachable.contains(it->get())) {
+      ++it;
+    } else {
+      it = func.blocks.erase(it);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+auto opt::eliminateDeadCode(Function &func) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  bool changed = removeUnreachableBlocks(func);
+
+  // incoming edges of every block, to revive edge arguments lazily
+  std::unordered_map<BasicBlock *, std::vector<Edge *>> incoming;
+  for (auto &bb : func.blocks) {
+    if (auto term = bb->terminator()) {
+      for (auto &edge : term->edges) {
+        incoming[edge.target].push_back(&edge);
+      }
+    }
+  }
+
+  // --- Mark ---
+  std::unordered_set<Value *> live;
+  std::vector<Value *> worklist;
+  live.reserve(func.instCount());
+  auto mark = [&](Value *val) {
+    if ((val->isInst() || val->op == Op::BlockArg) && live.insert(val).second) {
+      worklist.push_back(val);
+    }
+  };
+
+  for (auto &bb : func.blocks) {
+    for (auto &inst : bb->insts) {
+      if (inst->hasSideEffects()) {
+        mark(inst.get());
+      }
+    }
+  }
+
+  while (!worklist.empty()) {
+    auto val = worklist.back();
+    worklist.pop_back();
+
+    if (val->op == Op::BlockArg) {
+      for (auto edge : incoming[val->parent]) {
+        mark(edge->args[val->imm]);
+      }
+      continue;
+    }
+    // edge arguments are handled through the block parameters above
+    for (auto use : val->operands) {
+      mark(use);
+    }
+  }
+
+  // --- Sweep ---
+  for (auto &bb : func.blocks) {
+    auto removed = std::erase_if(
+        bb->insts, [&](const auto &inst) { return !live.contains(inst.get()); });
+    changed |= removed > 0;
+  }
+
+  for (auto &bb : func.blocks) {
+    std::vector<bool> keep;
+    for (const auto &param : bb->params) {
+      keep.push_back(live.contains(param.get()));
+    }
+    if (std::ranges::all_of(keep, [](bool k) { return k; })) {
+      continue;
+    }
+
+    for (auto edge : incoming[bb.get()]) {
+      std::vector<Value *> args;
+      for (size_t i = 0; i < edge->args.size(); ++i) {
+        if (keep[i]) {
+          args.push_back(edge->args[i]);
+        }
+      }
+      edge->args = std::move(args);
+    }
+
+    std::vector<std::unique_ptr<Value>> params;
+    for (size_t i = 0; i < bb->params.size(); ++i) {
+      if (keep[i]) {
+        bb->params[i]->imm = static_cast<int>(params.size());
+        params.push_back(std::move(bb->params[i]));
+      }
+    }
+    bb->params = std::move(params);
+    changed = true;
+  }
+
+  return changed;
+}
@@ -0,0 +1,1152 @@
+/**
+ * @file analysis.cpp
+ * @brief Dominator and post-dominator trees, natural loop and induction
+ * variable detection, the analysis cache, alias analysis, the call graph,
+ * side-effect summaries and value ranges.
+ */
+
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.analysis;
+
+import opt.ir;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Immediate dominators of a graph given in reverse post-order from
+ * node 0, with Cooper, Harvey & Kennedy: "A Simple, Fast Dominance
+ * Algorithm". Node 0 is its own idom.
+ */
+auto computeIdoms(const std::vector<std::vector<int>> &preds)
+    -> std::vector<int> {
+  const int n = static_cast<int>(preds.size());
+  std::vector<int> idoms(n, -1);
+  if (n > 0) {
+    idoms[0] = 0;
+  }
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (a > b) {
+        a = idoms[a];
+      }
+      while (b > a) {
+        b = idoms[b];
+      }
+    }
+    return a;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int i = 1; i < n; ++i) {
+      int dom = -1;
+      for (int pred : preds[i]) {
+        if (idoms[pred] != -1) {
+          dom = dom == -1 ? pred : intersect(pred, dom);
+        }
+      }
+      if (dom != idoms[i]) {
+        idoms[i] = dom;
+        changed = true;
+      }
+    }
+  }
+  return idoms;
+}
+
+/**
+ * @brief DFS entry and exit times of the tree rooted at node 0, so that
+ * ancestor queries are O(1).
+ */
+auto numberTree(const std::vector<int> &idoms)
+    -> std::vector<std::pair<int, int>> {
+  const int n = static_cast<int>(idoms.size());
+  std::vector<std::vector<int>> kids(n);
+  for (int i = 1; i < n; ++i) {
+    kids[idoms[i]].push_back(i);
+  }
+
+  std::vector<std::pair<int, int>> interval(n);
+  int clock = 0;
+  std::vector<std::pair<int, size_t>> stack;
+  if (n > 0) {
+    stack.emplace_back(0, 0);
+    interval[0].first = clock++;
+  }
+  while (!stack.empty()) {
+    auto &[node, next] = stack.back();
+    if (next < kids[node].size()) {
+      int child = kids[node][next++];
+      interval[child].first = clock++;
+      stack.emplace_back(child, 0);
+    } else {
+      interval[node].second = clock++;
+      stack.pop_back();
+    }
+  }
+  return interval;
+}
+
+} // namespace
+
+DominatorTree::DominatorTree(const Function &func)
+    : rpo(reversePostOrder(func)) {
+  const int n = static_cast<int>(rpo.size());
+  for (int i = 0; i < n; ++i) {
+    index[rpo[i]] = i;
+  }
+
+  std::vector<std::vector<int>> preds(n);
+  for (int i = 0; i < n; ++i) {
+    for (auto succ : rpo[i]->succs()) {
+      preds[index.at(succ)].push_back(i);
+    }
+  }
+
+  idoms = computeIdoms(preds);
+  kids.resize(n);
+  for (int i = 1; i < n; ++i) {
+    kids[idoms[i]].push_back(rpo[i]);
+  }
+  interval = numberTree(idoms);
+}
+
+auto DominatorTree::idom(const BasicBlock *bb) const -> BasicBlock * {
+  int i = index.at(bb);
+  return i == 0 ? nullptr : rpo[idoms[i]];
+}
+
+auto DominatorTree::children(const BasicBlock *bb) const
+    -> const std::vector<BasicBlock *> & {
+  return kids[index.at(bb)];
+}
+
+auto DominatorTree::dominates(const BasicBlock *a, const BasicBlock *b) const
+    -> bool {
+  auto ia = index.find(a);
+  auto ib = index.find(b);
+  if (ia == index.end() || ib == index.end()) {
+    return false;
+  }
+  const auto &[in_a, out_a] = interval[ia->second];
+  const auto &[in_b, out_b] = interval[ib->second];
+  return in_a <= in_b && out_b <= out_a;
+}
+
+PostDominatorTree::PostDominatorTree(const Function &func) {
+  auto order = reversePostOrder(func);
+  std::unordered_set<const BasicBlock *> reachable(order.begin(), order.end());
+  auto preds = func.preds();
+
+  // post-order of the reversed CFG from the virtual exit, whose successors
+  // there are the `ret` blocks
+  std::vector<BasicBlock *> post;
+  std::unordered_set<const BasicBlock *> seen;
+  std::vector<std::pair<BasicBlock *, size_t>> stack;
+  auto enter = [&](BasicBlock *bb) {
+    if (reachable.contains(bb) && seen.insert(bb).second) {
+      stack.emplace_back(bb, 0);
+    }
+  };
+  for (auto bb : order) {
+    if (bb->terminator()->op != Op::Return) {
+      continue;
+    }
+    enter(bb);
+    while (!stack.empty()) {
+      auto &[cur, next] = stack.back();
+      const auto &ins = preds[cur];
+      if (next < ins.size()) {
+        enter(ins[next++]);
+      } else {
+        post.push_back(cur);
+        stack.pop_back();
+      }
+    }
+  }
+
+  rpo.push_back(nullptr);
+  rpo.insert(rpo.end(), post.rbegin(), post.rend());
+  const int n = static_cast<int>(rpo.size());
+  for (int i = 1; i < n; ++i) {
+    index[rpo[i]] = i;
+  }
+
+  // predecessors in the reversed CFG are successors in the CFG
+  std::vector<std::vector<int>> reversed(n);
+  for (int i = 1; i < n; ++i) {
+    if (rpo[i]->terminator()->op == Op::Return) {
+      reversed[i].push_back(0);
+    }
+    for (auto succ : rpo[i]->succs()) {
+      if (auto it = index.find(succ); it != index.end()) {
+        reversed[i].push_back(it->second);
+      }
+    }
+  }
+
+  idoms = computeIdoms(reversed);
+  kids.resize(n);
+  for (int i = 1; i < n; ++i) {
+    kids[idoms[i]].push_back(rpo[i]);
+  }
+  interval = numberTree(idoms);
+}
+
+auto PostDominatorTree::ipdom(const BasicBlock *bb) const -> BasicBlock * {
+  return rpo[idoms[index.at(bb)]];
+}
+
+auto PostDominatorTree::children(const BasicBlock *bb) const
+    -> const std::vector<BasicBlock *> & {
+  return kids[index.at(bb)];
+}
+
+auto PostDominatorTree::postDominates(const BasicBlock *a,
+                                      const BasicBlock *b) const -> bool {
+  auto ia = index.find(a);
+  auto ib = index.find(b);
+  if (ia == index.end() || ib == index.end()) {
+    return false;
+  }
+  const auto &[in_a, out_a] = interval[ia->second];
+  const auto &[in_b, out_b] = interval[ib->second];
+  return in_a <= in_b && out_b <= out_a;
+}
+
+auto Loop::depth() const -> int {
+  int res = 1;
+  for (auto loop = parent; loop; loop = loop->parent) {
+    ++res;
+  }
+  return res;
+}
+
+auto Loop::latches() const -> std::vector<BasicBlock *> {
+  std::vector<BasicBlock *> res;
+  for (auto bb : blocks) {
+    auto succs = bb->succs();
+    if (std::ranges::find(succs, header) != succs.end()) {
+      res.push_back(bb);
+    }
+  }
+  return res;
+}
+
+auto Loop::exitBlocks() const -> std::vector<BasicBlock *> {
+  std::vector<BasicBlock *> res;
+  for (auto bb : blocks) {
+    for (auto succ : bb->succs()) {
+      if (!contains(succ) && std::ranges::find(res, succ) == res.end()) {
+        res.push_back(succ);
+      }
+    }
+  }
+  return res;
+}
+
+auto Loop::exitingBlocks() const -> std::vector<BasicBlock *> {
+  std::vector<BasicBlock *> res;
+  for (auto bb : blocks) {
+    if (std::ranges::any_of(bb->succs(),
+                            [&](auto succ) { return !contains(succ); })) {
+      res.push_back(bb);
+    }
+  }
+  return res;
+}
+
+auto Loop::hasOutsideUses() const -> bool {
+  for (const auto &bb : header->parent->blocks) {
+    if (contains(bb.get())) {
+      continue;
+    }
+    for (const auto &inst : bb->insts) {
+      bool inside = false;
+      inst->forEachUse([&](Value *use) { inside |= !isInvariant(use); });
+      if (inside) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+LoopInfo::LoopInfo(const Function &func, const DominatorTree &domTree) {
+  if (func.isDecl()) {
+    return;
+  }
+  auto preds = func.preds();
+
+  // one loop per header, collecting the bodies of all its back edges
+  std::unordered_map<BasicBlock *, Loop *> byHeader;
+  for (auto bb : domTree.order()) {
+    for (auto succ : bb->succs()) {
+      if (!domTree.dominates(succ, bb)) {
+        continue;
+      }
+      auto &loop = byHeader[succ];
+      if (!loop) {
+        loops.push_back(std::make_unique<Loop>());
+        loop = loops.back().get();
+        loop->header = succ;
+        loop->members.insert(succ);
+      }
+
+      std::vector<BasicBlock *> worklist{bb};
+      while (!worklist.empty()) {
+        auto cur = worklist.back();
+        worklist.pop_back();
+        if (!loop->members.insert(cur).second) {
+          continue;
+        }
+        for (auto pred : preds[cur]) {
+          if (domTree.isReachable(pred)) {
+            worklist.push_back(pred);
+          }
+        }
+      }
+    }
+  }
+
+  // smaller loops nest inside the smallest larger loop holding their header
+  std::vector<Loop *> bySize;
+  for (auto &loop : loops) {
+    bySize.push_back(loop.get());
+  }
+  std::ranges::sort(bySize, {}, [](Loop *loop) { return loop->members.size(); });
+  for (size_t i = 0; i < bySize.size(); ++i) {
+    for (size_t j = i + 1; j < bySize.size(); ++j) {
+      if (bySize[j]->contains(bySize[i]->header)) {
+        bySize[i]->parent = bySize[j];
+        bySize[j]->subLoops.push_back(bySize[i]);
+        break;
+      }
+    }
+    if (!bySize[i]->parent) {
+      roots.push_back(bySize[i]);
+    }
+  }
+
+  for (auto bb : domTree.order()) {
+    for (auto loop : bySize) {
+      if (loop->contains(bb)) {
+        loop->blocks.push_back(bb);
+        innermost.try_emplace(bb, loop);
+      }
+    }
+  }
+}
+
+auto LoopInfo::loopFor(const BasicBlock *bb) const -> Loop * {
+  auto it = innermost.find(bb);
+  return it == innermost.end() ? nullptr : it->second;
+}
+
+auto LoopInfo::postOrder() const -> std::vector<Loop *> {
+  std::vector<Loop *> res;
+  auto visit = [&](this auto &&self, Loop *loop) -> void {
+    for (auto sub : loop->subLoops) {
+      self(sub);
+    }
+    res.push_back(loop);
+  };
+  for (auto root : roots) {
+    visit(root);
+  }
+  return res;
+}
+
+auto AnalysisManager::domTree(const Function &func) -> const DominatorTree & {
+  auto &res = entries[&func].domTree;
+  if (res) {
+    ++stats.cached;
+  } else {
+    res = std::make_unique<DominatorTree>(func);
+    ++stats.computed;
+  }
+  return *res;
+}
+
+auto AnalysisManager::postDomTree(const Function &func)
+    -> const PostDominatorTree & {
+  auto &res = entries[&func].postDomTree;
+  if (res) {
+    ++stats.cached;
+  } else {
+    res = std::make_unique<PostDominatorTree>(func);
+    ++stats.computed;
+  }
+  return *res;
+}
+
+auto AnalysisManager::loops(const Function &func) -> const LoopInfo & {
+  auto &res = entries[&func].loops;
+  if (res) {
+    ++stats.cached;
+  } else {
+    res = std::make_unique<LoopInfo>(func, domTree(func));
+    ++stats.computed;
+  }
+  return *res;
+}
+
+auto AnalysisManager::invalidate(const Function &func, PreservedAnalyses kept)
+    -> void {
+  auto it = entries.find(&func);
+  if (it == entries.end()) {
+    return;
+  }
+  auto drop = [&](auto &analysis, PreservedAnalyses::Kind kind) {
+    if (analysis && !kept.preserves(kind)) {
+      analysis.reset();
+      ++stats.invalidated;
+    }
+  };
+  drop(it->second.domTree, PreservedAnalyses::Dominators);
+  drop(it->second.postDomTree, PreservedAnalyses::PostDominators);
+  drop(it->second.loops, PreservedAnalyses::Loops);
+}
+
+auto AnalysisManager::clear() -> void {
+  for (const auto &[func, entry] : entries) {
+    stats.invalidated += (entry.domTree ? 1 : 0) +
+                         (entry.postDomTree ? 1 : 0) + (entry.loops ? 1 : 0);
+  }
+  entries.clear();
+}
+
+InductionInfo::InductionInfo(const Function &func, const LoopInfo &loops,
+                             const DominatorTree &domTree) {
+  std::unordered_set<const Value *> leaked;
+  for (const auto &bb : func.blocks) {
+    for (const auto &inst : bb->insts) {
+      if (inst->op == Op::Alloc &&
+          sameType(pointee(inst->ty), type::IntType::get())) {
+        scalars.insert(inst.get());
+      }
+      for (size_t i = 0; i < inst->operands.size(); ++i) {
+        if (inst->op != Op::Load && (inst->op != Op::Store || i != 1)) {
+          leaked.insert(inst->operands[i]);
+        }
+      }
+      for (const auto &edge : inst->edges) {
+        leaked.insert(edge.args.begin(), edge.args.end());
+      }
+    }
+  }
+  std::erase_if(scalars, [&](auto val) { return leaked.contains(val); });
+
+  for (auto loop : loops.postOrder()) {
+    std::unordered_map<const Value *, int> stores;
+    for (auto bb : loop->blocks) {
+      for (const auto &inst : bb->insts) {
+        if (inst->op == Op::Store) {
+          ++stores[inst->operands[1]];
+        }
+      }
+    }
+    auto latches = loop->latches();
+    auto &found = ivs[loop];
+    for (auto bb : loop->blocks) {
+      if (loops.loopFor(bb) != loop ||
+          !std::ranges::all_of(latches, [&](auto latch) {
+            return domTree.dominates(bb, latch);
+          })) {
+        continue;
+      }
+      for (const auto &inst : bb->insts) {
+        if (inst->op != Op::Store) {
+          continue;
+        }
+        auto slot = inst->operands[1];
+        auto next = inst->operands[0];
+        if (!scalars.contains(slot) || stores.at(slot) != 1 ||
+            next->op != Op::Binary || next->parent != bb ||
+            (next->binop != BinOp::Add && next->binop != BinOp::Sub)) {
+          continue;
+        }
+        // the update is the slot's only store in the loop, so a load from a
+        // dominating block still reads the value the iteration started with
+        auto isOld = [&](const Value *val) {
+          return val->op == Op::Load && val->operands[0] == slot &&
+                 (val->parent == bb || (loop->contains(val->parent) &&
+                                        domTree.dominates(val->parent, bb)));
+        };
+        auto lhs = next->operands[0];
+        auto rhs = next->operands[1];
+        int step = 0;
+        if (isOld(lhs) && rhs->isInt()) {
+          step = next->binop == BinOp::Add ? rhs->imm : -rhs->imm;
+        } else if (next->binop == BinOp::Add && isOld(rhs) && lhs->isInt()) {
+          step = lhs->imm;
+        }
+        if (step != 0) {
+          found.push_back({slot, inst.get(), step});
+        }
+      }
+    }
+  }
+}
+
+auto InductionInfo::of(const Loop *loop) const
+    -> const std::vector<InductionVariable> & {
+  auto it = ivs.find(loop);
+  return it == ivs.end() ? none : it->second;
+}
+
+auto InductionInfo::find(const Loop *loop, const Value *slot) const
+    -> const InductionVariable * {
+  for (const auto &iv : of(loop)) {
+    if (iv.slot == slot) {
+      return &iv;
+    }
+  }
+  return nullptr;
+}
+
+auto opt::entryValue(BasicBlock *entering, const Value *slot) -> Value * {
+  auto preds = entering->parent->preds();
+  std::unordered_set<BasicBlock *> seen;
+  for (auto bb = entering; bb && seen.insert(bb).second;
+       bb = preds[bb].size() == 1 ? preds[bb][0] : nullptr) {
+    for (auto it = bb->insts.rbegin(); it != bb->insts.rend(); ++it) {
+      if ((*it)->op == Op::Store && (*it)->operands[1] == slot) {
+        return (*it)->operands[0];
+      }
+    }
+  }
+  return nullptr;
+}
+
+auto opt::isIdentifiedObject(const Value *val) -> bool {
+  return val->op == Op::Alloc || val->op == Op::GlobalAlloc;
+}
+
+AliasAnalysis::AliasAnalysis(const Function &func) {
+  auto leak = [&](Value *val) {
+    if (val->ty->is_ptr()) {
+      if (auto base = location(val).base; base->op == Op::Alloc) {
+        escaping.insert(base);
+      }
+    }
+  };
+  for (const auto &bb : func.blocks) {
+    for (const auto &inst : bb->insts) {
+      if (inst->op == Op::Call || inst->op == Op::Return) {
+        std::ranges::for_each(inst->operands, leak);
+      } else if (inst->op == Op::Store) {
+        leak(inst->operands[0]);
+      }
+      for (const auto &edge : inst->edges) {
+        std::ranges::for_each(edge.args, leak);
+      }
+    }
+  }
+}
+
+auto AliasAnalysis::location(Value *ptr) -> const MemoryLocation & {
+  if (auto it = locations.find(ptr); it != locations.end()) {
+    return it->second;
+  }
+  MemoryLocation res{ptr};
+  if (ptr->op == Op::GetPtr || ptr->op == Op::GetElemPtr) {
+    res = location(ptr->operands[0]);
+    auto index = ptr->operands[1];
+    int stride = sizeOf(pointee(ptr->ty));
+    if (index->isInt()) {
+      res.lo += index->imm * stride;
+      res.hi += index->imm * stride;
+    } else if (ptr->op == Op::GetElemPtr) {
+      auto arr = std::dynamic_pointer_cast<type::ArrayType>(
+          pointee(ptr->operands[0]->ty));
+      res.hi += (arr->len - 1) * stride;
+    } else {
+      res.bounded = false;
+    }
+  }
+  res.size = sizeOf(pointee(ptr->ty));
+  return locations[ptr] = res;
+}
+
+auto AliasAnalysis::mayShareObject(const Value *a, const Value *b) const
+    -> bool {
+  if (a == b) {
+    return true;
+  }
+  if (isIdentifiedObject(a) && isIdentifiedObject(b)) {
+    return false;
+  }
+  return !isPrivate(a) && !isPrivate(b);
+}
+
+auto AliasAnalysis::alias(Value *a, Value *b) -> AliasResult {
+  auto &stats = statistics();
+  ++stats.queries;
+  auto key = a < b ? std::pair<const Value *, const Value *>{a, b}
+                   : std::pair<const Value *, const Value *>{b, a};
+  auto [it, inserted] = results.try_emplace(key, AliasResult::MayAlias);
+  if (!inserted) {
+    ++stats.cached;
+  } else {
+    const auto &la = location(a);
+    const auto &lb = location(b);
+    if (!mayShareObject(la.base, lb.base)) {
+      it->second = AliasResult::NoAlias;
+    } else if (la.base == lb.base && la.bounded && lb.bounded) {
+      if (la.hi + la.size <= lb.lo || lb.hi + lb.size <= la.lo) {
+        it->second = AliasResult::NoAlias;
+      } else if (la.offset() && la.offset() == lb.offset() &&
+                 la.size == lb.size) {
+        it->second = AliasResult::MustAlias;
+      }
+    }
+  }
+
+  // clang-format off
+  switch (it->second) {
+  case AliasResult::NoAlias:   ++stats.noAlias; break;
+  case AliasResult::MayAlias:  ++stats.mayAlias; break;
+  case AliasResult::MustAlias: ++stats.mustAlias; break;
+  }
+  // clang-format on
+  return it->second;
+}
+
+auto AliasAnalysis::statistics() -> Statistics & {
+  static Statistics stats;
+  return stats;
+}
+
+CallGraph::CallGraph(const Module &module) {
+  for (const auto &func : module.funcs) {
+    auto &out = edges[func.get()];
+    for (const auto &bb : func->blocks) {
+      for (const auto &inst : bb->insts) {
+        if (inst->op != Op::Call) {
+          continue;
+        }
+        ++sites[inst->callee];
+        if (std::ranges::find(out, inst->callee) == out.end()) {
+          out.push_back(inst->callee);
+        }
+      }
+    }
+  }
+
+  // Tarjan's algorithm emits components in reverse topological order,
+  // i.e. callees before callers
+  std::unordered_map<const Function *, int> index;
+  std::unordered_map<const Function *, int> low;
+  std::unordered_set<const Function *> onStack;
+  std::vector<Function *> stack;
+  int clock = 0;
+
+  auto connect = [&](this auto &&self, Function *func) -> void {
+    index[func] = low[func] = clock++;
+    stack.push_back(func);
+    onStack.insert(func);
+    for (auto callee : edges[func]) {
+      if (!index.contains(callee)) {
+        self(callee);
+        low[func] = std::min(low[func], low[callee]);
+      } else if (onStack.contains(callee)) {
+        low[func] = std::min(low[func], index[callee]);
+      }
+    }
+    if (low[func] != index[func]) {
+      return;
+    }
+    std::vector<Function *> component;
+    Function *member = nullptr;
+    do {
+      member = stack.back();
+      stack.pop_back();
+      onStack.erase(member);
+      sccIndex[member] = static_cast<int>(components.size());
+      component.push_back(member);
+    } while (member != func);
+    components.push_back(std::move(component));
+  };
+
+  for (const auto &func : module.funcs) {
+    if (!index.contains(func.get())) {
+      connect(func.get());
+    }
+  }
+}
+
+auto CallGraph::callees(const Function *func) const
+    -> const std::vector<Function *> & {
+  return edges.at(func);
+}
+
+auto CallGraph::callSites(const Function *func) const -> int {
+  auto it = sites.find(func);
+  return it == sites.end() ? 0 : it->second;
+}
+
+auto CallGraph::isRecursive(const Function *func) const -> bool {
+  const auto &component = components[sccIndex.at(func)];
+  const auto &out = edges.at(func);
+  return component.size() > 1 ||
+         std::ranges::find(out, func) != out.end();
+}
+
+SideEffectInfo::SideEffectInfo(const CallGraph &calls) {
+  auto isLocal = [](const Value *ptr) {
+    while (ptr->op == Op::GetPtr || ptr->op == Op::GetElemPtr) {
+      ptr = ptr->operands[0];
+    }
+    return ptr->op == Op::Alloc;
+  };
+  // effects of the function's own instructions, calls excluded
+  auto local = [&](const Function *func) {
+    if (func->isDecl()) {
+      return Purity::Writing;
+    }
+    auto res = Purity::Pure;
+    for (const auto &bb : func->blocks) {
+      for (const auto &inst : bb->insts) {
+        if (inst->op == Op::Store && !isLocal(inst->operands[1])) {
+          return Purity::Writing;
+        }
+        if (inst->op == Op::Load && !isLocal(inst->operands[0])) {
+          res = Purity::ReadOnly;
+        }
+      }
+    }
+    return res;
+  };
+
+  for (const auto &component : calls.sccs()) {
+    auto res = Purity::Pure;
+    for (auto func : component) {
+      res = std::max(res, local(func));
+      for (auto callee : calls.callees(func)) {
+        if (!calls.sameSCC(func, callee)) {
+          res = std::max(res, summary.at(callee));
+        }
+      }
+    }
+    for (auto func : component) {
+      summary[func] = res;
+    }
+  }
+}
+
+namespace {
+
+/**
+ * @brief What is known at a program point: the ranges of private scalars,
+ * and the ranges of SSA values narrowed by branch conditions.
+ *
+ * A missing scalar may hold anything; a missing SSA value has the range it
+ * was computed with.
+ */
+using RangeState = std::unordered_map<const Value *, Interval>;
+
+/**
+ * @brief The interval `[lo, hi]`, or the full range if it leaves `i32`.
+ */
+auto fit(long lo, long hi) -> Interval {
+  if (lo < INT32_MIN || hi > INT32_MAX) {
+    return Interval::full();
+  }
+  return {lo, hi};
+}
+
+auto hull(const Interval &a, const Interval &b) -> Interval {
+  return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+/**
+ * @brief The smallest `2^k - 1` not below `val >= 0`.
+ */
+auto lowMask(long val) -> long {
+  long res = 0;
+  while (res < val) {
+    res = res * 2 + 1;
+  }
+  return res;
+}
+
+auto evaluate(BinOp op, const Interval &a, const Interval &b) -> Interval {
+  auto compare = [](bool yes, bool no) {
+    return yes ? Interval::constant(1)
+               : no ? Interval::constant(0) : Interval{0, 1};
+  };
+  bool shift = b.isConstant() && b.lo >= 0 && b.lo < 32;
+  switch (op) {
+  case BinOp::Add: return fit(a.lo + b.lo, a.hi + b.hi);
+  case BinOp::Sub: return fit(a.lo - b.hi, a.hi - b.lo);
+  case BinOp::Mul: {
+    auto products = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+    return fit(std::min(products), std::max(products));
+  }
+  case BinOp::Div:
+    if (b.isConstant() && b.lo != 0) {
+      // truncating division is monotone in the dividend
+      auto x = a.lo / b.lo;
+      auto y = a.hi / b.lo;
+      return fit(std::min(x, y), std::max(x, y));
+    }
+    if (b.lo > 0) {
+      return {std::min(a.lo, 0L), std::max(a.hi, 0L)};
+    }
+    return Interval::full();
+  case BinOp::Mod: {
+    // the remainder is smaller than the divisor and has the dividend's sign
+    long bound = std::max(std::abs(b.lo), std::abs(b.hi)) - 1;
+    return {a.lo >= 0 ? 0 : std::max(a.lo, -bound),
+            a.hi <= 0 ? 0 : std::min(a.hi, bound)};
+  }
+  case BinOp::And:
+    if (a.lo >= 0 || b.lo >= 0) {
+      return {0, std::min(a.lo >= 0 ? a.hi : b.hi, b.lo >= 0 ? b.hi : a.hi)};
+    }
+    return Interval::full();
+  case BinOp::Or:
+  case BinOp::Xor:
+    if (a.lo >= 0 && b.lo >= 0) {
+      return {0, lowMask(std::max(a.hi, b.hi))};
+    }
+    return Interval::full();
+  case BinOp::Shl:
+    return shift ? fit(a.lo * (1L << b.lo), a.hi * (1L << b.lo))
+                 : Interval::full();
+  case BinOp::Sar:
+    return shift ? Interval{a.lo >> b.lo, a.hi >> b.lo} : Interval::full();
+  case BinOp::Shr:
+    if (shift && a.lo >= 0) {
+      return {a.lo >> b.lo, a.hi >> b.lo};
+    }
+    return shift && b.lo > 0 ? Interval{0, 0xffffffffL >> b.lo}
+                             : Interval::full();
+  case BinOp::Lt: return compare(a.hi < b.lo, a.lo >= b.hi);
+  case BinOp::Le: return compare(a.hi <= b.lo, a.lo > b.hi);
+  case BinOp::Gt: return compare(a.lo > b.hi, a.hi <= b.lo);
+  case BinOp::Ge: return compare(a.lo >= b.hi, a.hi < b.lo);
+  case BinOp::Eq:
+    return compare(a.isConstant() && a == b, a.hi < b.lo || b.hi < a.lo);
+  case BinOp::Ne:
+    return compare(a.hi < b.lo || b.hi < a.lo, a.isConstant() && a == b);
+  }
+  return Interval::full();
+}
+
+auto isComparison(BinOp op) -> bool {
+  return op == BinOp::Lt || op == BinOp::Le || op == BinOp::Gt ||
+         op == BinOp::Ge || op == BinOp::Eq || op == BinOp::Ne;
+}
+
+auto negate(BinOp op) -> BinOp {
+  // clang-format off
+  switch (op) {
+  case BinOp::Lt: return BinOp::Ge;
+  case BinOp::Le: return BinOp::Gt;
+  case BinOp::Gt: return BinOp::Le;
+  case BinOp::Ge: return BinOp::Lt;
+  case BinOp::Eq: return BinOp::Ne;
+  default:        return BinOp::Eq;
+  }
+  // clang-format on
+}
+
+/**
+ * @brief Narrows `a` and `b` to the values for which `a op b` holds.
+ */
+auto constrain(BinOp op, Interval &a, Interval &b) -> void {
+  switch (op) {
+  case BinOp::Lt:
+    a.hi = std::min(a.hi, b.hi - 1);
+    b.lo = std::max(b.lo, a.lo + 1);
+    break;
+  case BinOp::Le:
+    a.hi = std::min(a.hi, b.hi);
+    b.lo = std::max(b.lo, a.lo);
+    break;
+  case BinOp::Gt: constrain(BinOp::Lt, b, a); break;
+  case BinOp::Ge: constrain(BinOp::Le, b, a); break;
+  case BinOp::Eq:
+    a = b = {std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+    break;
+  case BinOp::Ne: {
+    // only an excluded bound of the other side narrows an interval
+    auto before = a;
+    if (b.isConstant()) {
+      a.lo += a.lo == b.lo;
+      a.hi -= a.hi == b.lo;
+    }
+    if (before.isConstant()) {
+      b.lo += b.lo == before.lo;
+      b.hi -= b.hi == before.lo;
+    }
+    break;
+  }
+  default: break;
+  }
+}
+
+/**
+ * @brief The facts known on every one of two paths.
+ */
+auto join(const RangeState &a, const RangeState &b) -> RangeState {
+  RangeState res;
+  for (const auto &[val, range] : a) {
+    if (auto it = b.find(val); it != b.end()) {
+      res.emplace(val, hull(range, it->second));
+    }
+  }
+  return res;
+}
+
+} // namespace
+
+ValueRanges::ValueRanges(const Function &func, const DominatorTree &domTree) {
+  // i32 scalars that are only ever loaded and stored
+  std::unordered_set<const Value *> slots;
+  for (const auto &bb : func.blocks) {
+    for (const auto &inst : bb->insts) {
+      if (inst->op == Op::Alloc && pointee(inst->ty)->is_int()) {
+        slots.insert(inst.get());
+      }
+    }
+  }
+  for (const auto &bb : func.blocks) {
+    for (const auto &inst : bb->insts) {
+      for (size_t k = 0; k < inst->operands.size(); ++k) {
+        bool access = (inst->op == Op::Load && k == 0) ||
+                      (inst->op == Op::Store && k == 1);
+        if (!access) {
+          slots.erase(inst->operands[k]);
+        }
+      }
+      for (const auto &edge : inst->edges) {
+        for (auto arg : edge.args) {
+          slots.erase(arg);
+        }
+      }
+    }
+  }
+
+  // widening thresholds: where comparisons with constants stop a counter,
+  // and one step short of overflowing
+  std::vector<long> limits{INT32_MIN, INT32_MIN + 1, INT32_MAX - 1, INT32_MAX};
+  for (const auto &bb : func.blocks) {
+    for (const auto &inst : bb->insts) {
+      if (inst->op == Op::Binary && isComparison(inst->binop)) {
+        for (auto val : inst->operands) {
+          if (val->isInt()) {
+            limits.insert(limits.end(), {val->imm - 1L, val->imm, val->imm + 1L});
+          }
+        }
+      }
+    }
+  }
+  std::ranges::sort(limits);
+
+  auto rangeOf = [&](const RangeState &state, const Value *val) {
+    if (val->isInt()) {
+      return Interval::constant(val->imm);
+    }
+    if (auto it = state.find(val); it != state.end()) {
+      return it->second;
+    }
+    if (auto it = results.find(val); it != results.end()) {
+      return it->second;
+    }
+    return Interval::full();
+  };
+
+  // out states per CFG edge; a missing edge is not known to be taken
+  std::map<std::pair<const BasicBlock *, const BasicBlock *>, RangeState>
+      edges;
+  // which SSA value a scalar is known to hold, within the current block
+  std::unordered_map<const Value *, const Value *> holds;
+
+  auto narrowTo = [&](RangeState &state, const Value *val, Interval range) {
+    if (val->isInt()) {
+      return;
+    }
+    state[val] = range;
+    for (const auto &[slot, held] : holds) {
+      if (held == val) {
+        state[slot] = range;
+      }
+    }
+  };
+  // narrows `state` by `cond` being `truth`, false if that cannot happen
+  auto narrow = [&](RangeState &state, const Value *cond, bool truth) {
+    // `ne (lt a, b), 0` as produced for `if (a < b)` tests the comparison
+    if (cond->op == Op::Binary &&
+        (cond->binop == BinOp::Ne || cond->binop == BinOp::Eq) &&
+        cond->operands[1]->isInt(0) && cond->operands[0]->op == Op::Binary &&
+        isComparison(cond->operands[0]->binop)) {
+      narrowTo(state, cond, Interval::constant(truth ? 1 : 0));
+      truth = cond->binop == BinOp::Ne ? truth : !truth;
+      cond = cond->operands[0];
+    }
+    auto range = rangeOf(state, cond);
+    if (range.isConstant()) {
+      return (range.lo != 0) == truth;
+    }
+    if (cond->op == Op::Binary && isComparison(cond->binop)) {
+      auto a = rangeOf(state, cond->operands[0]);
+      auto b = rangeOf(state, cond->operands[1]);
+      constrain(truth ? cond->binop : negate(cond->binop), a, b);
+      if (a.isEmpty() || b.isEmpty()) {
+        return false;
+      }
+      narrowTo(state, cond->operands[0], a);
+      narrowTo(state, cond->operands[1], b);
+    } else {
+      auto zero = Interval::constant(0);
+      constrain(truth ? BinOp::Ne : BinOp::Eq, range, zero);
+      if (range.isEmpty()) {
+        return false;
+      }
+    }
+    narrowTo(state, cond, Interval::constant(truth ? 1 : 0));
+    return true;
+  };
+  auto transfer = [&](const BasicBlock *bb, RangeState state) -> bool {
+    bool changed = false;
+    holds.clear();
+    for (const auto &inst : bb->insts) {
+      auto val = inst.get();
+      std::optional<Interval> res;
+      switch (val->op) {
+      case Op::Load:
+        if (slots.contains(val->operands[0])) {
+          res = rangeOf(state, val->operands[0]);
+          holds[val->operands[0]] = val;
+        } else if (val->ty->is_int()) {
+          res = Interval::full();
+        }
+        break;
+      case Op::Store:
+        if (slots.contains(val->operands[1])) {
+          state[val->operands[1]] = rangeOf(state, val->operands[0]);
+          holds[val->operands[1]] = val->operands[0];
+        }
+        break;
+      case Op::Binary: {
+        std::vector<Interval> ranges{rangeOf(state, val->operands[0]),
+                                     rangeOf(state, val->operands[1])};
+        res = evaluate(val->binop, ranges[0], ranges[1]);
+        operands[val] = std::move(ranges);
+        break;
+      }
+      case Op::Call:
+        if (val->ty->is_int()) {
+          res = Interval::full();
+        }
+        break;
+      default: break;
+      }
+      if (res) {
+        auto [it, added] = results.try_emplace(val, *res);
+        changed |= added || it->second != *res;
+        it->second = *res;
+        state.erase(val);
+      }
+    }
+
+    auto term = bb->terminator();
+    auto leave = [&](const Edge &edge, RangeState out) {
+      for (size_t k = 0; k < edge.args.size(); ++k) {
+        out[edge.target->params[k].get()] = rangeOf(out, edge.args[k]);
+      }
+      edges[{bb, edge.target}] = std::move(out);
+    };
+    if (term->op == Op::Jump) {
+      leave(term->edges[0], std::move(state));
+    } else if (term->op == Op::Branch) {
+      const auto &outs = term->edges;
+      if (outs[0].target == outs[1].target) {
+        leave(outs[0], std::move(state));
+        return changed;
+      }
+      for (int k = 0; k < 2; ++k) {
+        auto out = state;
+        if (narrow(out, term->operands[0], k == 0)) {
+          leave(outs[k], std::move(out));
+        } else {
+          edges.erase({bb, outs[k].target});
+        }
+      }
+    }
+    return changed;
+  };
+
+  auto preds = func.preds();
+  std::unordered_map<const BasicBlock *, RangeState> entries;
+  std::unordered_map<const BasicBlock *, int> visits;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto bb : domTree.order()) {
+      std::optional<RangeState> state;
+      if (bb == func.entry()) {
+        state.emplace();
+      }
+      for (auto pred : preds[bb]) {
+        if (auto it = edges.find({pred, bb}); it != edges.end()) {
+          state = state ? join(*state, it->second) : it->second;
+        }
+      }
+      if (!state) {
+        continue;
+      }
+      if (auto it = entries.find(bb); it == entries.end()) {
+        entries.emplace(bb, *state);
+        changed = true;
+      } else {
+        // grow monotonically, and jump to the next threshold once a bound
+        // keeps moving
+        auto next = join(it->second, *state);
+        if (++visits[bb] > 3) {
+          for (auto &[val, range] : next) {
+            const auto &before = it->second.at(val);
+            if (range.lo < before.lo) {
+              range.lo = *std::prev(std::ranges::upper_bound(limits, range.lo));
+            }
+            if (range.hi > before.hi) {
+              range.hi = *std::ranges::lower_bound(limits, range.hi);
+            }
+          }
+        }
+        changed |= next != it->second;
+        it->second = std::move(next);
+      }
+      changed |= transfer(bb, entries.at(bb));
+    }
+  }
+}
+
+auto ValueRanges::operand(const Value *inst, size_t index) const -> Interval {
+  if (inst->operands[index]->isInt()) {
+    return Interval::constant(inst->operands[index]->imm);
+  }
+  auto it = operands.find(inst);
+  return it == operands.end() ? Interval::full() : it->second[index];
+}
+
+auto ValueRanges::result(const Value *inst) const -> Interval {
+  auto it = results.find(inst);
+  return it == results.end() ? Interval::full() : it->second;
+}
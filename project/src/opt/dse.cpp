@@ -0,0 +1,357 @@
+/**
+ * @file dse.cpp
+ * @brief Dead store elimination.
+ *
+ * A backward dataflow computes which memory locations are *live*, i.e. may
+ * be read before they are written again, at the end of every block. A
+ * `store` to a location that is not live right after it is deleted:
+ * - it is overwritten on every path before any read, or
+ * - it writes a local that is never read again (locals die at `ret`, while
+ *   globals and locals whose address escapes stay live).
+ *
+ * Locations are identified objects plus byte offsets from `AliasAnalysis`.
+ * Only a store to a known offset overwrites a location; stores with a
+ * dynamic index only get deleted when nothing of their object is live, and
+ * stores through pointers of unknown origin are kept.
+ *
+ * ### Filling Loops
+ * `int a[n] = {};` followed by a loop filling `a[i]` for every `i` writes
+ * each element twice. A loop *fills* a subarray `p` of a local when:
+ * - `i` starts at 0 and steps by 1, and the only exit is either a header
+ *   test `i < len(p)` or a latch test of the stepped value against `len(p)`;
+ * - it stores to `p[i]` (with the value `i` has on entry to the iteration)
+ *   in a block dominating the latch, so every iteration does;
+ * - it never reads the array.
+ *
+ * The elements of `p` are then dead on the edges entering the loop.
+ */
+
+module;
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief The locations that may be read before they are written.
+ */
+struct LiveSet {
+  bool outside = false; ///< Everything a caller or callee can reach.
+  std::unordered_set<const Value *> whole; ///< Objects read at any offset.
+  std::unordered_map<const Value *, std::unordered_set<int>> exact;
+
+  auto size() const -> size_t {
+    size_t res = whole.size() + (outside ? 1 : 0);
+    for (const auto &[base, offsets] : exact) {
+      res += offsets.size();
+    }
+    return res;
+  }
+
+  auto merge(const LiveSet &other) -> void {
+    outside |= other.outside;
+    whole.insert(other.whole.begin(), other.whole.end());
+    for (const auto &[base, offsets] : other.exact) {
+      exact[base].insert(offsets.begin(), offsets.end());
+    }
+  }
+};
+
+class DeadStoreElimination {
+public:
+  DeadStoreElimination(Function &_func, AnalysisManager &am,
+                       const SideEffectInfo &_effects)
+      : func(_func), effects(_effects), domTree(am.domTree(_func)),
+        loops(am.loops(_func)), ivs(_func, loops, domTree), aa(_func) {}
+
+  auto run() -> bool {
+    for (auto loop : loops.postOrder()) {
+      findFilledElements(*loop);
+    }
+
+    // live-out sets, iterated to a fixpoint in post-order
+    std::unordered_map<const BasicBlock *, LiveSet> liveIn;
+    const auto &order = domTree.order();
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        auto live = liveOut(*it, liveIn);
+        transfer(*it, live, nullptr);
+        auto &in = liveIn[*it];
+        if (live.size() != in.size()) {
+          in = std::move(live);
+          changed = true;
+        }
+      }
+    }
+
+    std::unordered_set<const Value *> dead;
+    for (auto bb : order) {
+      auto live = liveOut(bb, liveIn);
+      transfer(bb, live, &dead);
+    }
+    for (auto &bb : func.blocks) {
+      std::erase_if(bb->insts, [&](const auto &inst) {
+        return dead.contains(inst.get());
+      });
+    }
+    return !dead.empty();
+  }
+
+private:
+  Function &func;
+  const SideEffectInfo &effects;
+  const DominatorTree &domTree;
+  const LoopInfo &loops;
+  InductionInfo ivs;
+  AliasAnalysis aa;
+
+  /// A filling loop and the elements it writes.
+  struct Fill {
+    const Loop *loop;
+    MemoryLocation array; ///< The subarray.
+    int len;       ///< Elements written.
+  };
+  std::unordered_map<const BasicBlock *, Fill> fills; ///< By loop header.
+
+  /**
+   * @brief Records the subarray `loop` fills, if it is a filling loop.
+   */
+  auto findFilledElements(const Loop &loop) -> void {
+    auto exiting = loop.exitingBlocks();
+    auto latches = loop.latches();
+    if (exiting.size() != 1 || latches.size() != 1) {
+      return;
+    }
+    auto test = exiting[0];
+    auto latch = latches[0];
+    auto branch = test->terminator();
+    if (branch->op != Op::Branch || !loop.contains(branch->edges[0].target) ||
+        loop.contains(branch->edges[1].target)) {
+      return;
+    }
+
+    // the test `i < len`, on a load of `i` or on the value just stored to it
+    auto cond = branch->operands[0];
+    if (cond->op != Op::Binary || cond->binop != BinOp::Lt ||
+        !cond->operands[1]->isInt()) {
+      return;
+    }
+    auto counter = cond->operands[0];
+    const InductionVariable *iv = nullptr;
+    for (const auto &other : ivs.of(&loop)) {
+      bool loaded = counter->op == Op::Load && counter->parent == test &&
+                    counter->operands[0] == other.slot;
+      if (loaded || other.update->operands[0] == counter) {
+        iv = &other;
+      }
+    }
+    int len = cond->operands[1]->imm;
+    if (!iv || iv->step != 1 || len <= 0) {
+      return;
+    }
+    // either the header tests `i` before the body, or the latch tests the
+    // stepped value after it; each iteration then runs with `i < len`
+    bool stepped = counter->op != Op::Load ||
+                   !readsCurrentValue(counter, iv->update);
+    bool topTested = test == loop.header && test != latch && !stepped;
+    bool bottomTested = test == latch && stepped;
+    if (!topTested && !bottomTested) {
+      return;
+    }
+
+    auto preds = func.preds();
+    std::vector<BasicBlock *> entering;
+    for (auto pred : preds[loop.header]) {
+      if (!loop.contains(pred)) {
+        entering.push_back(pred);
+      }
+    }
+    if (entering.size() != 1) {
+      return;
+    }
+    auto start = entryValue(entering[0], iv->slot);
+    if (!start || !start->isInt() || start->imm != 0) {
+      return;
+    }
+
+    // a store to `p[i]` run by every iteration before `i` is stepped
+    std::optional<MemoryLocation> filled;
+    for (auto bb : loop.blocks) {
+      for (auto &inst : bb->insts) {
+        if (filled || inst->op != Op::Store ||
+            !domTree.dominates(bb, latch)) {
+          continue;
+        }
+        auto dest = inst->operands[1];
+        if (dest->op != Op::GetElemPtr || dest->operands[1]->op != Op::Load ||
+            dest->operands[1]->operands[0] != iv->slot) {
+          continue;
+        }
+        auto array = aa.location(dest->operands[0]);
+        auto ty = std::dynamic_pointer_cast<type::ArrayType>(
+            pointee(dest->operands[0]->ty));
+        if (!aa.isPrivate(array.base) || !array.offset() || !ty ||
+            !ty->base->is_int() || ty->len < len ||
+            !readsCurrentValue(dest->operands[1], iv->update)) {
+          continue;
+        }
+        filled = array;
+      }
+    }
+    if (!filled) {
+      return;
+    }
+    for (auto bb : loop.blocks) {
+      for (auto &inst : bb->insts) {
+        if (inst->op == Op::Load &&
+            aa.location(inst->operands[0]).base == filled->base) {
+          return;
+        }
+      }
+    }
+    fills.emplace(loop.header, Fill{&loop, *filled, len});
+  }
+
+  /**
+   * @brief Whether `load` of an induction slot runs before `update` within
+   * an iteration.
+   */
+  auto readsCurrentValue(const Value *load, const Value *update) const
+      -> bool {
+    if (load->parent != update->parent) {
+      return !domTree.dominates(update->parent, load->parent);
+    }
+    for (auto &inst : load->parent->insts) {
+      if (inst.get() == load) {
+        return true;
+      }
+      if (inst.get() == update) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  auto liveOut(const BasicBlock *bb,
+               const std::unordered_map<const BasicBlock *, LiveSet> &liveIn)
+      const -> LiveSet {
+    LiveSet live;
+    if (bb->terminator()->op == Op::Return) {
+      live.outside = true;
+    }
+    for (auto succ : bb->succs()) {
+      auto it = liveIn.find(succ);
+      if (it == liveIn.end()) {
+        continue;
+      }
+      auto fill = fills.find(succ);
+      if (fill == fills.end() || fill->second.loop->contains(bb)) {
+        live.merge(it->second);
+        continue;
+      }
+      // the loop overwrites the filled elements before reading them
+      LiveSet rest = it->second;
+      const auto &[loop, array, len] = fill->second;
+      if (array.lo == 0 && len * 4 == sizeOf(pointee(array.base->ty))) {
+        rest.whole.erase(array.base);
+        rest.exact.erase(array.base);
+      } else if (auto offsets = rest.exact.find(array.base);
+                 offsets != rest.exact.end()) {
+        for (int i = 0; i < len; ++i) {
+          offsets->second.erase(array.lo + i * 4);
+        }
+      }
+      live.merge(rest);
+    }
+    return live;
+  }
+
+  auto isLive(const LiveSet &live, const MemoryLocation &loc) const -> bool {
+    auto base = loc.base;
+    if ((live.outside && !aa.isPrivate(base)) || live.whole.contains(base)) {
+      return true;
+    }
+    auto it = live.exact.find(base);
+    if (it == live.exact.end()) {
+      return false;
+    }
+    if (auto offset = loc.offset()) {
+      return it->second.contains(*offset);
+    }
+    if (!loc.bounded) {
+      return !it->second.empty();
+    }
+    return std::ranges::any_of(it->second, [&](int offset) {
+      return offset >= loc.lo && offset < loc.hi + loc.size;
+    });
+  }
+
+  /**
+   * @brief Steps `live` backwards through `bb`, collecting the stores it
+   * finds dead into `dead` if given.
+   */
+  auto transfer(BasicBlock *bb, LiveSet &live,
+                std::unordered_set<const Value *> *dead) -> void {
+    for (auto it = bb->insts.rbegin(); it != bb->insts.rend(); ++it) {
+      auto inst = it->get();
+      switch (inst->op) {
+      case Op::Store: {
+        const auto &loc = aa.location(inst->operands[1]);
+        if (!isIdentifiedObject(loc.base)) {
+          break;
+        }
+        if (dead && !isLive(live, loc)) {
+          dead->insert(inst);
+        }
+        if (auto offset = loc.offset()) {
+          if (auto offsets = live.exact.find(loc.base);
+              offsets != live.exact.end()) {
+            offsets->second.erase(*offset);
+          }
+        }
+        break;
+      }
+      case Op::Load: {
+        const auto &loc = aa.location(inst->operands[0]);
+        if (!isIdentifiedObject(loc.base)) {
+          live.outside = true;
+        } else if (auto offset = loc.offset()) {
+          live.exact[loc.base].insert(*offset);
+        } else {
+          live.whole.insert(loc.base);
+        }
+        break;
+      }
+      case Op::Call:
+        live.outside |= !effects.isPure(inst->callee);
+        break;
+      default: break;
+      }
+    }
+  }
+};
+
+} // namespace
+
+auto opt::eliminateDeadStores(Function &func, AnalysisManager &am) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  CallGraph calls(*func.parent);
+  SideEffectInfo effects(calls);
+  return DeadStoreElimination(func, am, effects).run();
+}
@@ -0,0 +1,135 @@
+/**
+ * @file globals.cpp
+ * @brief Promotion of scalar globals to locals of their only user.
+ *
+ * A scalar global that is only ever loaded and stored (its address does not
+ * escape) by a single non-recursive function behaves like a local of that
+ * function, provided no value flows between two calls of it:
+ * - `@main` runs exactly once, so its locals start with the initializer.
+ * - Any other function must write the global before every read, i.e. each
+ *   load is preceded by a store in its block or in a dominating block.
+ *
+ * The global is replaced by an `alloc` in the entry block, initialized with
+ * the global's initializer unless no load can observe it, and removed from
+ * the module. The local can then
+ * be treated as private memory by later passes: no call can clobber it.
+ */
+
+module;
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Whether every load of `global` in `func` reads a value stored by
+ * the same invocation.
+ */
+auto isStoredBeforeLoads(const Function &func, const Value *global,
+                         const std::vector<Value *> &uses) -> bool {
+  DominatorTree domTree(func);
+  std::vector<const BasicBlock *> storing;
+  for (auto use : uses) {
+    if (use->op == Op::Store) {
+      storing.push_back(use->parent);
+    }
+  }
+  for (auto use : uses) {
+    if (use->op != Op::Load) {
+      continue;
+    }
+    auto bb = use->parent;
+    bool covered = std::ranges::any_of(storing, [&](const BasicBlock *def) {
+      return def != bb && domTree.dominates(def, bb);
+    });
+    for (auto &inst : bb->insts) {
+      if (covered || inst.get() == use) {
+        break;
+      }
+      covered = inst->op == Op::Store && inst->operands[1] == global;
+    }
+    if (!covered) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+auto opt::localizeGlobals(Module &module) -> bool {
+  // every use of a candidate global, by function
+  std::unordered_map<const Value *, std::vector<Value *>> uses;
+  std::unordered_map<const Value *, Function *> owner;
+  std::unordered_set<const Value *> rejected;
+  for (auto &func : module.funcs) {
+    for (auto &bb : func->blocks) {
+      for (auto &inst : bb->insts) {
+        for (size_t i = 0; i < inst->operands.size(); ++i) {
+          auto val = inst->operands[i];
+          if (val->op != Op::GlobalAlloc) {
+            continue;
+          }
+          bool access = (inst->op == Op::Load && i == 0) ||
+                        (inst->op == Op::Store && i == 1);
+          auto [it, inserted] = owner.try_emplace(val, func.get());
+          if (!access || it->second != func.get()) {
+            rejected.insert(val);
+          }
+          uses[val].push_back(inst.get());
+        }
+        for (auto &edge : inst->edges) {
+          for (auto arg : edge.args) {
+            rejected.insert(arg);
+          }
+        }
+      }
+    }
+  }
+
+  CallGraph calls(module);
+  std::unordered_set<const Value *> promoted;
+  for (auto &global : module.globals) {
+    auto it = owner.find(global.get());
+    if (it == owner.end() || rejected.contains(global.get()) ||
+        !pointee(global->ty)->is_int()) {
+      continue;
+    }
+    auto func = it->second;
+    bool once = func->name == "@main" && calls.callSites(func) == 0;
+    bool overwritten =
+        isStoredBeforeLoads(*func, global.get(), uses[global.get()]);
+    if (calls.isRecursive(func) || (!once && !overwritten)) {
+      continue;
+    }
+
+    auto entry = func->entry();
+    auto init = global->operands[0];
+    auto local = entry->insert(entry->insts.begin(),
+                               makeAlloc(pointee(global->ty), global->name));
+    if (!overwritten) {
+      entry->insert(std::next(entry->find(local)),
+                    makeStore(init->isInt() ? init : module.getInt(0), local));
+    }
+    replaceAllUses(*func, global.get(), local);
+    promoted.insert(global.get());
+  }
+
+  std::erase_if(module.globals, [&](const auto &global) {
+    return promoted.contains(global.get());
+  });
+  return !promoted.empty();
+}
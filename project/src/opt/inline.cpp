@@ -0,0 +1,311 @@
+/**
+ * @file inline.cpp
+ * @brief Function inlining driven by a size/benefit cost model.
+ *
+ * Functions are visited bottom-up over the strongly connected components of
+ * the call graph, so a callee has already absorbed its own small helpers by
+ * the time it is considered for inlining into its callers.
+ *
+ * ### Cost Model
+ * - **Cost**: number of instructions in the callee, minus a bonus for every
+ *   constant argument (those tend to fold away) and a large bonus if this is
+ *   the callee's only call site (the original can then be deleted).
+ * - **Threshold**: `inlineThreshold`, doubled per enclosing loop of the call
+ *   site (up to two levels), since hot call sites pay the call sequence most.
+ * - **Limits**: a caller never grows beyond `inlineCallerLimit`
+ *   instructions, and recursive callees are unfolded at most
+ *   `inlineRecursionDepth` levels deep.
+ *
+ * ### Transformation
+ * The block holding the call is split after it, the callee's blocks are
+ * cloned in between (allocations go to the caller's entry block), and
+ * `ret v` becomes a store to a return slot followed by a jump to the
+ * continuation, where the slot is loaded in place of the call's result.
+ */
+
+module;
+
+#include <algorithm>
+#include <fmt/core.h>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+// clang-format off
+constexpr int const_arg_bonus = 10;   ///< Per constant argument.
+constexpr int last_call_bonus = 40;   ///< For callees with one call site.
+constexpr int max_loop_scaling = 2;   ///< Loop levels that raise the threshold.
+// clang-format on
+
+struct CallSite {
+  Value *call;
+  int loopDepth; ///< Loop depth of the original call in the caller.
+  int recursion; ///< Recursive inlines this call site came from.
+};
+
+class Inliner {
+public:
+  Inliner(Module &_module, const Options &_options)
+      : module(_module), options(_options), graph(_module) {}
+
+  auto run() -> bool {
+    bool changed = false;
+    for (const auto &component : graph.sccs()) {
+      for (auto func : component) {
+        if (!func->isDecl()) {
+          changed |= inlineInto(*func);
+        }
+      }
+    }
+    changed |= removeDeadFunctions();
+    return changed;
+  }
+
+private:
+  Module &module;
+  const Options &options;
+  CallGraph graph;
+  std::unordered_map<const Function *, int> sizes;
+  /// Erased calls, kept alive until their uses are rewritten.
+  std::vector<std::unique_ptr<Value>> graveyard;
+
+  auto sizeOf(const Function *func) -> int {
+    auto [it, inserted] = sizes.try_emplace(func, 0);
+    if (inserted) {
+      it->second = static_cast<int>(func->instCount());
+    }
+    return it->second;
+  }
+
+  auto remark(std::string_view msg) const -> void {
+    if (options.wantsRemarks("inline")) {
+      fmt::print(stderr, "remark: {}\n", msg);
+    }
+  }
+
+  auto shouldInline(const Function &caller, const CallSite &site) -> bool {
+    auto callee = site.call->callee;
+    if (callee->isDecl()) {
+      return false;
+    }
+
+    bool recursive = graph.isRecursive(callee);
+    if (recursive && site.recursion >= options.inlineRecursionDepth) {
+      remark(fmt::format("{}: not inlining recursive {}: depth limit {}",
+                         caller.name, callee->name,
+                         options.inlineRecursionDepth));
+      return false;
+    }
+
+    int size = sizeOf(callee);
+    if (sizeOf(&caller) + size > options.inlineCallerLimit) {
+      remark(fmt::format("{}: not inlining {}: caller would exceed {} "
+                         "instructions",
+                         caller.name, callee->name, options.inlineCallerLimit));
+      return false;
+    }
+
+    int cost = size;
+    for (auto arg : site.call->operands) {
+      cost -= arg->isInt() ? const_arg_bonus : 0;
+    }
+    if (!recursive && graph.callSites(callee) == 1) {
+      cost -= last_call_bonus;
+    }
+    int threshold = options.inlineThreshold
+                    << std::min(site.loopDepth, max_loop_scaling);
+
+    if (cost > threshold) {
+      remark(fmt::format("{}: not inlining {}: cost {} exceeds threshold {}",
+                         caller.name, callee->name, cost, threshold));
+      return false;
+    }
+    remark(fmt::format("{}: inlined {} (cost {}, threshold {}, loop depth {})",
+                       caller.name, callee->name, cost, threshold,
+                       site.loopDepth));
+    return true;
+  }
+
+  auto inlineInto(Function &caller) -> bool {
+    std::vector<CallSite> worklist;
+    {
+      DominatorTree domTree(caller);
+      LoopInfo loops(caller, domTree);
+      for (auto bb : domTree.order()) {
+        auto loop = loops.loopFor(bb);
+        for (auto &inst : bb->insts) {
+          if (inst->op == Op::Call) {
+            worklist.push_back({inst.get(), loop ? loop->depth() : 0, 0});
+          }
+        }
+      }
+    }
+
+    std::unordered_map<Value *, Value *> results;
+    for (size_t i = 0; i < worklist.size(); ++i) {
+      auto site = worklist[i];
+      if (!shouldInline(caller, site)) {
+        continue;
+      }
+      auto callee = site.call->callee;
+      int recursion = site.recursion + graph.isRecursive(callee);
+      sizes[&caller] += sizeOf(callee);
+      for (auto call : inlineCall(caller, site.call, results)) {
+        worklist.push_back({call, site.loopDepth, recursion});
+      }
+    }
+
+    if (results.empty()) {
+      return false;
+    }
+    replaceAllUses(caller, results);
+    graveyard.clear();
+    return true;
+  }
+
+  /**
+   * @brief Replaces `call` with a copy of its callee's body.
+   *
+   * @param results Receives the mapping from the call to its result.
+   * @return The calls inside the copied body.
+   */
+  auto inlineCall(Function &caller, Value *call,
+                  std::unordered_map<Value *, Value *> &results)
+      -> std::vector<Value *> {
+    auto callee = call->callee;
+    auto block = call->parent;
+    auto entry = caller.entry();
+
+    // the return slot joins the entry block once the body has been cloned
+    std::unique_ptr<Value> slotAlloc;
+    if (!callee->retTy->is_void()) {
+      slotAlloc = makeAlloc(callee->retTy, "@" + callee->name.substr(1) + "_ret");
+    }
+    auto slot = slotAlloc.get();
+
+    // clone first: the callee may be the caller itself
+    std::unordered_map<const Value *, Value *> values;
+    std::unordered_map<const BasicBlock *, BasicBlock *> blocks;
+    std::vector<std::unique_ptr<BasicBlock>> clones;
+    std::vector<Value *> copied;
+    std::vector<std::unique_ptr<Value>> allocs;
+
+    for (size_t i = 0; i < callee->params.size(); ++i) {
+      values[callee->params[i].get()] = call->operands[i];
+    }
+    for (const auto &bb : callee->blocks) {
+      auto clone = std::make_unique<BasicBlock>(bb->name);
+      clone->parent = &caller;
+      for (const auto &param : bb->params) {
+        values[param.get()] = clone->addParam(param->ty);
+      }
+      blocks[bb.get()] = clone.get();
+      clones.push_back(std::move(clone));
+    }
+
+    auto cont = std::make_unique<BasicBlock>(block->name);
+    cont->parent = &caller;
+    for (const auto &bb : callee->blocks) {
+      auto clone = blocks.at(bb.get());
+      for (const auto &inst : bb->insts) {
+        if (inst->op == Op::Return) {
+          if (slot) {
+            copied.push_back(clone->append(makeStore(inst->operands[0], slot)));
+          }
+          clone->append(makeJump(cont.get()));
+          continue;
+        }
+        auto copy = cloneInst(*inst);
+        values[inst.get()] = copy.get();
+        copied.push_back(copy.get());
+        if (copy->op == Op::Alloc) {
+          allocs.push_back(std::move(copy));
+        } else {
+          clone->append(std::move(copy));
+        }
+      }
+    }
+
+    std::vector<Value *> calls;
+    for (auto inst : copied) {
+      inst->forEachUse([&](Value *&use) {
+        // a self-inlined body may still refer to calls inlined before
+        for (auto it = results.find(use); it != results.end();
+             it = results.find(use)) {
+          use = it->second;
+        }
+        if (auto it = values.find(use); it != values.end()) {
+          use = it->second;
+        }
+      });
+      for (auto &edge : inst->edges) {
+        edge.target = blocks.at(edge.target);
+      }
+      if (inst->op == Op::Call) {
+        calls.push_back(inst);
+      }
+    }
+
+    // split the calling block and wire the clones in between
+    auto pos = block->find(call);
+    for (auto it = std::next(pos); it != block->insts.end(); ++it) {
+      (*it)->parent = cont.get();
+    }
+    cont->insts.splice(cont->insts.end(), block->insts, std::next(pos),
+                       block->insts.end());
+    if (slot) {
+      results[call] = cont->insert(cont->insts.begin(), makeLoad(slot));
+    }
+    graveyard.push_back(block->detach(call));
+    block->append(makeJump(blocks.at(callee->entry())));
+
+    auto where = std::next(caller.find(block));
+    for (auto &clone : clones) {
+      caller.blocks.insert(where, std::move(clone));
+    }
+    caller.blocks.insert(where, std::move(cont));
+    if (slotAlloc) {
+      allocs.push_back(std::move(slotAlloc));
+    }
+    for (auto &alloc : allocs) {
+      entry->insert(entry->insts.begin(), std::move(alloc));
+    }
+    return calls;
+  }
+
+  /**
+   * @brief Deletes functions that are no longer called, keeping `@main`.
+   */
+  auto removeDeadFunctions() -> bool {
+    bool changed = false;
+    for (bool erased = true; erased;) {
+      erased = false;
+      CallGraph current(module);
+      std::erase_if(module.funcs, [&](const auto &func) {
+        bool dead = !func->isDecl() && func->name != "@main" &&
+                    current.callSites(func.get()) == 0;
+        erased |= dead;
+        return dead;
+      });
+      changed |= erased;
+    }
+    return changed;
+  }
+};
+
+} // namespace
+
+auto opt::inlineFunctions(Module &module, const Options &options) -> bool {
+  return Inliner(module, options).run();
+}
@@ -0,0 +1,498 @@
+/**
+ * @file instcombine.cpp
+ * @brief Algebraic simplification of binary instructions.
+ *
+ * The front end translates every AST node on its own, so the IR is full of
+ * sequences a peephole can shorten: `sub 0, %x` for each nested unary minus,
+ * `eq 0, %x` for `!`, `ne %c, 0` on comparisons that are already 0 or 1, and
+ * arithmetic on constants once inlining and unrolling have substituted them.
+ *
+ * Each rule of the table below either replaces an instruction by an
+ * existing value or rewrites its operator and operands in place; no rule
+ * creates instructions, so a rewrite never adds work of its own. A worklist
+ * revisits the users of everything that changed until no rule applies.
+ *
+ * Canonical forms, which later rules and passes rely on:
+ * - constants are the right operand of commutative operators and
+ *   comparisons (`gt 5, %x` becomes `lt %x, 5`);
+ * - a constant is added rather than subtracted (`add %x, -1`);
+ * - `le` / `ge` against a constant become `lt` / `gt`, which the backend
+ *   emits as a single `slt` / `sgt`.
+ */
+
+module;
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+
+using namespace opt;
+
+namespace {
+
+auto isComparison(BinOp op) -> bool {
+  return op == BinOp::Lt || op == BinOp::Le || op == BinOp::Gt ||
+         op == BinOp::Ge || op == BinOp::Eq || op == BinOp::Ne;
+}
+
+auto isCommutative(BinOp op) -> bool {
+  return op == BinOp::Add || op == BinOp::Mul || op == BinOp::And ||
+         op == BinOp::Or || op == BinOp::Xor || op == BinOp::Eq ||
+         op == BinOp::Ne;
+}
+
+/**
+ * @brief The comparison with swapped operands: `a < b` is `b > a`.
+ */
+auto mirrored(BinOp op) -> BinOp {
+  // clang-format off
+  switch (op) {
+  case BinOp::Lt: return BinOp::Gt;
+  case BinOp::Le: return BinOp::Ge;
+  case BinOp::Gt: return BinOp::Lt;
+  case BinOp::Ge: return BinOp::Le;
+  default:        return op;
+  }
+  // clang-format on
+}
+
+/**
+ * @brief The comparison that holds exactly when `op` does not.
+ */
+auto inverted(BinOp op) -> BinOp {
+  // clang-format off
+  switch (op) {
+  case BinOp::Lt: return BinOp::Ge;
+  case BinOp::Le: return BinOp::Gt;
+  case BinOp::Gt: return BinOp::Le;
+  case BinOp::Ge: return BinOp::Lt;
+  case BinOp::Eq: return BinOp::Ne;
+  default:        return BinOp::Eq;
+  }
+  // clang-format on
+}
+
+auto isBinary(const Value *val, BinOp op) -> bool {
+  return val->op == Op::Binary && val->binop == op;
+}
+
+/**
+ * @brief Whether `val` is always 0 or 1.
+ */
+auto isBool(const Value *val, int depth = 0) -> bool {
+  // bounds the walk through chains of `&&` results
+  constexpr int max_depth = 4;
+
+  if (val->isInt()) {
+    return val->imm == 0 || val->imm == 1;
+  }
+  if (val->op != Op::Binary) {
+    return false;
+  }
+  if (isComparison(val->binop)) {
+    return true;
+  }
+  bool logical = val->binop == BinOp::And || val->binop == BinOp::Or ||
+                 val->binop == BinOp::Xor;
+  return logical && depth < max_depth &&
+         isBool(val->operands[0], depth + 1) &&
+         isBool(val->operands[1], depth + 1);
+}
+
+/**
+ * @brief The `x` of `sub 0, x`, or nullptr.
+ */
+auto negated(const Value *val) -> Value * {
+  if (isBinary(val, BinOp::Sub) && val->operands[0]->isInt(0)) {
+    return val->operands[1];
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Rewrites `inst` in place to `lhs op rhs`.
+ */
+auto rewrite(Value &inst, BinOp op, Value *lhs, Value *rhs) -> Value * {
+  inst.binop = op;
+  inst.operands = {lhs, rhs};
+  return &inst;
+}
+
+/**
+ * @brief A simplification rule.
+ *
+ * Returns nullptr if the rule does not apply, `&inst` if it rewrote `inst`
+ * in place, and otherwise the value that replaces `inst`.
+ */
+using Rule = Value *(*)(Value &inst, Module &module);
+
+/**
+ * @brief `add 1, 2` is 3.
+ */
+auto foldConstants(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  int res = 0;
+  if (lhs->isInt() && rhs->isInt() &&
+      foldBinary(inst.binop, lhs->imm, rhs->imm, res)) {
+    return module.getInt(res);
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Moves a constant to the right: `mul 4, %x` is `mul %x, 4` and
+ * `gt 5, %x` is `lt %x, 5`.
+ */
+auto moveConstantRight(Value &inst, Module &) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  if (!lhs->isInt() || rhs->isInt()) {
+    return nullptr;
+  }
+  if (isCommutative(inst.binop) || isComparison(inst.binop)) {
+    return rewrite(inst, mirrored(inst.binop), rhs, lhs);
+  }
+  return nullptr;
+}
+
+/**
+ * @brief `sub %x, 3` is `add %x, -3`, which reassociates like any add.
+ */
+auto addNegatedConstant(Value &inst, Module &module) -> Value * {
+  auto rhs = inst.operands[1];
+  if (inst.binop != BinOp::Sub || !rhs->isInt() || rhs->imm == 0 ||
+      rhs->imm == INT32_MIN) {
+    return nullptr;
+  }
+  return rewrite(inst, BinOp::Add, inst.operands[0], module.getInt(-rhs->imm));
+}
+
+/**
+ * @brief Operations with a neutral or absorbing right constant, such as
+ * `add %x, 0`, `mul %x, 1` or `and %x, 0`.
+ */
+auto rightIdentity(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  if (!rhs->isInt()) {
+    return nullptr;
+  }
+  switch (inst.binop) {
+  case BinOp::Add:
+  case BinOp::Sub:
+  case BinOp::Or:
+  case BinOp::Xor:
+  case BinOp::Shl:
+  case BinOp::Shr:
+  case BinOp::Sar: return rhs->imm == 0 ? lhs : nullptr;
+  case BinOp::Mul:
+    if (rhs->imm == 0) {
+      return rhs;
+    }
+    return rhs->imm == 1 ? lhs : nullptr;
+  case BinOp::Div: return rhs->imm == 1 ? lhs : nullptr;
+  case BinOp::Mod:
+    return rhs->imm == 1 || rhs->imm == -1 ? module.getInt(0) : nullptr;
+  case BinOp::And:
+    if (rhs->imm == 0) {
+      return rhs;
+    }
+    return rhs->imm == -1 ? lhs : nullptr;
+  default: return nullptr;
+  }
+}
+
+/**
+ * @brief `sub %x, %x` is 0 and `le %x, %x` is 1. Division is left alone,
+ * as it traps for 0.
+ */
+auto sameOperands(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  if (lhs != inst.operands[1]) {
+    return nullptr;
+  }
+  // clang-format off
+  switch (inst.binop) {
+  case BinOp::And:
+  case BinOp::Or:  return lhs;
+  case BinOp::Sub:
+  case BinOp::Xor:
+  case BinOp::Ne:
+  case BinOp::Lt:
+  case BinOp::Gt:  return module.getInt(0);
+  case BinOp::Eq:
+  case BinOp::Le:
+  case BinOp::Ge:  return module.getInt(1);
+  default:         return nullptr;
+  }
+  // clang-format on
+}
+
+/**
+ * @brief Negations from unary minus: `sub 0, (sub 0, %x)` is `%x`, and a
+ * negated operand turns `add` into `sub` and back.
+ */
+auto foldNegation(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  switch (inst.binop) {
+  case BinOp::Sub:
+    if (lhs->isInt(0) && isBinary(rhs, BinOp::Sub)) {
+      // -(-x) is x, -(a - b) is b - a
+      if (auto val = negated(rhs)) {
+        return val;
+      }
+      return rewrite(inst, BinOp::Sub, rhs->operands[1], rhs->operands[0]);
+    }
+    if (auto val = negated(rhs)) {
+      return rewrite(inst, BinOp::Add, lhs, val);
+    }
+    return nullptr;
+  case BinOp::Add:
+    if (auto val = negated(rhs)) {
+      return rewrite(inst, BinOp::Sub, lhs, val);
+    }
+    if (auto val = negated(lhs)) {
+      return rewrite(inst, BinOp::Sub, rhs, val);
+    }
+    return nullptr;
+  case BinOp::Mul:
+  case BinOp::Div:
+    // x / -1 wraps like 0 - x for INT32_MIN
+    if (rhs->isInt(-1)) {
+      return rewrite(inst, BinOp::Sub, module.getInt(0), lhs);
+    }
+    return nullptr;
+  default: return nullptr;
+  }
+}
+
+/**
+ * @brief Combines constants across two operations: `add (add %x, 1), 2` is
+ * `add %x, 3`, and `add (sub 5, %x), 1` is `sub 6, %x`.
+ */
+auto reassociate(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  int res = 0;
+  if (!rhs->isInt() || lhs->op != Op::Binary) {
+    // c1 - (x + c2) is (c1 - c2) - x
+    if (inst.binop == BinOp::Sub && lhs->isInt() &&
+        isBinary(rhs, BinOp::Add) && rhs->operands[1]->isInt()) {
+      foldBinary(BinOp::Sub, lhs->imm, rhs->operands[1]->imm, res);
+      return rewrite(inst, BinOp::Sub, module.getInt(res), rhs->operands[0]);
+    }
+    return nullptr;
+  }
+  auto inner = lhs->operands;
+  bool associative = inst.binop == BinOp::Add || inst.binop == BinOp::Mul ||
+                     inst.binop == BinOp::And || inst.binop == BinOp::Or ||
+                     inst.binop == BinOp::Xor;
+  if (associative && lhs->binop == inst.binop && inner[1]->isInt()) {
+    foldBinary(inst.binop, inner[1]->imm, rhs->imm, res);
+    return rewrite(inst, inst.binop, inner[0], module.getInt(res));
+  }
+  if (inst.binop == BinOp::Add && lhs->binop == BinOp::Sub &&
+      inner[0]->isInt()) {
+    foldBinary(BinOp::Add, inner[0]->imm, rhs->imm, res);
+    return rewrite(inst, BinOp::Sub, module.getInt(res), inner[1]);
+  }
+  // (x << a) << b is x << (a + b) while the total stays below 32
+  bool shift = inst.binop == BinOp::Shl || inst.binop == BinOp::Shr ||
+               inst.binop == BinOp::Sar;
+  if (shift && lhs->binop == inst.binop && inner[1]->isInt() &&
+      inner[1]->imm >= 0 && rhs->imm >= 0 && inner[1]->imm + rhs->imm < 32) {
+    return rewrite(inst, inst.binop, inner[0],
+                   module.getInt(inner[1]->imm + rhs->imm));
+  }
+  return nullptr;
+}
+
+/**
+ * @brief `mul %x, 8` is `shl %x, 3`.
+ */
+auto multiplyByPowerOfTwo(Value &inst, Module &module) -> Value * {
+  auto rhs = inst.operands[1];
+  if (inst.binop != BinOp::Mul || !rhs->isInt() || rhs->imm <= 1 ||
+      !std::has_single_bit(static_cast<unsigned>(rhs->imm))) {
+    return nullptr;
+  }
+  auto shift = std::countr_zero(static_cast<unsigned>(rhs->imm));
+  return rewrite(inst, BinOp::Shl, inst.operands[0], module.getInt(shift));
+}
+
+/**
+ * @brief Tests of values that are already 0 or 1: `ne %b, 0` is `%b`, and
+ * `eq (lt %x, %y), 0` is `ge %x, %y`.
+ */
+auto simplifyBoolean(Value &inst, Module &) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  if (!rhs->isInt(0) && !rhs->isInt(1)) {
+    return nullptr;
+  }
+  bool test = inst.binop == BinOp::Ne || inst.binop == BinOp::Eq;
+  // whether the result is `lhs` itself rather than its negation
+  bool same = (inst.binop == BinOp::Ne) == rhs->isInt(0);
+  if (test && isBool(lhs)) {
+    if (same) {
+      return lhs;
+    }
+    if (lhs->op == Op::Binary && isComparison(lhs->binop)) {
+      return rewrite(inst, inverted(lhs->binop), lhs->operands[0],
+                     lhs->operands[1]);
+    }
+    return nullptr;
+  }
+  if (inst.binop == BinOp::And && rhs->isInt(1) && isBool(lhs)) {
+    return lhs;
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Tests against zero of a difference: `eq (sub %x, %y), 0` is
+ * `eq %x, %y`, which holds for `xor` as well and survives wrap-around.
+ */
+auto compareDifference(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  if ((inst.binop != BinOp::Eq && inst.binop != BinOp::Ne) || !rhs->isInt()) {
+    return nullptr;
+  }
+  if (rhs->imm == 0 &&
+      (isBinary(lhs, BinOp::Sub) || isBinary(lhs, BinOp::Xor))) {
+    return rewrite(inst, inst.binop, lhs->operands[0], lhs->operands[1]);
+  }
+  // x + c1 == c2 is x == c2 - c1
+  if (isBinary(lhs, BinOp::Add) && lhs->operands[1]->isInt()) {
+    int res = 0;
+    foldBinary(BinOp::Sub, rhs->imm, lhs->operands[1]->imm, res);
+    return rewrite(inst, inst.binop, lhs->operands[0], module.getInt(res));
+  }
+  return nullptr;
+}
+
+/**
+ * @brief `le %x, 9` is `lt %x, 10`, `ge %x, 0` is `gt %x, -1`, and
+ * comparisons against the ends of the `i32` range are decided.
+ */
+auto canonicalizeComparison(Value &inst, Module &module) -> Value * {
+  auto lhs = inst.operands[0];
+  auto rhs = inst.operands[1];
+  if (!rhs->isInt()) {
+    return nullptr;
+  }
+  switch (inst.binop) {
+  case BinOp::Le:
+    if (rhs->imm == INT32_MAX) {
+      return module.getInt(1);
+    }
+    return rewrite(inst, BinOp::Lt, lhs, module.getInt(rhs->imm + 1));
+  case BinOp::Ge:
+    if (rhs->imm == INT32_MIN) {
+      return module.getInt(1);
+    }
+    return rewrite(inst, BinOp::Gt, lhs, module.getInt(rhs->imm - 1));
+  case BinOp::Lt: return rhs->imm == INT32_MIN ? module.getInt(0) : nullptr;
+  case BinOp::Gt: return rhs->imm == INT32_MAX ? module.getInt(0) : nullptr;
+  default: return nullptr;
+  }
+}
+
+/**
+ * @brief The rules, tried in order on every instruction.
+ *
+ * Folding and canonicalization come first so that the later rules only have
+ * to match constants on the right.
+ */
+constexpr std::array<Rule, 11> Rules{
+    foldConstants,      moveConstantRight,    addNegatedConstant,
+    rightIdentity,      sameOperands,         foldNegation,
+    reassociate,        multiplyByPowerOfTwo, simplifyBoolean,
+    compareDifference,  canonicalizeComparison,
+};
+
+} // namespace
+
+auto opt::combineInstructions(Function &func) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  auto module = func.parent;
+  auto users = collectUsers(func);
+
+  std::vector<Value *> worklist;
+  std::unordered_set<Value *> queued;
+  // replaced instructions, erased once the worklist is empty
+  std::unordered_set<Value *> dead;
+  auto push = [&](Value *val) {
+    if (val->op == Op::Binary && !dead.contains(val) &&
+        queued.insert(val).second) {
+      worklist.push_back(val);
+    }
+  };
+  // popped from the back, so definitions come before their uses
+  auto order = reversePostOrder(func);
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    for (auto inst = (*it)->insts.rbegin(); inst != (*it)->insts.rend();
+         ++inst) {
+      push(inst->get());
+    }
+  }
+
+  bool changed = false;
+  while (!worklist.empty()) {
+    auto inst = worklist.back();
+    worklist.pop_back();
+    queued.erase(inst);
+
+    Value *res = nullptr;
+    for (auto rule : Rules) {
+      if ((res = rule(*inst, *module))) {
+        break;
+      }
+    }
+    if (!res) {
+      continue;
+    }
+    changed = true;
+
+    if (res == inst) {
+      for (auto use : inst->operands) {
+        users[use].push_back(inst);
+      }
+      push(inst);
+      for (auto user : users[inst]) {
+        push(user);
+      }
+      continue;
+    }
+    auto moved = std::move(users[inst]);
+    users.erase(inst);
+    for (auto user : moved) {
+      user->forEachUse([&](Value *&use) {
+        if (use == inst) {
+          use = res;
+        }
+      });
+      users[res].push_back(user);
+      push(user);
+    }
+    dead.insert(inst);
+  }
+
+  for (auto inst : dead) {
+    inst->parent->erase(inst);
+  }
+  return changed;
+}
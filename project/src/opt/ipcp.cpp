@@ -0,0 +1,428 @@
+/**
+ * @file ipcp.cpp
+ * @brief Interprocedural constant propagation and function specialization.
+ *
+ * ### Parameter Slots
+ * The front end copies every parameter into an `alloc` on entry and reads
+ * it back with `load`s. When that copy is the only store to the slot and
+ * the slot's address never escapes, each load yields the parameter, so a
+ * constant parameter also replaces the loads and `call`s passing such a
+ * load forward the parameter itself.
+ *
+ * ### Propagation
+ * Parameters start unknown and are lowered to a constant or to "varying"
+ * by meeting the arguments of all call sites until nothing changes. An
+ * argument forwarding the callee's own parameter (recursion) adds no
+ * information, and one forwarding a caller parameter contributes that
+ * parameter's state. Constant parameters are substituted into the body,
+ * which is then constant folded.
+ *
+ * ### Specialization
+ * A call passing constants the callee cannot assume in general gets a clone
+ * with those constants substituted if the call is hot: it sits in a loop,
+ * or the callee is recursive and passes the constants on to itself, so the
+ * whole recursion runs in the clone. Calls with the same constants share a
+ * clone, and all clones together add at most `specializeBudget`
+ * instructions.
+ */
+
+module;
+
+#include <algorithm>
+#include <fmt/core.h>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Maps the parameter slots of `func` to the parameter they hold.
+ */
+auto findParamSlots(const Function &func)
+    -> std::unordered_map<const Value *, Value *> {
+  std::unordered_map<const Value *, Value *> slots;
+  std::unordered_set<const Value *> rejected;
+  for (const auto &bb : func.blocks) {
+    for (const auto &inst : bb->insts) {
+      if (inst->op == Op::Load) {
+        // a read before the copy in the entry block sees garbage
+        auto src = inst->operands[0];
+        if (bb.get() == func.entry() && !slots.contains(src)) {
+          rejected.insert(src);
+        }
+        continue;
+      }
+      if (inst->op == Op::Store) {
+        auto [val, dest] = std::pair(inst->operands[0], inst->operands[1]);
+        if (dest->op == Op::Alloc &&
+            (val->op != Op::FuncArg || bb.get() != func.entry() ||
+             !slots.try_emplace(dest, val).second)) {
+          rejected.insert(dest);
+        }
+        rejected.insert(val);
+        continue;
+      }
+      for (auto use : inst->operands) {
+        rejected.insert(use);
+      }
+    }
+  }
+  std::erase_if(slots, [&](const auto &slot) {
+    return rejected.contains(slot.first);
+  });
+  return slots;
+}
+
+/**
+ * @brief The parameter `val` reloads from its slot, or `val` itself.
+ */
+auto forwarded(const std::unordered_map<const Value *, Value *> &slots,
+               Value *val) -> Value * {
+  if (val->op == Op::Load) {
+    if (auto it = slots.find(val->operands[0]); it != slots.end()) {
+      return it->second;
+    }
+  }
+  return val;
+}
+
+/**
+ * @brief Folds `Binary` instructions whose operands are constants, in
+ * dependency order. Folded instructions are left for DCE.
+ */
+auto foldConstants(Function &func) -> void {
+  auto module = func.parent;
+  std::unordered_map<Value *, Value *> folded;
+  for (auto bb : reversePostOrder(func)) {
+    for (auto &inst : bb->insts) {
+      inst->forEachUse([&](Value *&use) {
+        if (auto it = folded.find(use); it != folded.end()) {
+          use = it->second;
+        }
+      });
+      int res = 0;
+      if (inst->op == Op::Binary && inst->operands[0]->isInt() &&
+          inst->operands[1]->isInt() &&
+          foldBinary(inst->binop, inst->operands[0]->imm,
+                     inst->operands[1]->imm, res)) {
+        folded[inst.get()] = module->getInt(res);
+      }
+    }
+  }
+  replaceAllUses(func, folded);
+}
+
+/**
+ * @brief Replaces parameters by constants, including the loads of their
+ * slots. `consts` holds an integer or nullptr per parameter.
+ *
+ * @return true if a parameter was in use.
+ */
+auto substitute(Function &func, const std::vector<Value *> &consts) -> bool {
+  auto slots = findParamSlots(func);
+  std::unordered_map<Value *, Value *> mapping;
+  for (size_t i = 0; i < consts.size(); ++i) {
+    if (consts[i]) {
+      mapping[func.params[i].get()] = consts[i];
+    }
+  }
+  for (auto &bb : func.blocks) {
+    for (auto &inst : bb->insts) {
+      if (auto param = forwarded(slots, inst.get()); mapping.contains(param)) {
+        mapping[inst.get()] = mapping.at(param);
+      }
+    }
+  }
+
+  auto users = collectUsers(func);
+  bool used = false;
+  for (const auto &[from, to] : mapping) {
+    used |= users.contains(from);
+  }
+  if (used) {
+    replaceAllUses(func, mapping);
+    foldConstants(func);
+  }
+  return used;
+}
+
+class ConstantPropagation {
+public:
+  explicit ConstantPropagation(Module &_module) : module(_module) {
+    for (auto &func : module.funcs) {
+      if (func->isDecl()) {
+        continue;
+      }
+      slots[func.get()] = findParamSlots(*func);
+      for (auto &bb : func->blocks) {
+        for (auto &inst : bb->insts) {
+          if (inst->op == Op::Call && !inst->callee->isDecl()) {
+            sites.emplace_back(func.get(), inst.get());
+          }
+        }
+      }
+    }
+  }
+
+  auto run() -> bool {
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto [caller, call] : sites) {
+        for (size_t i = 0; i < call->operands.size(); ++i) {
+          changed |= meet(call->callee->params[i].get(),
+                          forwarded(slots.at(caller), call->operands[i]));
+        }
+      }
+    }
+
+    bool changed = false;
+    for (auto &func : module.funcs) {
+      std::vector<Value *> consts;
+      for (auto &param : func->params) {
+        auto it = state.find(param.get());
+        consts.push_back(it == state.end() ? nullptr : it->second);
+      }
+      if (!func->isDecl()) {
+        changed |= substitute(*func, consts);
+      }
+    }
+    return changed;
+  }
+
+private:
+  Module &module;
+  std::vector<std::pair<Function *, Value *>> sites;
+  std::unordered_map<const Function *,
+                     std::unordered_map<const Value *, Value *>>
+      slots;
+  /// Absent: unknown, nullptr: varying, otherwise the constant.
+  std::unordered_map<const Value *, Value *> state;
+
+  /**
+   * @brief Lowers the state of `param` by an incoming argument.
+   * @return true if the state changed.
+   */
+  auto meet(Value *param, Value *arg) -> bool {
+    if (arg == param) {
+      return false;
+    }
+    if (arg->op == Op::FuncArg) {
+      auto it = state.find(arg);
+      if (it == state.end()) {
+        return false;
+      }
+      arg = it->second;
+    }
+    auto value = arg && arg->isInt() ? arg : nullptr;
+    auto [it, inserted] = state.try_emplace(param, value);
+    if (inserted || it->second == value || !it->second) {
+      return inserted;
+    }
+    it->second = nullptr;
+    return true;
+  }
+};
+
+class Specializer {
+public:
+  Specializer(Module &_module, const Options &_options)
+      : module(_module), options(_options), graph(_module),
+        budget(_options.specializeBudget) {}
+
+  auto run() -> bool {
+    std::vector<Function *> funcs;
+    for (auto &func : module.funcs) {
+      if (!func->isDecl()) {
+        funcs.push_back(func.get());
+      }
+    }
+    bool changed = false;
+    for (auto func : funcs) {
+      DominatorTree domTree(*func);
+      LoopInfo loops(*func, domTree);
+      for (auto &bb : func->blocks) {
+        for (auto &inst : bb->insts) {
+          if (inst->op == Op::Call && inst->callee != func &&
+              !inst->callee->isDecl()) {
+            changed |= specialize(inst.get(), loops.loopFor(bb.get()));
+          }
+        }
+      }
+    }
+    return changed;
+  }
+
+private:
+  using Key = std::pair<const Function *, std::vector<Value *>>;
+
+  Module &module;
+  const Options &options;
+  CallGraph graph;
+  int budget;
+  std::map<Key, Function *> clones;
+
+  auto remark(std::string_view msg) const -> void {
+    if (options.wantsRemarks("specialize")) {
+      fmt::print(stderr, "remark: {}\n", msg);
+    }
+  }
+
+  auto specialize(Value *call, const Loop *loop) -> bool {
+    auto callee = call->callee;
+    auto users = collectUsers(*callee);
+    std::vector<Value *> consts;
+    bool any = false;
+    for (size_t i = 0; i < call->operands.size(); ++i) {
+      auto arg = call->operands[i];
+      bool useful = arg->isInt() && users.contains(callee->params[i].get());
+      consts.push_back(useful ? arg : nullptr);
+      any |= useful;
+    }
+    if (!any || (!loop && !recursesWith(*callee, consts))) {
+      return false;
+    }
+
+    Key key{callee, consts};
+    if (auto it = clones.find(key); it != clones.end()) {
+      call->callee = it->second;
+      return true;
+    }
+    int size = static_cast<int>(callee->instCount());
+    if (size > budget) {
+      remark(fmt::format("not specializing {}: {} instructions exceed the "
+                         "remaining budget {}",
+                         callee->name, size, budget));
+      return false;
+    }
+    budget -= size;
+    auto clone = cloneFunction(*callee, consts);
+    remark(fmt::format("specialized {} as {}", callee->name, clone->name));
+    clones.emplace(std::move(key), clone);
+    call->callee = clone;
+    return true;
+  }
+
+  /**
+   * @brief Whether `func` calls itself passing `consts` on unchanged.
+   */
+  auto recursesWith(const Function &func, const std::vector<Value *> &consts)
+      -> bool {
+    if (!graph.isRecursive(&func)) {
+      return false;
+    }
+    auto slots = findParamSlots(func);
+    for (const auto &bb : func.blocks) {
+      for (const auto &inst : bb->insts) {
+        if (inst->op == Op::Call && inst->callee == &func &&
+            passesOn(*inst, consts, [&](Value *arg, size_t i) {
+              return forwarded(slots, arg) == func.params[i].get();
+            })) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  template <typename F>
+  static auto passesOn(const Value &call, const std::vector<Value *> &consts,
+                       F &&same) -> bool {
+    for (size_t i = 0; i < consts.size(); ++i) {
+      if (consts[i] && call.operands[i] != consts[i] &&
+          !same(call.operands[i], i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  auto cloneFunction(Function &func, const std::vector<Value *> &consts)
+      -> Function * {
+    std::string name;
+    for (int n = 0; name.empty() || module.findFunc(name); ++n) {
+      name = fmt::format("{}_spec{}", func.name, n);
+    }
+    auto clone = std::make_unique<Function>(name, func.retTy);
+    clone->parent = &module;
+    clone->count_label = func.count_label;
+
+    std::unordered_map<const Value *, Value *> values;
+    std::unordered_map<const BasicBlock *, BasicBlock *> blocks;
+    for (const auto &param : func.params) {
+      auto arg = std::make_unique<Value>(Op::FuncArg, param->ty);
+      arg->name = param->name;
+      arg->imm = param->imm;
+      values[param.get()] = arg.get();
+      clone->params.push_back(std::move(arg));
+    }
+    for (const auto &bb : func.blocks) {
+      auto &copy = clone->blocks.emplace_back(
+          std::make_unique<BasicBlock>(bb->name));
+      copy->parent = clone.get();
+      for (const auto &param : bb->params) {
+        values[param.get()] = copy->addParam(param->ty);
+      }
+      blocks[bb.get()] = copy.get();
+    }
+    for (const auto &bb : func.blocks) {
+      auto copy = blocks.at(bb.get());
+      for (const auto &inst : bb->insts) {
+        values[inst.get()] = copy->append(cloneInst(*inst));
+      }
+    }
+    for (auto &bb : clone->blocks) {
+      for (auto &inst : bb->insts) {
+        inst->forEachUse([&](Value *&use) {
+          if (auto it = values.find(use); it != values.end()) {
+            use = it->second;
+          }
+        });
+        for (auto &edge : inst->edges) {
+          edge.target = blocks.at(edge.target);
+        }
+      }
+    }
+
+    // recursion passing the same constants stays in the clone
+    substitute(*clone, consts);
+    for (auto &bb : clone->blocks) {
+      for (auto &inst : bb->insts) {
+        if (inst->op == Op::Call && inst->callee == &func &&
+            passesOn(*inst, consts,
+                     [](Value *, size_t) { return false; })) {
+          inst->callee = clone.get();
+        }
+      }
+    }
+
+    auto res = clone.get();
+    auto pos = std::ranges::find_if(
+        module.funcs, [&](const auto &other) { return other.get() == &func; });
+    module.funcs.insert(std::next(pos), std::move(clone));
+    return res;
+  }
+};
+
+} // namespace
+
+auto opt::propagateConstantArgs(Module &module) -> bool {
+  return ConstantPropagation(module).run();
+}
+
+auto opt::specializeFunctions(Module &module, const Options &options) -> bool {
+  return Specializer(module, options).run();
+}
@@ -0,0 +1,559 @@
+/**
+ * @file ir.cpp
+ * @brief Construction helpers, utilities and the Koopa printer of the
+ * optimizer IR.
+ */
+
+module;
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <fmt/core.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.ir;
+
+import ir.type;
+import log;
+
+using namespace opt;
+
+auto Function::newBlock(std::string_view prefix, BasicBlock *before)
+    -> BasicBlock * {
+  auto bb =
+      std::make_unique<BasicBlock>(fmt::format("%{}_opt{}", prefix, count_label++));
+  bb->parent = this;
+  auto pos = before ? find(before) : blocks.end();
+  return blocks.insert(pos, std::move(bb))->get();
+}
+
+auto Function::eraseBlock(BasicBlock *bb) -> void { blocks.erase(find(bb)); }
+
+auto Function::find(const BasicBlock *bb) -> iterator {
+  for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+    if (it->get() == bb) {
+      return it;
+    }
+  }
+  return blocks.end();
+}
+
+auto Function::preds() const
+    -> std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> {
+  std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> res;
+  for (const auto &bb : blocks) {
+    res[bb.get()];
+    for (auto succ : bb->succs()) {
+      res[succ].push_back(bb.get());
+    }
+  }
+  return res;
+}
+
+auto Function::instCount() const -> size_t {
+  size_t cnt = 0;
+  for (const auto &bb : blocks) {
+    cnt += bb->insts.size();
+  }
+  return cnt;
+}
+
+auto Module::getInt(int val) -> Value * {
+  auto &slot = ints[val];
+  if (!slot) {
+    slot = std::make_unique<Value>(Op::Integer, type::IntType::get());
+    slot->imm = val;
+  }
+  return slot.get();
+}
+
+auto Module::getZeroInit(std::shared_ptr<type::Type> ty) -> Value * {
+  consts.push_back(std::make_unique<Value>(Op::ZeroInit, std::move(ty)));
+  return consts.back().get();
+}
+
+auto Module::getUndef(std::shared_ptr<type::Type> ty) -> Value * {
+  consts.push_back(std::make_unique<Value>(Op::Undef, std::move(ty)));
+  return consts.back().get();
+}
+
+auto Module::getAggregate(std::shared_ptr<type::Type> ty,
+                          std::vector<Value *> elems) -> Value * {
+  consts.push_back(
+      std::make_unique<Value>(Op::Aggregate, std::move(ty), std::move(elems)));
+  return consts.back().get();
+}
+
+auto Module::findFunc(std::string_view name) const -> Function * {
+  for (const auto &func : funcs) {
+    if (func->name == name) {
+      return func.get();
+    }
+  }
+  return nullptr;
+}
+
+auto Module::instCount() const -> size_t {
+  size_t cnt = 0;
+  for (const auto &func : funcs) {
+    cnt += func->instCount();
+  }
+  return cnt;
+}
+
+auto opt::sameType(const std::shared_ptr<type::Type> &a,
+                   const std::shared_ptr<type::Type> &b) -> bool {
+  return a == b || a->toKoopa() == b->toKoopa();
+}
+
+auto opt::pointee(const std::shared_ptr<type::Type> &ty)
+    -> std::shared_ptr<type::Type> {
+  auto ptr = std::dynamic_pointer_cast<type::PtrType>(ty);
+  assert(ptr && "pointee of a non-pointer type");
+  return ptr->target;
+}
+
+auto opt::sizeOf(const std::shared_ptr<type::Type> &ty) -> int {
+  if (auto arr = std::dynamic_pointer_cast<type::ArrayType>(ty)) {
+    return arr->len * sizeOf(arr->base);
+  }
+  return ty->is_void() ? 0 : 4;
+}
+
+auto opt::makeAlloc(std::shared_ptr<type::Type> ty, std::string name)
+    -> std::unique_ptr<Value> {
+  auto inst = std::make_unique<Value>(Op::Alloc, type::PtrType::get(ty));
+  inst->name = std::move(name);
+  return inst;
+}
+
+auto opt::makeLoad(Value *src) -> std::unique_ptr<Value> {
+  return std::make_unique<Value>(Op::Load, pointee(src->ty),
+                                 std::vector<Value *>{src});
+}
+
+auto opt::makeStore(Value *val, Value *dest) -> std::unique_ptr<Value> {
+  return std::make_unique<Value>(Op::Store, type::VoidType::get(),
+                                 std::vector<Value *>{val, dest});
+}
+
+auto opt::makeGetPtr(Value *src, Value *index) -> std::unique_ptr<Value> {
+  return std::make_unique<Value>(Op::GetPtr, src->ty,
+                                 std::vector<Value *>{src, index});
+}
+
+auto opt::makeGetElemPtr(Value *src, Value *index) -> std::unique_ptr<Value> {
+  auto arr = std::dynamic_pointer_cast<type::ArrayType>(pointee(src->ty));
+  assert(arr && "getelemptr on a non-array pointer");
+  return std::make_unique<Value>(Op::GetElemPtr,
+                                 type::PtrType::get(arr->base),
+                                 std::vector<Value *>{src, index});
+}
+
+auto opt::makeBinary(BinOp op, Value *lhs, Value *rhs)
+    -> std::unique_ptr<Value> {
+  auto inst = std::make_unique<Value>(Op::Binary, type::IntType::get(),
+                                      std::vector<Value *>{lhs, rhs});
+  inst->binop = op;
+  return inst;
+}
+
+auto opt::makeCall(Function *callee, std::vector<Value *> args)
+    -> std::unique_ptr<Value> {
+  auto inst = std::make_unique<Value>(Op::Call, callee->retTy, std::move(args));
+  inst->callee = callee;
+  return inst;
+}
+
+auto opt::makeBranch(Value *cond, BasicBlock *t, BasicBlock *f)
+    -> std::unique_ptr<Value> {
+  auto inst = std::make_unique<Value>(Op::Branch, type::VoidType::get(),
+                                      std::vector<Value *>{cond});
+  inst->edges = {Edge{t, {}}, Edge{f, {}}};
+  return inst;
+}
+
+auto opt::makeJump(BasicBlock *target, std::vector<Value *> args)
+    -> std::unique_ptr<Value> {
+  auto inst = std::make_unique<Value>(Op::Jump, type::VoidType::get());
+  inst->edges = {Edge{target, std::move(args)}};
+  return inst;
+}
+
+auto opt::makeReturn(Value *val) -> std::unique_ptr<Value> {
+  auto inst = std::make_unique<Value>(Op::Return, type::VoidType::get());
+  if (val) {
+    inst->operands.push_back(val);
+  }
+  return inst;
+}
+
+auto opt::cloneInst(const Value &inst) -> std::unique_ptr<Value> {
+  auto copy = std::make_unique<Value>(inst.op, inst.ty, inst.operands);
+  copy->name = inst.name;
+  copy->edges = inst.edges;
+  copy->callee = inst.callee;
+  copy->binop = inst.binop;
+  copy->imm = inst.imm;
+  return copy;
+}
+
+auto opt::replaceAllUses(Function &func, Value *from, Value *to) -> void {
+  replaceAllUses(func, {{from, to}});
+}
+
+auto opt::replaceAllUses(Function &func,
+                         const std::unordered_map<Value *, Value *> &mapping)
+    -> void {
+  if (mapping.empty()) {
+    return;
+  }
+  for (auto &bb : func.blocks) {
+    for (auto &inst : bb->insts) {
+      inst->forEachUse([&](Value *&use) {
+        // follow chains such as a -> b, b -> c
+        for (auto it = mapping.find(use); it != mapping.end();
+             it = mapping.find(use)) {
+          use = it->second;
+        }
+      });
+    }
+  }
+}
+
+auto opt::collectUsers(Function &func)
+    -> std::unordered_map<Value *, std::vector<Value *>> {
+  std::unordered_map<Value *, std::vector<Value *>> users;
+  for (auto &bb : func.blocks) {
+    for (auto &inst : bb->insts) {
+      inst->forEachUse([&](Value *use) { users[use].push_back(inst.get()); });
+    }
+  }
+  return users;
+}
+
+auto opt::reversePostOrder(const Function &func) -> std::vector<BasicBlock *> {
+  std::vector<BasicBlock *> order;
+  if (func.isDecl()) {
+    return order;
+  }
+
+  // Successors are visited last-to-first so that the "true" side of a branch
+  // is laid out first, which keeps the natural then/else and loop body order.
+  std::unordered_set<BasicBlock *> visited;
+  std::vector<std::pair<BasicBlock *, std::vector<BasicBlock *>>> stk;
+  auto push = [&](BasicBlock *bb) {
+    visited.insert(bb);
+    stk.emplace_back(bb, bb->succs());
+  };
+
+  push(func.entry());
+  while (!stk.empty()) {
+    auto &[bb, succs] = stk.back();
+    if (succs.empty()) {
+      order.push_back(bb);
+      stk.pop_back();
+      continue;
+    }
+    auto nxt = succs.back();
+    succs.pop_back();
+    if (!visited.contains(nxt)) {
+      push(nxt);
+    }
+  }
+
+  std::ranges::reverse(order);
+  return order;
+}
+
+auto opt::foldBinary(BinOp op, int lhs, int rhs, int &res) -> bool {
+  // compute in unsigned to get wrap-around semantics without UB
+  auto ul = static_cast<uint32_t>(lhs);
+  auto ur = static_cast<uint32_t>(rhs);
+  // clang-format off
+  switch (op) {
+  case BinOp::Ne:  res = lhs != rhs; break;
+  case BinOp::Eq:  res = lhs == rhs; break;
+  case BinOp::Gt:  res = lhs > rhs;  break;
+  case BinOp::Lt:  res = lhs < rhs;  break;
+  case BinOp::Ge:  res = lhs >= rhs; break;
+  case BinOp::Le:  res = lhs <= rhs; break;
+  case BinOp::Add: res = static_cast<int>(ul + ur); break;
+  case BinOp::Sub: res = static_cast<int>(ul - ur); break;
+  case BinOp::Mul: res = static_cast<int>(ul * ur); break;
+  case BinOp::Div:
+    if (rhs == 0) return false;
+    res = (lhs == INT32_MIN && rhs == -1) ? lhs : lhs / rhs;
+    break;
+  case BinOp::Mod:
+    if (rhs == 0) return false;
+    res = (lhs == INT32_MIN && rhs == -1) ? 0 : lhs % rhs;
+    break;
+  case BinOp::And: res = static_cast<int>(ul & ur); break;
+  case BinOp::Or:  res = static_cast<int>(ul | ur); break;
+  case BinOp::Xor: res = static_cast<int>(ul ^ ur); break;
+  case BinOp::Shl: res = static_cast<int>(ul << (ur & 31)); break;
+  case BinOp::Shr: res = static_cast<int>(ul >> (ur & 31)); break;
+  case BinOp::Sar: res = lhs >> (rhs & 31); break;
+  }
+  // clang-format on
+  return true;
+}
+
+auto opt::binOpName(BinOp op) -> std::string_view {
+  // clang-format off
+  switch (op) {
+  case BinOp::Ne:  return "ne";
+  case BinOp::Eq:  return "eq";
+  case BinOp::Gt:  return "gt";
+  case BinOp::Lt:  return "lt";
+  case BinOp::Ge:  return "ge";
+  case BinOp::Le:  return "le";
+  case BinOp::Add: return "add";
+  case BinOp::Sub: return "sub";
+  case BinOp::Mul: return "mul";
+  case BinOp::Div: return "div";
+  case BinOp::Mod: return "mod";
+  case BinOp::And: return "and";
+  case BinOp::Or:  return "or";
+  case BinOp::Xor: return "xor";
+  case BinOp::Shl: return "shl";
+  case BinOp::Shr: return "shr";
+  case BinOp::Sar: return "sar";
+  }
+  // clang-format on
+  return "?";
+}
+
+namespace {
+
+/**
+ * @brief Assigns printable, unique names to the symbols of one function.
+ *
+ * Named allocations and labels keep their front-end names (deduplicated,
+ * since passes may clone them); everything else is renumbered `%0, %1, ...`.
+ */
+class NameTable {
+public:
+  explicit NameTable(std::set<std::string> _taken) : taken(std::move(_taken)) {}
+
+  auto unique(std::string base) -> std::string {
+    std::string res = base;
+    for (int k = 1; taken.contains(res); ++k) {
+      res = fmt::format("{}_{}", base, k);
+    }
+    taken.insert(res);
+    return res;
+  }
+
+  auto name(const Value *val) -> std::string {
+    switch (val->op) {
+    case Op::Integer: return std::to_string(val->imm);
+    case Op::ZeroInit: return "zeroinit";
+    case Op::Undef: return "undef";
+    case Op::Aggregate: {
+      std::string res = "{";
+      for (size_t i = 0; i < val->operands.size(); ++i) {
+        res += (i ? ", " : "") + name(val->operands[i]);
+      }
+      return res + "}";
+    }
+    default: break;
+    }
+    if (auto it = names.find(val); it != names.end()) {
+      return it->second;
+    }
+    return val->name;
+  }
+
+  auto assign(const Value *val) -> void {
+    if (val->op == Op::Alloc && val->name.starts_with("@")) {
+      names[val] = unique(val->name);
+    } else {
+      names[val] = unique(fmt::format("%{}", count_reg++));
+    }
+  }
+
+  auto assign(const BasicBlock *bb) -> void {
+    names[bb] = unique(bb->name.empty() ? std::string("%bb") : bb->name);
+  }
+
+  auto label(const BasicBlock *bb) -> const std::string & { return names[bb]; }
+
+private:
+  std::set<std::string> taken;
+  std::unordered_map<const void *, std::string> names;
+  int count_reg = 0;
+};
+
+auto printType(const std::shared_ptr<type::Type> &ty) -> std::string {
+  return ty->toKoopa();
+}
+
+auto printFunction(const Function &func, std::set<std::string> taken)
+    -> std::string {
+  std::string buffer;
+  buffer += fmt::format("{} {}(", func.isDecl() ? "decl" : "fun", func.name);
+  for (size_t i = 0; i < func.params.size(); ++i) {
+    const auto &param = func.params[i];
+    buffer += i ? ", " : "";
+    if (func.isDecl()) {
+      buffer += printType(param->ty);
+    } else {
+      buffer += fmt::format("{}: {}", param->name, printType(param->ty));
+      taken.insert(param->name);
+    }
+  }
+  buffer += ")";
+  if (!func.retTy->is_void()) {
+    buffer += fmt::format(": {}", printType(func.retTy));
+  }
+  if (func.isDecl()) {
+    return buffer + "\n";
+  }
+  buffer += " {\n";
+
+  // reachable blocks in layout order first, unreachable leftovers after
+  auto order = reversePostOrder(func);
+  std::unordered_set<BasicBlock *> placed(order.begin(), order.end());
+  for (const auto &bb : func.blocks) {
+    if (!placed.contains(bb.get())) {
+      order.push_back(bb.get());
+    }
+  }
+
+  NameTable table(std::move(taken));
+  for (auto bb : order) {
+    table.assign(bb);
+  }
+  for (auto bb : order) {
+    for (const auto &param : bb->params) {
+      table.assign(param.get());
+    }
+    for (const auto &inst : bb->insts) {
+      if (!inst->ty->is_void()) {
+        table.assign(inst.get());
+      }
+    }
+  }
+
+  auto printEdge = [&](const Edge &edge) {
+    std::string res = table.label(edge.target);
+    if (!edge.args.empty()) {
+      res += "(";
+      for (size_t i = 0; i < edge.args.size(); ++i) {
+        res += (i ? ", " : "") + table.name(edge.args[i]);
+      }
+      res += ")";
+    }
+    return res;
+  };
+
+  for (auto bb : order) {
+    buffer += table.label(bb);
+    if (!bb->params.empty()) {
+      buffer += "(";
+      for (size_t i = 0; i < bb->params.size(); ++i) {
+        buffer += fmt::format("{}{}: {}", i ? ", " : "",
+                              table.name(bb->params[i].get()),
+                              printType(bb->params[i]->ty));
+      }
+      buffer += ")";
+    }
+    buffer += ":\n";
+
+    for (const auto &inst : bb->insts) {
+      const auto &ops = inst->operands;
+      std::string lhs = inst->ty->is_void()
+                            ? ""
+                            : fmt::format("{} = ", table.name(inst.get()));
+      std::string body;
+      switch (inst->op) {
+      case Op::Alloc: body = "alloc " + printType(pointee(inst->ty)); break;
+      case Op::Load: body = "load " + table.name(ops[0]); break;
+      case Op::Store:
+        body = fmt::format("store {}, {}", table.name(ops[0]),
+                           table.name(ops[1]));
+        break;
+      case Op::GetPtr:
+        body = fmt::format("getptr {}, {}", table.name(ops[0]),
+                           table.name(ops[1]));
+        break;
+      case Op::GetElemPtr:
+        body = fmt::format("getelemptr {}, {}", table.name(ops[0]),
+                           table.name(ops[1]));
+        break;
+      case Op::Binary:
+        body = fmt::format("{} {}, {}", binOpName(inst->binop),
+                           table.name(ops[0]), table.name(ops[1]));
+        break;
+      case Op::Call: {
+        body = fmt::format("call {}(", inst->callee->name);
+        for (size_t i = 0; i < ops.size(); ++i) {
+          body += (i ? ", " : "") + table.name(ops[i]);
+        }
+        body += ")";
+        break;
+      }
+      case Op::Branch:
+        body = fmt::format("br {}, {}, {}", table.name(ops[0]),
+                           printEdge(inst->edges[0]),
+                           printEdge(inst->edges[1]));
+        break;
+      case Op::Jump: body = "jump " + printEdge(inst->edges[0]); break;
+      case Op::Return:
+        body = ops.empty() ? "ret" : "ret " + table.name(ops[0]);
+        break;
+      default:
+        Log::panic(fmt::format(
+            "Optimizer Error: value kind {} in instruction position",
+            static_cast<int>(inst->op)));
+      }
+      buffer += fmt::format("  {}{}\n", lhs, body);
+    }
+  }
+
+  buffer += "}\n";
+  return buffer;
+}
+
+} // namespace
+
+auto Module::toKoopa() const -> std::string {
+  std::string buffer;
+  std::set<std::string> taken;
+  NameTable globalNames({});
+
+  for (const auto &func : funcs) {
+    taken.insert(func->name);
+  }
+  for (const auto &global : globals) {
+    taken.insert(global->name);
+  }
+
+  for (const auto &func : funcs) {
+    if (func->isDecl()) {
+      buffer += printFunction(*func, taken);
+    }
+  }
+  buffer += "\n";
+
+  for (const auto &global : globals) {
+    buffer += fmt::format("global {} = alloc {}, {}\n", global->name,
+                          printType(pointee(global->ty)),
+                          globalNames.name(global->operands[0]));
+  }
+
+  for (const auto &func : funcs) {
+    if (!func->isDecl()) {
+      buffer += "\n" + printFunction(*func, taken);
+    }
+  }
+  return buffer;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file licm.cpp
+ * @brief Loop-invariant code motion.
+ *
+ * Every loop first gets a preheader: a block outside the loop whose only
+ * successor is the header, giving hoisted code a place to live. Loops are
+ * then visited innermost first, so code hoisted out of an inner loop lands
+ * in a block of the outer loop and may be hoisted again.
+ *
+ * An instruction is moved to the preheader when all of its operands are
+ * defined outside the loop and executing it early is harmless:
+ * - Arithmetic and address computations are pure; `div` / `mod` only if
+ *   the divisor is a constant that cannot trap.
+ * - A `load` additionally needs an address that no store or call inside the
+ *   loop may write (as told by `AliasAnalysis`), and must either execute on
+ *   every trip through the loop or read from an address that is always
+ *   valid.
+ * - A `call` must execute on every trip; the callee must be pure, or
+ *   read-only in a loop that writes no memory at all.
+ *
+ * Calls to functions that do not write memory (see `SideEffectInfo`) do not
+ * count as clobbers.
+ */
+
+module;
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+import ir.type;
+
+using namespace opt;
+
+auto opt::getOrInsertPreheader(Function &func, const Loop &loop)
+    -> BasicBlock * {
+  auto header = loop.header;
+  std::vector<BasicBlock *> outside;
+  for (auto &bb : func.blocks) {
+    if (loop.contains(bb.get())) {
+      continue;
+    }
+    for (auto succ : bb->succs()) {
+      if (succ == header) {
+        outside.push_back(bb.get());
+        break;
+      }
+    }
+  }
+  if (outside.size() == 1 && outside[0]->terminator()->op == Op::Jump) {
+    return outside[0];
+  }
+
+  auto preheader = func.newBlock("preheader", header);
+  std::vector<Value *> args;
+  for (const auto &param : header->params) {
+    args.push_back(preheader->addParam(param->ty));
+  }
+  for (auto bb : outside) {
+    for (auto &edge : bb->terminator()->edges) {
+      if (edge.target == header) {
+        edge.target = preheader;
+      }
+    }
+  }
+  preheader->append(makeJump(header, std::move(args)));
+  return preheader;
+}
+
+namespace {
+
+/**
+ * @brief Whether a load from `ptr` is valid wherever `ptr` is available:
+ * a local or global object, or an in-bounds constant element of one.
+ */
+auto isDereferenceable(Value *ptr) -> bool {
+  if (isIdentifiedObject(ptr)) {
+    return true;
+  }
+  if (ptr->op != Op::GetElemPtr || !ptr->operands[1]->isInt()) {
+    return false;
+  }
+  auto arr =
+      std::dynamic_pointer_cast<type::ArrayType>(pointee(ptr->operands[0]->ty));
+  int index = ptr->operands[1]->imm;
+  return arr && index >= 0 && index < arr->len &&
+         isDereferenceable(ptr->operands[0]);
+}
+
+class LoopInvariantMotion {
+public:
+  LoopInvariantMotion(Function &_func, AnalysisManager &_am,
+                      const SideEffectInfo &_effects)
+      : func(_func), am(_am), effects(_effects) {}
+
+  auto run() -> bool {
+    if (am.loops(func).empty()) {
+      return false;
+    }
+    auto blocks = func.blocks.size();
+    for (auto loop : am.loops(func).postOrder()) {
+      getOrInsertPreheader(func, *loop);
+    }
+    bool changed = func.blocks.size() != blocks;
+    if (changed) {
+      am.invalidate(func);
+    }
+
+    // hoisting keeps the CFG, so these stay valid after the pass
+    aa = std::make_unique<AliasAnalysis>(func);
+    const auto &domTree = am.domTree(func);
+    const auto &loops = am.loops(func);
+    for (auto loop : loops.postOrder()) {
+      changed |= hoist(*loop, domTree);
+    }
+    return changed;
+  }
+
+private:
+  Function &func;
+  AnalysisManager &am;
+  const SideEffectInfo &effects;
+  std::unique_ptr<AliasAnalysis> aa;
+
+  // memory effects of the loop being processed
+  bool hasCall = false;        ///< To a function that may write memory.
+  std::vector<Value *> stores; ///< Addresses stored to.
+
+  /**
+   * @brief Whether a store or call in the loop may write to `ptr`.
+   */
+  auto isClobbered(Value *ptr) -> bool {
+    if (hasCall && !aa->isPrivate(aa->location(ptr).base)) {
+      return true;
+    }
+    return std::ranges::any_of(stores, [&](Value *dest) {
+      return aa->alias(dest, ptr) != AliasResult::NoAlias;
+    });
+  }
+
+  /**
+   * @brief Whether `inst` may be executed in the preheader instead.
+   *
+   * @param guaranteed The instruction runs whenever the loop is entered.
+   */
+  auto canHoist(const Loop &loop, Value *inst, bool guaranteed) -> bool {
+    for (auto use : inst->operands) {
+      if (!loop.isInvariant(use)) {
+        return false;
+      }
+    }
+    switch (inst->op) {
+    case Op::GetPtr:
+    case Op::GetElemPtr: return true;
+    case Op::Binary:
+      if (inst->binop == BinOp::Div || inst->binop == BinOp::Mod) {
+        auto rhs = inst->operands[1];
+        return rhs->isInt() && !rhs->isInt(0) && !rhs->isInt(-1);
+      }
+      return true;
+    case Op::Load: {
+      auto src = inst->operands[0];
+      return !isClobbered(src) && (guaranteed || isDereferenceable(src));
+    }
+    case Op::Call:
+      if (!guaranteed) {
+        return false;
+      }
+      switch (effects.of(inst->callee)) {
+      case Purity::Pure: return true;
+      case Purity::ReadOnly: return !hasCall && stores.empty();
+      default: return false;
+      }
+    default: return false;
+    }
+  }
+
+  auto hoist(const Loop &loop, const DominatorTree &domTree) -> bool {
+    auto preheader = getOrInsertPreheader(func, loop);
+
+    hasCall = false;
+    stores.clear();
+    for (auto bb : loop.blocks) {
+      for (auto &inst : bb->insts) {
+        if (inst->op == Op::Call) {
+          hasCall |= effects.writesMemory(inst->callee);
+        } else if (inst->op == Op::Store) {
+          stores.push_back(inst->operands[1]);
+        }
+      }
+    }
+
+    auto exiting = loop.exitingBlocks();
+    auto pos = std::prev(preheader->insts.end());
+    bool changed = false;
+    for (auto bb : loop.blocks) {
+      bool guaranteed = !exiting.empty() || bb == loop.header;
+      for (auto exit : exiting) {
+        guaranteed &= domTree.dominates(bb, exit);
+      }
+      for (auto it = bb->insts.begin(); it != bb->insts.end();) {
+        auto next = std::next(it);
+        if (canHoist(loop, it->get(), guaranteed)) {
+          (*it)->parent = preheader;
+          preheader->insts.splice(pos, bb->insts, it);
+          changed = true;
+        }
+        it = next;
+      }
+    }
+    return changed;
+  }
+};
+
+} // namespace
+
+auto opt::hoistLoopInvariants(Function &func, AnalysisManager &am) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  CallGraph calls(*func.parent);
+  SideEffectInfo effects(calls);
+  return LoopInvariantMotion(func, am, effects).run();
+}
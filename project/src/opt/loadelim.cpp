@@ -0,0 +1,329 @@
+/**
+ * @file loadelim.cpp
+ * @brief Redundant load elimination and store-to-load forwarding.
+ *
+ * Blocks are visited in reverse post-order, tracking which value each
+ * memory location is known to hold. A `load` from a location with a known
+ * value is replaced by that value; otherwise it becomes the known value
+ * itself. A `store` makes its operand the known value of its address.
+ *
+ * ### Across Blocks
+ * A block starts with the locations all its predecessors agree on. A value
+ * available along every path to a block is defined on every such path, so
+ * it dominates the block and can be used there. A loop header only sees its
+ * entering edges, minus the locations the loop body may write. Values
+ * defined inside a loop are not used outside of it.
+ *
+ * ### Alias Model
+ * Locations come from `AliasAnalysis`: a base pointer plus a range of byte
+ * offsets. Accesses from different identified objects never overlap, nor do
+ * accesses from the same base whose ranges are disjoint, so `p[0]` and
+ * `p[1]` stay apart even for a pointer parameter `p`.
+ *
+ * Calls clobber everything but non-escaping locals, unless `SideEffectInfo`
+ * says the callee does not write memory. Equal `getelemptr` / `getptr`
+ * computations are merged first so that they name the same location.
+ */
+
+module;
+
+#include <iterator>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Known location values, indexed by base and start offset so that a
+ * store only visits the entries it may overwrite.
+ *
+ * The indexes may hold addresses whose entry is gone; erasing those again
+ * is harmless, as they still sit in the right bucket.
+ */
+struct Memory {
+  std::unordered_map<Value *, Value *> values; ///< Address to value.
+  /// Addresses with a known offset, by base and then offset.
+  std::unordered_map<Value *, std::unordered_map<int, std::vector<Value *>>>
+      exact;
+  /// Addresses with a variable offset, by base.
+  std::unordered_map<Value *, std::vector<Value *>> inexact;
+
+  auto forget(std::vector<Value *> &addrs) -> void {
+    for (auto addr : addrs) {
+      values.erase(addr);
+    }
+    addrs.clear();
+  }
+
+  auto forgetBase(Value *base) -> void {
+    if (auto it = exact.find(base); it != exact.end()) {
+      for (auto &[offset, addrs] : it->second) {
+        forget(addrs);
+      }
+    }
+    if (auto it = inexact.find(base); it != inexact.end()) {
+      forget(it->second);
+    }
+  }
+
+  auto bases() const -> std::vector<Value *> {
+    std::vector<Value *> res;
+    for (const auto &[base, addrs] : exact) {
+      res.push_back(base);
+    }
+    for (const auto &[base, addrs] : inexact) {
+      if (!exact.contains(base)) {
+        res.push_back(base);
+      }
+    }
+    return res;
+  }
+};
+
+class LoadElimination {
+public:
+  LoadElimination(Function &_func, AnalysisManager &am,
+                  const SideEffectInfo &_effects)
+      : func(_func), effects(_effects), domTree(am.domTree(_func)),
+        loops(am.loops(_func)), aa(_func) {}
+
+  auto run() -> bool {
+    findLoopClobbers();
+
+    std::unordered_map<BasicBlock *, Memory> out;
+    auto preds = func.preds();
+    for (auto bb : domTree.order()) {
+      Memory memory = entryState(bb, preds[bb], out);
+      visit(bb, memory);
+      out[bb] = std::move(memory);
+    }
+    if (replaced.empty()) {
+      return false;
+    }
+
+    replaceAllUses(func, replaced);
+    for (auto &bb : func.blocks) {
+      std::erase_if(bb->insts, [&](const auto &inst) {
+        return replaced.contains(inst.get());
+      });
+    }
+    return true;
+  }
+
+private:
+  Function &func;
+  const SideEffectInfo &effects;
+  const DominatorTree &domTree;
+  const LoopInfo &loops;
+  AliasAnalysis aa;
+
+  std::unordered_map<Value *, Value *> replaced; ///< Redundant instructions.
+  std::map<std::tuple<Op, Value *, Value *>, std::vector<Value *>> addrs;
+  /// What a loop may write: store addresses and whether it calls a writer.
+  struct Clobbers {
+    std::vector<Value *> stores;
+    bool call = false;
+  };
+  std::unordered_map<const Loop *, Clobbers> clobbers;
+
+  auto resolve(Value *val) const -> Value * {
+    for (auto it = replaced.find(val); it != replaced.end();
+         it = replaced.find(val)) {
+      val = it->second;
+    }
+    return val;
+  }
+
+  auto findLoopClobbers() -> void {
+    for (auto loop : loops.postOrder()) {
+      auto &res = clobbers[loop];
+      for (auto bb : loop->blocks) {
+        for (auto &inst : bb->insts) {
+          if (inst->op == Op::Store) {
+            res.stores.push_back(inst->operands[1]);
+          } else if (inst->op == Op::Call) {
+            res.call |= effects.writesMemory(inst->callee);
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief The locations known on entry to `bb`.
+   */
+  auto entryState(BasicBlock *bb, const std::vector<BasicBlock *> &preds,
+                  const std::unordered_map<BasicBlock *, Memory> &out)
+      -> Memory {
+    auto loop = loops.loopFor(bb);
+    bool header = loop && loop->header == bb;
+    const Memory *first = nullptr;
+    std::vector<const Memory *> rest;
+    for (auto pred : preds) {
+      auto it = out.find(pred);
+      if (it == out.end()) {
+        // only a loop's back edges come from blocks not visited yet
+        if (!header || !loop->contains(pred)) {
+          return {};
+        }
+        continue;
+      }
+      if (first) {
+        rest.push_back(&it->second);
+      } else {
+        first = &it->second;
+      }
+    }
+    if (!first) {
+      return {};
+    }
+
+    Memory memory;
+    for (const auto &[addr, val] : first->values) {
+      // values computed in a loop are reloaded after it, so loop passes
+      // can copy the loop body without having to merge them
+      auto home = val->isInst() ? loops.loopFor(val->parent) : nullptr;
+      bool agreed = !home || home->contains(bb);
+      for (auto other : rest) {
+        auto it = other->values.find(addr);
+        agreed &= it != other->values.end() && it->second == val;
+      }
+      if (agreed) {
+        remember(memory, addr, val);
+      }
+    }
+    if (header) {
+      const auto &loopClobbers = clobbers.at(loop);
+      if (loopClobbers.call) {
+        clobberPublic(memory);
+      }
+      for (auto dest : loopClobbers.stores) {
+        clobber(memory, dest);
+      }
+    }
+    return memory;
+  }
+
+  auto remember(Memory &memory, Value *addr, Value *val) -> void {
+    memory.values[addr] = val;
+    const auto &loc = aa.location(addr);
+    if (auto offset = loc.offset()) {
+      memory.exact[loc.base][*offset].push_back(addr);
+    } else {
+      memory.inexact[loc.base].push_back(addr);
+    }
+  }
+
+  /**
+   * @brief Forgets every location a store to `dest` may overwrite.
+   */
+  auto clobber(Memory &memory, Value *dest) -> void {
+    const auto &loc = aa.location(dest);
+    auto base = loc.base;
+    for (auto other : memory.bases()) {
+      if (other != base && aa.mayShareObject(base, other)) {
+        memory.forgetBase(other);
+      }
+    }
+
+    // loads and stores access single words, so a known offset only
+    // overlaps the locations starting there
+    if (auto it = memory.exact.find(base); it != memory.exact.end()) {
+      auto &offsets = it->second;
+      if (auto offset = loc.offset()) {
+        memory.forget(offsets[*offset]);
+      } else {
+        for (auto bucket = offsets.begin(); bucket != offsets.end();) {
+          auto &[offset, addrs] = *bucket;
+          if (!loc.bounded || (loc.lo <= offset && offset < loc.hi + 4)) {
+            memory.forget(addrs);
+          }
+          bucket = addrs.empty() ? offsets.erase(bucket) : std::next(bucket);
+        }
+      }
+    }
+    if (auto it = memory.inexact.find(base); it != memory.inexact.end()) {
+      std::erase_if(it->second, [&](Value *addr) {
+        if (aa.alias(addr, dest) == AliasResult::NoAlias) {
+          return false;
+        }
+        memory.values.erase(addr);
+        return true;
+      });
+    }
+  }
+
+  /**
+   * @brief Forgets every location a callee may write.
+   */
+  auto clobberPublic(Memory &memory) -> void {
+    for (auto base : memory.bases()) {
+      if (!aa.isPrivate(base)) {
+        memory.forgetBase(base);
+      }
+    }
+  }
+
+  auto visit(BasicBlock *bb, Memory &memory) -> void {
+    for (auto &inst : bb->insts) {
+      inst->forEachUse([&](Value *&use) { use = resolve(use); });
+
+      switch (inst->op) {
+      case Op::GetPtr:
+      case Op::GetElemPtr: {
+        auto &same = addrs[{inst->op, inst->operands[0], inst->operands[1]}];
+        for (auto other : same) {
+          if (domTree.dominates(other->parent, bb)) {
+            replaced[inst.get()] = other;
+            break;
+          }
+        }
+        if (!replaced.contains(inst.get())) {
+          same.push_back(inst.get());
+        }
+        break;
+      }
+      case Op::Load: {
+        auto src = inst->operands[0];
+        if (auto it = memory.values.find(src); it != memory.values.end()) {
+          replaced[inst.get()] = it->second;
+        } else {
+          remember(memory, src, inst.get());
+        }
+        break;
+      }
+      case Op::Store:
+        clobber(memory, inst->operands[1]);
+        remember(memory, inst->operands[1], inst->operands[0]);
+        break;
+      case Op::Call:
+        if (effects.writesMemory(inst->callee)) {
+          clobberPublic(memory);
+        }
+        break;
+      default: break;
+      }
+    }
+  }
+};
+
+} // namespace
+
+auto opt::eliminateRedundantLoads(Function &func, AnalysisManager &am) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  CallGraph calls(*func.parent);
+  SideEffectInfo effects(calls);
+  return LoadElimination(func, am, effects).run();
+}
@@ -0,0 +1,666 @@
+/**
+ * @file loopnest.cpp
+ * @brief Interchange and tiling of perfect loop nests.
+ *
+ * A *nest* is an innermost loop together with its parent when the parent
+ * does nothing but start the inner loop and step its own counter:
+ * ```
+ * j = 0;                      // outer preheader
+ * do {                        // outer header: starts the inner loop
+ *   i = 0;
+ *   do { body(i, j); i = i + 1; } while (i < M);
+ *   j = j + 1;                // outer latch: nothing but the step
+ * } while (j < N);
+ * ```
+ * Both loops are rotated, start and end at constants and step by a positive
+ * constant, and the inner one is stepped last in its latch.
+ *
+ * ### Interchange
+ * Every access of the body is an address affine in `i` and `j`. Its byte
+ * strides tell how far it moves per iteration of either loop. The loops are
+ * swapped when that gives the inner loop the smaller strides (capped at a
+ * cache line, past which every access misses alike), e.g. to walk
+ * `a[i][j]` along its rows.
+ *
+ * Swapping is legal when no location is touched in an order that the swap
+ * would change:
+ * - a stored array element is only accessed through the very same address,
+ *   and every subscript depends on at most one of the counters, so that the
+ *   iterations touching it keep their relative order;
+ * - a scalar is only read, is a reduction `s = s + x` whose additions may
+ *   be reordered, or is written before it is read in every iteration;
+ * - there are no calls to functions with side effects.
+ *
+ * ### Tiling
+ * If an access still strides by a cache line or more in the inner loop
+ * while the outer loop revisits its lines, those lines are reused once per
+ * outer iteration. When the inner loop touches more lines than fit the
+ * cache (`cacheSize`), they are evicted before the reuse. The inner loop is
+ * then strip-mined into tiles of `tileSize` iterations, and the loop over
+ * tiles becomes the outermost one:
+ * ```
+ * for (t = 0; t < M; t += B)
+ *   for (j ...)
+ *     for (i = t; i < t + B; i++) body(i, j);
+ * ```
+ */
+
+module;
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+constexpr int cache_line = 64;
+
+/**
+ * @brief A counted loop of a nest: `slot` runs from `start` by `step`
+ * while below `bound`.
+ */
+struct Level {
+  Value *slot;
+  int start;
+  int bound;
+  int step;
+
+  auto trips() const -> int { return (bound - start + step - 1) / step; }
+};
+
+/**
+ * @brief A perfect nest of two loops.
+ */
+struct Nest {
+  // clang-format off
+  const Loop *outer;
+  const Loop *inner;
+  BasicBlock *header;       ///< Outer header, which starts the inner loop.
+  BasicBlock *innerLatch;   ///< Steps the inner counter and tests it.
+  BasicBlock *latch;        ///< Outer latch, the inner loop's only exit.
+  BasicBlock *exit;         ///< Where the outer loop leaves to.
+  Value *innerInit;         ///< `store start, slot` in `header`.
+  Level outerLevel;
+  Level innerLevel;
+  // clang-format on
+};
+
+/**
+ * @brief Byte strides of an address per iteration of the outer and the
+ * inner loop.
+ */
+struct Strides {
+  long outer = 0;
+  long inner = 0;
+  bool separable = true; ///< No subscript depends on both counters.
+};
+
+/**
+ * @brief A stride per iteration as far as caches are concerned.
+ */
+auto lineCost(long stride) -> long {
+  return std::min<long>(std::abs(stride), cache_line);
+}
+
+class LoopNestOptimizer {
+public:
+  LoopNestOptimizer(Function &_func, AnalysisManager &am,
+                    const SideEffectInfo &_effects, const Options &_options)
+      : func(_func), effects(_effects), options(_options),
+        domTree(am.domTree(_func)), loops(am.loops(_func)),
+        ivs(_func, loops, domTree), aa(_func) {}
+
+  auto run() -> bool {
+    std::vector<Nest> nests;
+    for (auto loop : loops.postOrder()) {
+      if (loop->subLoops.empty() && loop->parent) {
+        if (auto nest = analyze(*loop->parent, *loop)) {
+          nests.push_back(*nest);
+        }
+      }
+    }
+
+    bool changed = false;
+    for (auto &nest : nests) {
+      strides.clear();
+      auto accesses = collectAccesses(nest);
+      if (!accesses) {
+        continue;
+      }
+      long current = 0;
+      long swapped = 0;
+      for (const auto &access : *accesses) {
+        current += lineCost(access.inner);
+        swapped += lineCost(access.outer);
+      }
+      if (swapped < current) {
+        interchange(nest);
+        for (auto &access : *accesses) {
+          std::swap(access.outer, access.inner);
+        }
+        changed = true;
+      }
+      if (shouldTile(nest, *accesses)) {
+        tile(nest);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+private:
+  Function &func;
+  const SideEffectInfo &effects;
+  const Options &options;
+  const DominatorTree &domTree;
+  const LoopInfo &loops;
+  InductionInfo ivs;
+  AliasAnalysis aa;
+
+  std::unordered_map<const Value *, std::optional<Strides>> strides;
+
+  /**
+   * @brief The counter `latch` steps last and tests against a constant, in
+   * `store (add (load slot), step), slot; br (lt stepped, bound)`.
+   */
+  auto steppedCounter(const Loop &loop, BasicBlock *latch) const
+      -> std::optional<Level> {
+    auto branch = latch->terminator();
+    if (branch->op != Op::Branch || branch->edges[0].target != loop.header ||
+        loop.contains(branch->edges[1].target) ||
+        !branch->edges[0].args.empty() || !branch->edges[1].args.empty()) {
+      return std::nullopt;
+    }
+    auto cond = branch->operands[0];
+    if (cond->op != Op::Binary || cond->binop != BinOp::Lt ||
+        !cond->operands[1]->isInt()) {
+      return std::nullopt;
+    }
+    for (const auto &iv : ivs.of(&loop)) {
+      if (iv.update->parent != latch || iv.update->operands[0] != cond->operands[0] ||
+          iv.step <= 0) {
+        continue;
+      }
+      // nothing reads the counter after it is stepped
+      for (auto it = latch->find(iv.update); it != latch->insts.end(); ++it) {
+        if ((*it)->op == Op::Load && (*it)->operands[0] == iv.slot) {
+          return std::nullopt;
+        }
+      }
+      return Level{iv.slot, 0, cond->operands[1]->imm, iv.step};
+    }
+    return std::nullopt;
+  }
+
+  auto analyze(const Loop &outer, const Loop &inner) -> std::optional<Nest> {
+    auto outerLatches = outer.latches();
+    auto innerLatches = inner.latches();
+    if (outerLatches.size() != 1 || innerLatches.size() != 1 ||
+        outer.exitingBlocks().size() != 1 ||
+        inner.exitingBlocks().size() != 1 ||
+        outer.blocks.size() != inner.blocks.size() + 2) {
+      return std::nullopt;
+    }
+    Nest nest{};
+    nest.outer = &outer;
+    nest.inner = &inner;
+    nest.header = outer.header;
+    nest.innerLatch = innerLatches[0];
+    nest.latch = outerLatches[0];
+
+    auto preds = func.preds();
+    auto header = nest.header;
+    auto headerJump = header->terminator();
+    if (header == nest.latch || inner.contains(header) ||
+        headerJump->op != Op::Jump || headerJump->edges[0].target != inner.header ||
+        !header->params.empty() || !inner.header->params.empty() ||
+        preds[inner.header].size() != 2) {
+      return std::nullopt;
+    }
+    auto innerLevel = steppedCounter(inner, nest.innerLatch);
+    auto outerLevel = steppedCounter(outer, nest.latch);
+    if (!innerLevel || !outerLevel ||
+        nest.innerLatch->terminator()->edges[1].target != nest.latch ||
+        preds[nest.latch].size() != 1) {
+      return std::nullopt;
+    }
+    nest.exit = nest.latch->terminator()->edges[1].target;
+
+    // the outer latch only steps its counter
+    auto update = ivs.find(&outer, outerLevel->slot)->update;
+    auto stepped = update->operands[0];
+    for (const auto &inst : nest.latch->insts) {
+      auto val = inst.get();
+      bool part = val == update || val == stepped ||
+                  val == nest.latch->terminator() ||
+                  val == nest.latch->terminator()->operands[0] ||
+                  (val->op == Op::Load && val->operands[0] == outerLevel->slot &&
+                   std::ranges::find(stepped->operands, val) != stepped->operands.end());
+      if (!part) {
+        return std::nullopt;
+      }
+    }
+
+    // the outer header starts the inner counter and computes addresses
+    for (const auto &inst : header->insts) {
+      auto val = inst.get();
+      switch (val->op) {
+      case Op::Store:
+        if (val->operands[1] != innerLevel->slot || !val->operands[0]->isInt() ||
+            nest.innerInit) {
+          return std::nullopt;
+        }
+        nest.innerInit = val;
+        innerLevel->start = val->operands[0]->imm;
+        break;
+      case Op::Load:
+        if (val->operands[0] != outerLevel->slot) {
+          return std::nullopt;
+        }
+        break;
+      case Op::Alloc:
+      case Op::Binary:
+      case Op::GetPtr:
+      case Op::GetElemPtr:
+      case Op::Jump: break;
+      default: return std::nullopt;
+      }
+    }
+    std::vector<BasicBlock *> entering;
+    for (auto pred : preds[header]) {
+      if (!outer.contains(pred)) {
+        entering.push_back(pred);
+      }
+    }
+    if (!nest.innerInit || entering.size() != 1) {
+      return std::nullopt;
+    }
+    auto start = entryValue(entering[0], outerLevel->slot);
+    if (!start || !start->isInt()) {
+      return std::nullopt;
+    }
+    outerLevel->start = start->imm;
+    if (innerLevel->start >= innerLevel->bound ||
+        outerLevel->start >= outerLevel->bound) {
+      return std::nullopt;
+    }
+    nest.innerLevel = *innerLevel;
+    nest.outerLevel = *outerLevel;
+
+    // values of the nest are not used after it
+    if (outer.hasOutsideUses()) {
+      return std::nullopt;
+    }
+    return nest;
+  }
+
+  /**
+   * @brief Coefficients of the outer and inner counter in an index.
+   */
+  auto coefficients(const Nest &nest, const Value *val) const
+      -> std::optional<std::pair<long, long>> {
+    if (!(val->isInst() || val->op == Op::BlockArg) ||
+        !nest.outer->contains(val->parent)) {
+      return std::pair<long, long>{0, 0};
+    }
+    if (val->op == Op::Load) {
+      if (val->operands[0] == nest.outerLevel.slot) {
+        return std::pair<long, long>{1, 0};
+      }
+      if (val->operands[0] == nest.innerLevel.slot) {
+        return std::pair<long, long>{0, 1};
+      }
+      return std::nullopt;
+    }
+    if (val->op != Op::Binary) {
+      return std::nullopt;
+    }
+    auto lhs = coefficients(nest, val->operands[0]);
+    auto rhs = coefficients(nest, val->operands[1]);
+    if (!lhs || !rhs) {
+      return std::nullopt;
+    }
+    auto [lo, li] = *lhs;
+    auto [ro, ri] = *rhs;
+    switch (val->binop) {
+    case BinOp::Add: return std::pair{lo + ro, li + ri};
+    case BinOp::Sub: return std::pair{lo - ro, li - ri};
+    case BinOp::Mul:
+      if (val->operands[1]->isInt()) {
+        return std::pair{lo * val->operands[1]->imm, li * val->operands[1]->imm};
+      }
+      if (val->operands[0]->isInt()) {
+        return std::pair{ro * val->operands[0]->imm, ri * val->operands[0]->imm};
+      }
+      break;
+    default: break;
+    }
+    if (lo == 0 && li == 0 && ro == 0 && ri == 0) {
+      return std::pair<long, long>{0, 0};
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief How an address moves with the counters, if it is affine.
+   */
+  auto stridesOf(const Nest &nest, Value *ptr) -> std::optional<Strides> {
+    if (auto it = strides.find(ptr); it != strides.end()) {
+      return it->second;
+    }
+    std::optional<Strides> res;
+    if (!(ptr->isInst() || ptr->op == Op::BlockArg) ||
+        !nest.outer->contains(ptr->parent) || ptr->op == Op::Alloc) {
+      res = Strides{};
+    } else if (ptr->op == Op::GetPtr || ptr->op == Op::GetElemPtr) {
+      auto base = stridesOf(nest, ptr->operands[0]);
+      auto index = coefficients(nest, ptr->operands[1]);
+      if (base && index) {
+        long size = sizeOf(pointee(ptr->op == Op::GetPtr ? ptr->operands[0]->ty
+                                                         : ptr->ty));
+        auto [outer, inner] = *index;
+        res = Strides{base->outer + outer * size, base->inner + inner * size,
+                      base->separable && (outer == 0 || inner == 0)};
+      }
+    }
+    strides[ptr] = res;
+    return res;
+  }
+
+  /**
+   * @brief Whether two addresses are the same computation, so that they
+   * name the same location in every iteration.
+   */
+  auto sameAddress(const Nest &nest, const Value *a, const Value *b) const
+      -> bool {
+    if (a == b) {
+      return true;
+    }
+    if (a->op != b->op || a->operands.size() != b->operands.size()) {
+      return false;
+    }
+    switch (a->op) {
+    case Op::Load:
+      // the counters are only stored outside the body
+      return a->operands[0] == b->operands[0] &&
+             (a->operands[0] == nest.outerLevel.slot ||
+              a->operands[0] == nest.innerLevel.slot);
+    case Op::Binary:
+      if (a->binop != b->binop) {
+        return false;
+      }
+      [[fallthrough]];
+    case Op::GetPtr:
+    case Op::GetElemPtr:
+      return sameAddress(nest, a->operands[0], b->operands[0]) &&
+             sameAddress(nest, a->operands[1], b->operands[1]);
+    default: return false;
+    }
+  }
+
+  /**
+   * @brief Whether the scalar `slot` is only read, is a reduction
+   * `s = s + x`, or is written before it is read in every iteration.
+   *
+   * A written scalar keeps the value of the iteration that wrote it last,
+   * which reordering changes unless every iteration writes it.
+   */
+  auto isReorderableScalar(const Nest &nest, const Value *slot,
+                           const std::vector<Value *> &accesses,
+                           const std::unordered_map<Value *, std::vector<Value *>>
+                               &users) const -> bool {
+    auto usersOf = [&](Value *val) -> size_t {
+      auto it = users.find(val);
+      return it == users.end() ? 0 : it->second.size();
+    };
+    bool readOnly = true;
+    bool reduction = true;
+    bool privatized = true;
+    for (auto access : accesses) {
+      auto bb = access->parent;
+      if (access->op == Op::Store) {
+        readOnly = false;
+        privatized &= domTree.dominates(bb, nest.innerLatch);
+        auto val = access->operands[0];
+        reduction &= val->op == Op::Binary && val->binop == BinOp::Add &&
+                     std::ranges::any_of(val->operands, [&](Value *op) {
+                       return op->op == Op::Load && op->operands[0] == slot &&
+                              op->parent == bb && usersOf(op) == 1;
+                     });
+        continue;
+      }
+      // a load feeding the addition stored back next, or one after a store
+      // in the same block
+      bool feeds = usersOf(access) == 1;
+      bool written = false;
+      for (auto &inst : bb->insts) {
+        if (inst.get() == access) {
+          break;
+        }
+        written |= inst->op == Op::Store && inst->operands[1] == slot;
+      }
+      if (feeds) {
+        auto use = users.at(access)[0];
+        feeds = false;
+        for (auto it = std::next(bb->find(access)); it != bb->insts.end(); ++it) {
+          auto inst = it->get();
+          if (inst->op == Op::Store && inst->operands[1] == slot) {
+            feeds = inst->operands[0] == use && use->op == Op::Binary &&
+                    use->binop == BinOp::Add;
+            break;
+          }
+          if (inst->op == Op::Load && inst->operands[0] == slot) {
+            break;
+          }
+        }
+      }
+      reduction &= feeds;
+      privatized &= written;
+    }
+    return readOnly || reduction || privatized;
+  }
+
+  /**
+   * @brief The strides of every memory access in the body, if the nest
+   * may be reordered.
+   */
+  auto collectAccesses(const Nest &nest) -> std::optional<std::vector<Strides>> {
+    std::vector<Value *> memory;
+    for (auto bb : nest.inner->blocks) {
+      for (auto &inst : bb->insts) {
+        switch (inst->op) {
+        case Op::Alloc: return std::nullopt;
+        case Op::Call:
+          if (!effects.isPure(inst->callee)) {
+            return std::nullopt;
+          }
+          break;
+        case Op::Load:
+        case Op::Store: memory.push_back(inst.get()); break;
+        default: break;
+        }
+      }
+    }
+    auto addressOf = [](const Value *inst) {
+      return inst->operands[inst->op == Op::Load ? 0 : 1];
+    };
+    const auto &inner = nest.innerLevel;
+    const auto &outer = nest.outerLevel;
+    auto innerUpdate = ivs.find(nest.inner, inner.slot)->update;
+
+    auto users = collectUsers(func);
+    std::unordered_map<Value *, std::vector<Value *>> scalars;
+    std::vector<Strides> res;
+    for (auto access : memory) {
+      auto addr = addressOf(access);
+      if (addr == outer.slot || addr == inner.slot) {
+        if (access->op == Op::Store && access != innerUpdate) {
+          return std::nullopt;
+        }
+        continue;
+      }
+      if (isIdentifiedObject(addr) && pointee(addr->ty)->is_int()) {
+        scalars[addr].push_back(access);
+        continue;
+      }
+      auto info = stridesOf(nest, addr);
+      if (!info) {
+        return std::nullopt;
+      }
+      res.push_back(*info);
+      if (access->op != Op::Store) {
+        continue;
+      }
+      // stored elements are only accessed at the same address, which moves
+      // with one counter per subscript
+      if (!info->separable || (info->outer == 0 && info->inner == 0)) {
+        return std::nullopt;
+      }
+      for (auto other : memory) {
+        auto otherAddr = addressOf(other);
+        if (!sameAddress(nest, addr, otherAddr) &&
+            aa.alias(addr, otherAddr) != AliasResult::NoAlias) {
+          return std::nullopt;
+        }
+      }
+    }
+    for (const auto &[slot, accesses] : scalars) {
+      if (!isReorderableScalar(nest, slot, accesses, users)) {
+        return std::nullopt;
+      }
+      for (auto other : memory) {
+        auto otherAddr = addressOf(other);
+        if (otherAddr != slot &&
+            aa.alias(slot, otherAddr) != AliasResult::NoAlias) {
+          return std::nullopt;
+        }
+      }
+    }
+    return res;
+  }
+
+  auto shouldTile(const Nest &nest, const std::vector<Strides> &accesses) const
+      -> bool {
+    const auto &inner = nest.innerLevel;
+    int size = options.tileSize;
+    if (size < 2 || inner.start != 0 || inner.step != 1 ||
+        inner.trips() <= size || inner.trips() % size != 0) {
+      return false;
+    }
+    // lines the inner loop touches that the next outer iteration reuses
+    long lines = 0;
+    for (const auto &access : accesses) {
+      if (std::abs(access.inner) >= cache_line &&
+          std::abs(access.outer) < cache_line) {
+        lines += inner.trips();
+      }
+    }
+    return lines * cache_line > options.cacheSize;
+  }
+
+  /**
+   * @brief Appends `slot += step; cond = slot < bound` before the terminator
+   * of `bb`.
+   */
+  auto emitStep(BasicBlock *bb, Value *slot, int step, Value *bound)
+      -> Value * {
+    auto module = func.parent;
+    auto load = bb->insertBeforeTerminator(makeLoad(slot));
+    auto next = bb->insertBeforeTerminator(
+        makeBinary(BinOp::Add, load, module->getInt(step)));
+    bb->insertBeforeTerminator(makeStore(next, slot));
+    return bb->insertBeforeTerminator(makeBinary(BinOp::Lt, next, bound));
+  }
+
+  auto interchange(Nest &nest) -> void {
+    auto module = func.parent;
+    auto &inner = nest.innerLevel;
+    auto &outer = nest.outerLevel;
+    auto preheader = getOrInsertPreheader(func, *nest.outer);
+    preheader->insertBeforeTerminator(
+        makeStore(module->getInt(inner.start), inner.slot));
+
+    // the header's values may change with the new inner counter: compute
+    // them in every iteration
+    auto header = nest.header;
+    auto body = nest.inner->header;
+    auto pos = body->insts.begin();
+    for (auto it = header->insts.begin(); it != header->insts.end();) {
+      auto inst = it++->get();
+      if (inst != nest.innerInit && inst->op != Op::Alloc &&
+          !inst->isTerminator()) {
+        body->insert(pos, header->detach(inst));
+      }
+    }
+    nest.innerInit->operands[0] = module->getInt(outer.start);
+    nest.innerInit->operands[1] = outer.slot;
+
+    // the inner latch steps the old outer counter and the outer latch the
+    // old inner one
+    auto innerBranch = nest.innerLatch->terminator();
+    nest.innerLatch->erase(ivs.find(nest.inner, inner.slot)->update);
+    innerBranch->operands[0] = emitStep(nest.innerLatch, outer.slot, outer.step,
+                                        module->getInt(outer.bound));
+    auto latch = nest.latch;
+    auto latchBranch = latch->terminator();
+    latch->insts.erase(latch->insts.begin(), std::prev(latch->insts.end()));
+    latchBranch->operands[0] =
+        emitStep(latch, inner.slot, inner.step, module->getInt(inner.bound));
+    std::swap(inner, outer);
+  }
+
+  auto tile(Nest &nest) -> void {
+    auto module = func.parent;
+    const auto &inner = nest.innerLevel;
+    const auto &outer = nest.outerLevel;
+    int size = options.tileSize;
+
+    auto entry = func.entry();
+    auto slot = entry->insert(entry->insts.begin(),
+                              makeAlloc(pointee(inner.slot->ty),
+                                        inner.slot->name + "_tile"));
+    auto preheader = getOrInsertPreheader(func, *nest.outer);
+    auto tileHeader = func.newBlock("tile_header", nest.header);
+    auto tileLatch = func.newBlock("tile_latch", nest.exit);
+    preheader->insertBeforeTerminator(makeStore(module->getInt(0), slot));
+    preheader->terminator()->edges[0].target = tileHeader;
+    tileHeader->append(makeStore(module->getInt(outer.start), outer.slot));
+    tileHeader->append(makeJump(nest.header));
+
+    // the inner loop runs over one tile
+    auto header = nest.header;
+    auto first = header->insert(header->find(nest.innerInit), makeLoad(slot));
+    auto end = header->insert(header->find(nest.innerInit),
+                              makeBinary(BinOp::Add, first, module->getInt(size)));
+    nest.innerInit->operands[0] = first;
+    nest.innerLatch->terminator()->operands[0]->operands[1] = end;
+
+    nest.latch->terminator()->edges[1].target = tileLatch;
+    tileLatch->append(makeBranch(module->getInt(0), tileHeader, nest.exit));
+    tileLatch->terminator()->operands[0] =
+        emitStep(tileLatch, slot, size, module->getInt(inner.bound));
+  }
+};
+
+} // namespace
+
+auto opt::optimizeLoopNests(Function &func, AnalysisManager &am,
+                            const Options &options) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  CallGraph calls(*func.parent);
+  SideEffectInfo effects(calls);
+  return LoopNestOptimizer(func, am, effects, options).run();
+}
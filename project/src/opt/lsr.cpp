@@ -0,0 +1,399 @@
+/**
+ * @file lsr.cpp
+ * @brief Strength reduction of array walks driven by induction variables.
+ *
+ * In `while (i < n) { s = s + a[i]; i = i + 1; }` every iteration computes
+ * `getelemptr @a, %i` afresh, which the backend emits as a multiplication by
+ * the element size plus an addition. With `@i` an induction variable of the
+ * loop and `@a` loop invariant, the address can instead be kept in a pointer
+ * slot that is initialized in the preheader and advanced by the step right
+ * after `@i` is: `@p` then always holds `@a + (@i + offset)`.
+ *
+ * Address computations `base[load @i + c]` of the same base and offset form
+ * one group and share a pointer. A group is reduced when it has several
+ * members, or when this leaves the induction variable without other uses.
+ * Then its update is deleted too; if the loop's exit test still reads it,
+ * the test is first rewritten to another induction variable with the same
+ * step (Koopa cannot compare pointers, so the test stays on integers).
+ * Only `==` and `!=` tests are rewritten: shifting the bound of an ordered
+ * comparison may wrap around and flip its outcome.
+ */
+
+module;
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief The address computations of one loop sharing a pointer.
+ */
+struct Group {
+  Value *base;
+  Op op; ///< `GetPtr` or `GetElemPtr`.
+  int offset;
+  std::vector<std::pair<BasicBlock *, BasicBlock::iterator>> members;
+};
+
+class StrengthReduction {
+public:
+  StrengthReduction(Function &_func, AnalysisManager &_am)
+      : func(_func), am(_am) {}
+
+  auto run() -> bool {
+    if (am.loops(func).empty()) {
+      return false;
+    }
+    auto blocks = func.blocks.size();
+    for (auto loop : am.loops(func).postOrder()) {
+      getOrInsertPreheader(func, *loop);
+    }
+    bool changed = func.blocks.size() != blocks;
+    if (changed) {
+      am.invalidate(func);
+    }
+
+    const auto &domTree = am.domTree(func);
+    const auto &loops = am.loops(func);
+    InductionInfo ivs(func, loops, domTree);
+    users = collectUsers(func);
+    for (auto &bb : func.blocks) {
+      for (auto &inst : bb->insts) {
+        if (inst->op == Op::Load && ivs.isPrivateScalar(inst->operands[0])) {
+          slotLoads[inst->operands[0]].push_back(inst.get());
+        }
+      }
+    }
+
+    for (auto loop : loops.postOrder()) {
+      for (const auto &iv : ivs.of(loop)) {
+        changed |= reduce(*loop, iv, ivs, domTree);
+      }
+    }
+    replaceAllUses(func, replaced);
+    return changed;
+  }
+
+private:
+  Function &func;
+  AnalysisManager &am;
+  std::unordered_map<Value *, std::vector<Value *>> users;
+  std::unordered_map<const Value *, std::vector<Value *>> slotLoads;
+  std::unordered_set<const Value *> removed; ///< Deleted induction variables.
+  std::unordered_map<Value *, Value *> replaced;
+
+  /**
+   * @brief Inserts `inst` before the terminator of `bb`, keeping the
+   * bookkeeping of slot loads and users up to date.
+   */
+  auto emit(BasicBlock *bb, std::unique_ptr<Value> inst) -> Value * {
+    auto res = bb->insertBeforeTerminator(std::move(inst));
+    for (auto use : res->operands) {
+      users[use].push_back(res);
+    }
+    if (res->op == Op::Load && slotLoads.contains(res->operands[0])) {
+      slotLoads[res->operands[0]].push_back(res);
+    }
+    return res;
+  }
+
+  /**
+   * @brief Splits an index into `load @slot` plus a constant offset.
+   */
+  static auto matchIndex(Value *index, const Value *slot)
+      -> std::pair<Value *, int> {
+    auto isSlotLoad = [&](Value *val) {
+      return val->op == Op::Load && val->operands[0] == slot;
+    };
+    if (isSlotLoad(index)) {
+      return {index, 0};
+    }
+    if (index->op != Op::Binary) {
+      return {nullptr, 0};
+    }
+    auto lhs = index->operands[0];
+    auto rhs = index->operands[1];
+    if (index->binop == BinOp::Add && isSlotLoad(lhs) && rhs->isInt()) {
+      return {lhs, rhs->imm};
+    }
+    if (index->binop == BinOp::Add && isSlotLoad(rhs) && lhs->isInt()) {
+      return {rhs, lhs->imm};
+    }
+    if (index->binop == BinOp::Sub && isSlotLoad(lhs) && rhs->isInt()) {
+      return {lhs, -rhs->imm};
+    }
+    return {nullptr, 0};
+  }
+
+  /**
+   * @brief Collects the address computations indexed by `iv` whose index is
+   * loaded in the same block with no update in between.
+   */
+  auto findGroups(const Loop &loop, const InductionVariable &iv)
+      -> std::vector<Group> {
+    std::map<std::tuple<Value *, Op, int>, Group> groups;
+    for (auto bb : loop.blocks) {
+      bool updated = false;
+      std::unordered_map<const Value *, bool> loadedAfterUpdate;
+      for (auto it = bb->insts.begin(); it != bb->insts.end(); ++it) {
+        auto inst = it->get();
+        if (inst == iv.update) {
+          updated = true;
+        } else if (inst->op == Op::Load && inst->operands[0] == iv.slot) {
+          loadedAfterUpdate[inst] = updated;
+        } else if ((inst->op == Op::GetPtr || inst->op == Op::GetElemPtr) &&
+                   loop.isInvariant(inst->operands[0])) {
+          auto [load, offset] = matchIndex(inst->operands[1], iv.slot);
+          auto found = loadedAfterUpdate.find(load);
+          if (found == loadedAfterUpdate.end() || found->second != updated) {
+            continue;
+          }
+          auto key = std::tuple(inst->operands[0], inst->op, offset);
+          auto &group = groups[key];
+          group.base = inst->operands[0];
+          group.op = inst->op;
+          group.offset = offset;
+          group.members.emplace_back(bb, it);
+        }
+      }
+    }
+    std::vector<Group> res;
+    for (auto &[key, group] : groups) {
+      res.push_back(std::move(group));
+    }
+    return res;
+  }
+
+  /**
+   * @brief Whether a load outside the loop reads a value stored earlier in
+   * its own block, and hence never one stored by the loop.
+   */
+  static auto isShielded(const Value *load) -> bool {
+    for (const auto &inst : load->parent->insts) {
+      if (inst.get() == load) {
+        return false;
+      }
+      if (inst->op == Op::Store && inst->operands[1] == load->operands[0]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Finds another induction variable stepped next to `iv` that the
+   * exit test reading `test` may use instead.
+   */
+  auto findReplacement(const Loop &loop, const InductionVariable &iv,
+                       const Value *test, const InductionInfo &ivs,
+                       const DominatorTree &domTree) const
+      -> const InductionVariable * {
+    auto block = iv.update->parent;
+    for (const auto &other : ivs.of(&loop)) {
+      if (other.slot == iv.slot || other.step != iv.step ||
+          removed.contains(other.slot) || other.update->parent != block) {
+        continue;
+      }
+      if (test->parent != block) {
+        if (domTree.dominates(block, test->parent) ||
+            domTree.dominates(test->parent, block)) {
+          return &other;
+        }
+        continue;
+      }
+      // both updates must happen on the same side of the test
+      int seen = 0;
+      for (const auto &inst : block->insts) {
+        if (inst.get() == test) {
+          break;
+        }
+        seen += inst.get() == iv.update || inst.get() == other.update;
+      }
+      if (seen != 1) {
+        return &other;
+      }
+    }
+    return nullptr;
+  }
+
+  auto reduce(const Loop &loop, const InductionVariable &iv,
+              const InductionInfo &ivs, const DominatorTree &domTree) -> bool {
+    if (removed.contains(iv.slot)) {
+      return false;
+    }
+    auto groups = findGroups(loop, iv);
+    std::unordered_set<const Value *> planned;
+    for (const auto &group : groups) {
+      for (auto [bb, it] : group.members) {
+        planned.insert(it->get());
+      }
+    }
+
+    // is the induction variable needed once the groups are reduced?
+    auto next = iv.update->operands[0];
+    auto feedsPlanned = [&](Value *val) {
+      const auto &uses = users[val];
+      return std::ranges::all_of(uses, [&](Value *use) {
+        return planned.contains(use) ||
+               (use->op == Op::Binary &&
+                std::ranges::all_of(users[use], [&](Value *user) {
+                  return planned.contains(user);
+                }));
+      });
+    };
+    // forwarded loads may leave the stepped value with other readers
+    bool dead = users[next].size() == 1;
+    Value *test = nullptr;
+    for (auto load : slotLoads[iv.slot]) {
+      bool feedsNext = load->parent == next->parent &&
+                       (next->operands[0] == load || next->operands[1] == load);
+      if ((feedsNext && std::ranges::all_of(users[load], [&](Value *use) {
+             return use == next || planned.contains(use);
+           })) ||
+          (loop.contains(load->parent) && feedsPlanned(load))) {
+        continue;
+      }
+      if (!loop.contains(load->parent)) {
+        dead &= isShielded(load);
+      } else if (auto cond = isExitTest(loop, load); cond && !test) {
+        test = load;
+      } else {
+        dead = false;
+      }
+    }
+    // inside another loop, the preheader must not read a value left behind
+    // by the previous run of this loop
+    auto preheader = getOrInsertPreheader(func, loop);
+    if (loop.parent) {
+      dead &= std::ranges::any_of(preheader->insts, [&](const auto &inst) {
+        return inst->op == Op::Store && inst->operands[1] == iv.slot;
+      });
+    }
+    const InductionVariable *replacement = nullptr;
+    if (dead && test) {
+      replacement = findReplacement(loop, iv, test, ivs, domTree);
+      dead = replacement != nullptr;
+    }
+
+    bool changed = false;
+    for (const auto &group : groups) {
+      if (dead || group.members.size() >= 2) {
+        reduceGroup(iv, group, preheader);
+        changed = true;
+      }
+    }
+    if (!dead) {
+      return changed;
+    }
+
+    if (test) {
+      rewriteExitTest(test, iv, *replacement, preheader);
+    }
+    removed.insert(iv.slot);
+    iv.update->parent->erase(iv.update);
+    return true;
+  }
+
+  /**
+   * @brief The equality exit test comparing `load` against a loop invariant,
+   * if that is the load's only use.
+   */
+  auto isExitTest(const Loop &loop, Value *load) -> Value * {
+    const auto &uses = users[load];
+    if (uses.size() != 1 || uses[0]->op != Op::Binary) {
+      return nullptr;
+    }
+    auto cond = uses[0];
+    auto other = cond->operands[cond->operands[0] == load ? 1 : 0];
+    const auto &branches = users[cond];
+    if ((cond->binop != BinOp::Eq && cond->binop != BinOp::Ne) ||
+        cond->operands[0] == cond->operands[1] || !loop.isInvariant(other) ||
+        branches.size() != 1 || branches[0]->op != Op::Branch ||
+        branches[0]->parent != load->parent) {
+      return nullptr;
+    }
+    auto succs = load->parent->succs();
+    bool exits = std::ranges::any_of(
+        succs, [&](auto succ) { return !loop.contains(succ); });
+    return exits ? cond : nullptr;
+  }
+
+  auto reduceGroup(const InductionVariable &iv, const Group &group,
+                   BasicBlock *preheader) -> void {
+    auto [firstBlock, first] = group.members[0];
+    auto entry = func.entry();
+    auto slot = entry->insert(entry->insts.begin(),
+                              makeAlloc((*first)->ty, iv.slot->name + "_ptr"));
+
+    // @p = base + (@i + offset)
+    Value *index = emit(preheader, makeLoad(iv.slot));
+    if (group.offset != 0) {
+      index = emit(preheader, makeBinary(BinOp::Add, index,
+                                         func.parent->getInt(group.offset)));
+    }
+    auto start = group.op == Op::GetPtr ? makeGetPtr(group.base, index)
+                                        : makeGetElemPtr(group.base, index);
+    emit(preheader, makeStore(emit(preheader, std::move(start)), slot));
+
+    // advance @p right after @i
+    auto block = iv.update->parent;
+    auto pos = std::next(block->find(iv.update));
+    auto cur = block->insert(pos, makeLoad(slot));
+    auto next = block->insert(
+        pos, makeGetPtr(cur, func.parent->getInt(iv.step)));
+    block->insert(pos, makeStore(next, slot));
+
+    for (auto [bb, it] : group.members) {
+      replaced[it->get()] = bb->insert(it, makeLoad(slot));
+    }
+  }
+
+  /**
+   * @brief Makes the exit test read `other` instead of `iv`; both advance
+   * in lockstep, so `iv == bound` is `other == bound + (other - iv)` with
+   * the difference taken on entry to the loop. This holds modulo 2^32, so
+   * the addition may wrap.
+   */
+  auto rewriteExitTest(Value *test, const InductionVariable &iv,
+                       const InductionVariable &other, BasicBlock *preheader)
+      -> void {
+    auto cond = users[test][0];
+    auto bound = cond->operands[cond->operands[0] == test ? 1 : 0];
+    auto distance =
+        emit(preheader, makeBinary(BinOp::Sub, emit(preheader, makeLoad(other.slot)),
+                                   emit(preheader, makeLoad(iv.slot))));
+    auto shifted = emit(preheader, makeBinary(BinOp::Add, bound, distance));
+
+    auto block = test->parent;
+    auto load = block->insert(block->find(test), makeLoad(other.slot));
+    slotLoads[other.slot].push_back(load);
+    users[load].push_back(cond);
+    for (auto &use : cond->operands) {
+      use = use == test ? load : shifted;
+    }
+  }
+};
+
+} // namespace
+
+auto opt::strengthReduceLoops(Function &func, AnalysisManager &am) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  return StrengthReduction(func, am).run();
+}
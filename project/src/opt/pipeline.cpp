@@ -0,0 +1,364 @@
+/**
+ * @file pipeline.cpp
+ * @brief The pass manager, the `-O` pipelines behind `-perf`, and the
+ * optimizer flags.
+ */
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <fmt/core.h>
+#include <functional>
+#include <iterator>
+#include <malloc.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+import log;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Prints the alias queries `func` made since `before` (`-Rpass=aa`).
+ */
+auto reportAliasQueries(const Function &func,
+                        const AliasAnalysis::Statistics &before) -> void {
+  const auto &now = AliasAnalysis::statistics();
+  fmt::print(stderr,
+             "remark: {}: {} alias queries ({} cached): {} no, {} may, {} "
+             "must\n",
+             func.name, now.queries - before.queries,
+             now.cached - before.cached, now.noAlias - before.noAlias,
+             now.mayAlias - before.mayAlias, now.mustAlias - before.mustAlias);
+}
+
+/**
+ * @brief Pipelines of `-O0`, `-O1` and `-O2`.
+ *
+ * Tail recursion goes first, as loops no longer block inlining. After
+ * unrolling, induction variable indices are constants, which lets arrays be
+ * split and their loads forwarded.
+ */
+constexpr std::array<std::string_view, 3> Presets{
+    "",
+    "tailrec,ipcp,inline,purecalls,simplifycfg,instcombine,dce,loadelim,dse,dce,"
+    "licm,dce",
+    "tailrec,ipcp,specialize,inline,localize-globals,purecalls,"
+    "simplifycfg,instcombine,dce,simplifycfg,loadelim,dse,dce,pre,vrp,"
+    "simplifycfg,loop-nest,licm,vectorize,lsr,dce,unroll,simplifycfg,"
+    "instcombine,dce,sroa,loadelim,dse,vrp,instcombine,dce",
+};
+
+} // namespace
+
+/**
+ * @brief A pass and how the pass manager drives it.
+ */
+struct opt::Pass {
+  std::string_view name;
+  PassKind kind;
+  /// Set for module passes.
+  bool (*onModule)(Module &, const Options &) = nullptr;
+  /// Set for function and loop passes.
+  bool (*onFunction)(Function &, AnalysisManager &, const Options &) = nullptr;
+  /// What stays valid when the pass changes a function.
+  PreservedAnalyses preserved = PreservedAnalyses::none();
+  /// Whether running it again right away never changes anything.
+  bool idempotent = false;
+};
+
+namespace {
+
+// clang-format off
+const std::array<Pass, 19> Registry{{
+    {.name = "ipcp", .kind = PassKind::Module,
+     .onModule = [](Module &module, const Options &) { return propagateConstantArgs(module); }},
+    {.name = "specialize", .kind = PassKind::Module,
+     .onModule = [](Module &module, const Options &options) { return specializeFunctions(module, options); }},
+    {.name = "inline", .kind = PassKind::Module,
+     .onModule = [](Module &module, const Options &options) { return inlineFunctions(module, options); }},
+    {.name = "localize-globals", .kind = PassKind::Module,
+     .onModule = [](Module &module, const Options &) { return localizeGlobals(module); }},
+    {.name = "purecalls", .kind = PassKind::Module,
+     .onModule = [](Module &module, const Options &) { return eliminatePureCalls(module); }},
+    {.name = "tailrec", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &, const Options &) { return eliminateTailCalls(func); },
+     .idempotent = true},
+    {.name = "simplifycfg", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &, const Options &) { return simplifyCFG(func); },
+     .idempotent = true},
+    // only deletes blocks the entry cannot reach, which no analysis covers
+    {.name = "dce", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &, const Options &) { return eliminateDeadCode(func); },
+     .preserved = PreservedAnalyses::all(), .idempotent = true},
+    {.name = "loadelim", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &) { return eliminateRedundantLoads(func, am); },
+     .preserved = PreservedAnalyses::all()},
+    {.name = "dse", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &) { return eliminateDeadStores(func, am); },
+     .preserved = PreservedAnalyses::all()},
+    {.name = "instcombine", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &, const Options &) { return combineInstructions(func); },
+     .preserved = PreservedAnalyses::all(), .idempotent = true},
+    {.name = "vrp", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &) { return simplifyWithRanges(func, am); },
+     .preserved = PreservedAnalyses::all()},
+    {.name = "pre", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &) { return eliminatePartialRedundancies(func, am); }},
+    {.name = "sroa", .kind = PassKind::Function,
+     .onFunction = [](Function &func, AnalysisManager &, const Options &) { return splitLocalArrays(func); },
+     .preserved = PreservedAnalyses::all(), .idempotent = true},
+    // loop passes insert preheaders (and drop the analyses) before moving
+    // anything, so the analyses left behind are valid
+    {.name = "loop-nest", .kind = PassKind::Loop,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &options) { return optimizeLoopNests(func, am, options); }},
+    {.name = "licm", .kind = PassKind::Loop,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &) { return hoistLoopInvariants(func, am); },
+     .preserved = PreservedAnalyses::all()},
+    {.name = "vectorize", .kind = PassKind::Loop,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &options) { return vectorizeLoops(func, am, options); }},
+    {.name = "lsr", .kind = PassKind::Loop,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &) { return strengthReduceLoops(func, am); },
+     .preserved = PreservedAnalyses::all()},
+    {.name = "unroll", .kind = PassKind::Loop,
+     .onFunction = [](Function &func, AnalysisManager &am, const Options &options) { return unrollLoops(func, am, options); }},
+}};
+// clang-format on
+
+auto findPass(std::string_view name) -> const Pass * {
+  auto it = std::ranges::find(Registry, name, &Pass::name);
+  return it == Registry.end() ? nullptr : &*it;
+}
+
+/**
+ * @brief Splits a comma-separated pipeline into pass names.
+ */
+auto splitPipeline(std::string_view pipeline) -> std::vector<std::string_view> {
+  std::vector<std::string_view> res;
+  while (!pipeline.empty()) {
+    auto comma = pipeline.find(',');
+    res.push_back(pipeline.substr(0, comma));
+    pipeline = comma == std::string_view::npos ? std::string_view()
+                                                : pipeline.substr(comma + 1);
+  }
+  return res;
+}
+
+/**
+ * @brief Bytes currently allocated on the heap.
+ */
+auto heapInUse() -> long {
+  auto info = mallinfo2();
+  return static_cast<long>(info.uordblks + info.hblkhd);
+}
+
+/**
+ * @brief Prints the analyses `func` computed and reused since `before`
+ * (`-Rpass=analysis`).
+ */
+auto reportAnalyses(const Function &func, const AnalysisManager &am,
+                    const AnalysisManager::Statistics &before) -> void {
+  const auto &now = am.statistics();
+  fmt::print(stderr,
+             "remark: {}: {} analyses computed, {} cached, {} invalidated\n",
+             func.name, now.computed - before.computed,
+             now.cached - before.cached, now.invalidated - before.invalidated);
+}
+
+} // namespace
+
+auto opt::parseOption(Options &options, std::string_view arg) -> bool {
+  auto value = [&](std::string_view flag) -> std::string_view {
+    if (!arg.starts_with(flag) || arg.size() <= flag.size() ||
+        arg[flag.size()] != '=') {
+      return {};
+    }
+    return arg.substr(flag.size() + 1);
+  };
+  auto number = [&](std::string_view flag, int &field) {
+    auto text = value(flag);
+    int res = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), res);
+    if (text.empty() || ec != std::errc() || ptr != text.data() + text.size()) {
+      return false;
+    }
+    field = res;
+    return true;
+  };
+
+  if (auto pass = value("-Rpass"); !pass.empty()) {
+    options.remarks.emplace(pass);
+    return true;
+  }
+  if (auto pipeline = value("-passes"); !pipeline.empty()) {
+    for (auto name : splitPipeline(pipeline)) {
+      if (!findPass(name)) {
+        Log::panic(fmt::format("Unknown pass '{}' in -passes", name));
+      }
+    }
+    options.passes = pipeline;
+    return true;
+  }
+  if (auto arch = value("-march"); !arch.empty()) {
+    if (arch != "rv32im" && arch != "rv32imv") {
+      Log::panic(fmt::format("Unsupported target '{}' in -march", arch));
+    }
+    options.vectorize = arch == "rv32imv";
+    return true;
+  }
+  if (arg == "-time-passes") {
+    options.timePasses = true;
+    return true;
+  }
+  return number("-inline-threshold", options.inlineThreshold) ||
+         number("-inline-recursion-depth", options.inlineRecursionDepth) ||
+         number("-inline-caller-limit", options.inlineCallerLimit) ||
+         number("-unroll-factor", options.unrollFactor) ||
+         number("-unroll-full-limit", options.unrollLimit) ||
+         number("-specialize-budget", options.specializeBudget) ||
+         number("-tile-size", options.tileSize) ||
+         number("-cache-size", options.cacheSize);
+}
+
+auto opt::presetPipeline(int level) -> std::string_view {
+  return Presets.at(std::clamp(level, 0, 2));
+}
+
+auto PassManager::addPipeline(std::string_view pipeline) -> bool {
+  std::vector<const Pass *> added;
+  for (auto name : splitPipeline(pipeline)) {
+    auto pass = findPass(name);
+    if (!pass) {
+      return false;
+    }
+    added.push_back(pass);
+  }
+  passes.insert(passes.end(), added.begin(), added.end());
+  return true;
+}
+
+auto PassManager::run(Module &module) -> void {
+  std::vector<const Pass *> group;
+  for (auto pass : passes) {
+    if (pass->kind != PassKind::Module) {
+      group.push_back(pass);
+      continue;
+    }
+    runGroup(module, group);
+    group.clear();
+    bool changed = measure(
+        *pass, [&] { return module.instCount(); },
+        [&] { return pass->onModule(module, options); });
+    if (changed) {
+      am.clear();
+    }
+  }
+  runGroup(module, group);
+  am.clear();
+  if (options.timePasses) {
+    reportTimings();
+  }
+}
+
+auto PassManager::runGroup(Module &module,
+                           const std::vector<const Pass *> &group) -> void {
+  if (group.empty()) {
+    return;
+  }
+  for (auto &func : module.funcs) {
+    if (func->isDecl()) {
+      continue;
+    }
+    auto queries = AliasAnalysis::statistics();
+    auto analyses = am.statistics();
+    // the passes known to change nothing at the current version of `func`
+    int version = 0;
+    std::unordered_map<const Pass *, int> settled;
+    for (auto pass : group) {
+      if (auto it = settled.find(pass); it != settled.end() && it->second == version) {
+        continue;
+      }
+      if (pass->kind == PassKind::Loop && am.loops(*func).empty()) {
+        continue;
+      }
+      bool changed = measure(
+          *pass, [&] { return func->instCount(); },
+          [&] { return pass->onFunction(*func, am, options); });
+      if (changed) {
+        am.invalidate(*func, pass->preserved);
+        ++version;
+      }
+      if (!changed || pass->idempotent) {
+        settled[pass] = version;
+      }
+    }
+    if (options.wantsRemarks("aa")) {
+      reportAliasQueries(*func, queries);
+    }
+    if (options.wantsRemarks("analysis")) {
+      reportAnalyses(*func, am, analyses);
+    }
+    am.invalidate(*func);
+  }
+}
+
+template <typename Size, typename Body>
+auto PassManager::measure(const Pass &pass, Size size, Body body) -> bool {
+  if (!options.timePasses) {
+    return body();
+  }
+  auto insts = static_cast<long>(size());
+  auto bytes = heapInUse();
+  auto start = std::chrono::steady_clock::now();
+  bool changed = body();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  auto it = std::ranges::find(timings, pass.name, &Timing::name);
+  if (it == timings.end()) {
+    timings.push_back({.name = pass.name});
+    it = std::prev(timings.end());
+  }
+  it->seconds += elapsed.count();
+  it->insts += static_cast<long>(size()) - insts;
+  it->bytes += heapInUse() - bytes;
+  ++it->runs;
+  return changed;
+}
+
+auto PassManager::reportTimings() const -> void {
+  auto sorted = timings;
+  std::ranges::stable_sort(sorted, std::greater<>(), &Timing::seconds);
+  double total = 0;
+  for (const auto &timing : sorted) {
+    total += timing.seconds;
+  }
+
+  fmt::print(stderr, "===- Pass execution timing report -===\n");
+  fmt::print(stderr, "  Total: {:.4f} s\n\n", total);
+  fmt::print(stderr, "  {:>9}  {:>6}  {:>9}  {:>11}  {:>5}  {}\n", "Wall (s)",
+             "%", "Insts", "Heap (KiB)", "Runs", "Pass");
+  for (const auto &[name, seconds, insts, bytes, runs] : sorted) {
+    fmt::print(stderr, "  {:>9.4f}  {:>5.1f}%  {:>+9}  {:>+11}  {:>5}  {}\n",
+               seconds, total > 0 ? 100 * seconds / total : 0.0, insts,
+               bytes / 1024, runs, name);
+  }
+}
+
+auto opt::optimize(Module &module, const Options &options) -> void {
+  PassManager manager(options);
+  manager.addPipeline(options.passes.empty() ? presetPipeline(options.level)
+                                             : options.passes);
+  manager.run(module);
+}
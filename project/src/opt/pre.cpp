@@ -0,0 +1,469 @@
+/**
+ * @file pre.cpp
+ * @brief Partial redundancy elimination by lazy code motion.
+ *
+ * An expression is partially redundant when it was already computed on some
+ * but not all paths reaching it, such as an address computed in the `then`
+ * arm and again after the `if`. Lazy code motion (Knoop, Rüthing and
+ * Steffen, in the edge-based form of Drechsler and Stadel) inserts it on
+ * the edges where it is missing, which makes the later copy fully redundant
+ * and lets it be deleted. A computation inside a loop whose operands are
+ * defined outside is redundant along the back edge, so loop-invariant code
+ * moves to the entering edge as a special case.
+ *
+ * ### Expressions
+ * Two instructions compute the same expression when they have the same
+ * operator and the very same operands. Only arithmetic and address
+ * computations move; `div` / `mod` may trap and stay where they are. Copies
+ * within one block are merged first, so a block holds at most one
+ * computation of each expression.
+ *
+ * ### Placement
+ * Per expression, four dataflow problems run over the CFG: availability,
+ * anticipability, the earliest edges an insertion is safe on, and how far
+ * it can be delayed from there. Insertions go on the latest of those edges,
+ * so the new values live as briefly as possible and register pressure does
+ * not grow beyond what the deleted copies needed. An insertion lands at the
+ * end of the edge's source if that only jumps, and otherwise in a new block
+ * splitting the edge.
+ *
+ * ### Rewriting
+ * A deleted copy is replaced by the value reaching its block, built on
+ * demand: a single predecessor passes on its own value, a merge gets a
+ * block parameter, and parameters whose incoming values all agree are
+ * folded away (Braun et al., "Simple and Efficient Construction of SSA
+ * Form").
+ */
+
+module;
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Identifies an expression: the operator and the operand values.
+ */
+using ExprKey = std::tuple<Op, BinOp, Value *, Value *>;
+
+auto isCandidate(const Value *inst) -> bool {
+  if (inst->op == Op::GetElemPtr || inst->op == Op::GetPtr) {
+    return true;
+  }
+  return inst->op == Op::Binary && inst->binop != BinOp::Div &&
+         inst->binop != BinOp::Mod;
+}
+
+auto keyOf(const Value *inst) -> ExprKey {
+  auto binop = inst->op == Op::Binary ? inst->binop : BinOp::Add;
+  return {inst->op, binop, inst->operands[0], inst->operands[1]};
+}
+
+/**
+ * @brief Replaces repeated computations within each block by the first one.
+ */
+auto mergeLocalCopies(Function &func) -> bool {
+  std::unordered_map<Value *, Value *> replaced;
+  for (auto &bb : func.blocks) {
+    std::map<ExprKey, Value *> seen;
+    for (auto &inst : bb->insts) {
+      // operands may be copies merged a moment ago
+      for (auto &use : inst->operands) {
+        if (auto it = replaced.find(use); it != replaced.end()) {
+          use = it->second;
+        }
+      }
+      if (!isCandidate(inst.get())) {
+        continue;
+      }
+      auto [it, added] = seen.try_emplace(keyOf(inst.get()), inst.get());
+      if (!added) {
+        replaced[inst.get()] = it->second;
+      }
+    }
+  }
+  if (replaced.empty()) {
+    return false;
+  }
+  replaceAllUses(func, replaced);
+  for (auto [inst, _] : replaced) {
+    inst->parent->erase(inst);
+  }
+  return true;
+}
+
+/**
+ * @brief The CFG as seen by the dataflow problems: reachable blocks in
+ * reverse post-order, with edges as indices into it.
+ */
+struct Graph {
+  std::vector<BasicBlock *> blocks;
+  std::unordered_map<const BasicBlock *, int> index;
+  /// Per block, the targets of its terminator's edges, in edge order.
+  std::vector<std::vector<int>> succs;
+  /// Per block, the incoming edges as (source block, edge number).
+  std::vector<std::vector<std::pair<int, int>>> preds;
+
+  explicit Graph(const Function &func) : blocks(reversePostOrder(func)) {
+    for (int b = 0; b < std::ssize(blocks); ++b) {
+      index[blocks[b]] = b;
+    }
+    succs.resize(blocks.size());
+    preds.resize(blocks.size());
+    for (int b = 0; b < std::ssize(blocks); ++b) {
+      auto targets = blocks[b]->succs();
+      for (int k = 0; k < std::ssize(targets); ++k) {
+        int t = index.at(targets[k]);
+        succs[b].push_back(t);
+        preds[t].emplace_back(b, k);
+      }
+    }
+  }
+};
+
+/**
+ * @brief Where one expression is inserted and deleted.
+ */
+struct Motion {
+  Value *sample = nullptr;                ///< A computation to copy.
+  std::vector<std::pair<int, int>> edges; ///< Insertions, (block, edge).
+  std::vector<Value *> deleted;           ///< Redundant computations.
+};
+
+/**
+ * @brief Solves lazy code motion for the expression computed by `occ`
+ * (block index to its computation there).
+ */
+auto placeExpression(const Graph &graph,
+                     const std::unordered_map<int, Value *> &occ) -> Motion {
+  auto n = graph.blocks.size();
+  std::vector<char> transp(n, 1);
+  std::vector<char> antloc(n, 0);
+  std::vector<char> comp(n, 0);
+
+  auto sample = occ.begin()->second;
+  for (auto val : sample->operands) {
+    // an operand is defined in its block: by an instruction or a parameter
+    if ((val->isInst() || val->op == Op::BlockArg) &&
+        graph.index.contains(val->parent)) {
+      transp[graph.index.at(val->parent)] = 0;
+    }
+  }
+  for (auto [b, inst] : occ) {
+    comp[b] = 1;
+    antloc[b] = transp[b];
+  }
+
+  // availability, forward
+  std::vector<char> avout(n, 1);
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t b = 0; b < n; ++b) {
+      char in = b != 0;
+      for (auto [p, _] : graph.preds[b]) {
+        in &= avout[p];
+      }
+      char out = comp[b] | (in & transp[b]);
+      changed |= out != avout[b];
+      avout[b] = out;
+    }
+  }
+
+  // anticipability, backward
+  std::vector<char> antin(n, 1);
+  std::vector<char> antout(n, 1);
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t b = n; b-- > 0;) {
+      char out = !graph.succs[b].empty();
+      for (auto s : graph.succs[b]) {
+        out &= antin[s];
+      }
+      char in = antloc[b] | (out & transp[b]);
+      changed |= out != antout[b] || in != antin[b];
+      antout[b] = out;
+      antin[b] = in;
+    }
+  }
+
+  auto earliest = [&](int i, int j) -> char {
+    return antin[j] & !avout[i] & (!transp[i] | !antout[i]);
+  };
+  // the entry acts as if entered by an edge the expression is earliest on
+  std::vector<char> laterin(n, 1);
+  laterin[0] = antin[0];
+  auto later = [&](int i, int j) -> char {
+    return earliest(i, j) | (laterin[i] & !antloc[i]);
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t b = 1; b < n; ++b) {
+      char in = 1;
+      for (auto [p, _] : graph.preds[b]) {
+        in &= later(p, static_cast<int>(b));
+      }
+      changed |= in != laterin[b];
+      laterin[b] = in;
+    }
+  }
+
+  Motion res{.sample = sample};
+  for (size_t b = 1; b < n; ++b) {
+    if (antloc[b] && !laterin[b]) {
+      res.deleted.push_back(occ.at(static_cast<int>(b)));
+    }
+  }
+  if (res.deleted.empty()) {
+    return res;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    for (int k = 0; k < std::ssize(graph.succs[i]); ++k) {
+      int j = graph.succs[i][k];
+      if (later(static_cast<int>(i), j) && !laterin[j]) {
+        res.edges.emplace_back(static_cast<int>(i), k);
+      }
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief Builds the value of one expression reaching each block.
+ */
+class ValueBuilder {
+public:
+  ValueBuilder(
+      Module &_module,
+      const std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> &_preds,
+      std::unordered_map<const BasicBlock *, Value *> _defs)
+      : module(_module), preds(_preds), defs(std::move(_defs)) {}
+
+  /**
+   * @brief The value at the end of `bb`.
+   */
+  auto valueOut(BasicBlock *bb) -> Value * {
+    if (auto it = defs.find(bb); it != defs.end()) {
+      return it->second;
+    }
+    return valueIn(bb);
+  }
+
+  /**
+   * @brief The value at the start of `bb`.
+   */
+  auto valueIn(BasicBlock *bb) -> Value * {
+    if (auto it = entries.find(bb); it != entries.end()) {
+      return it->second;
+    }
+    const auto &incoming = preds.at(bb);
+    if (incoming.size() == 1) {
+      return entries[bb] = valueOut(incoming[0]);
+    }
+
+    // registered first, so that loops find it
+    auto param = bb->addParam(sampleType());
+    entries[bb] = param;
+    params.push_back(param);
+    for (auto pred : unique(incoming)) {
+      auto val = reachable(pred) ? valueOut(pred)
+                                 : module.getUndef(param->ty);
+      for (auto &edge : pred->terminator()->edges) {
+        if (edge.target == bb) {
+          edge.args.push_back(val);
+        }
+      }
+    }
+    return param;
+  }
+
+  /**
+   * @brief Maps the parameters whose incoming values all agree to that
+   * value, so that `replaceAllUses` can fold them.
+   */
+  auto trivialParams(std::unordered_map<Value *, Value *> &mapping) -> void {
+    auto resolve = [&](Value *val) {
+      for (auto it = mapping.find(val); it != mapping.end();
+           it = mapping.find(val)) {
+        val = it->second;
+      }
+      return val;
+    };
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto param : params) {
+        if (mapping.contains(param)) {
+          continue;
+        }
+        Value *same = nullptr;
+        bool trivial = true;
+        for (auto pred : unique(preds.at(param->parent))) {
+          for (const auto &edge : pred->terminator()->edges) {
+            if (edge.target != param->parent) {
+              continue;
+            }
+            auto val = resolve(edge.args[param->imm]);
+            if (val == param || val == same || val->op == Op::Undef) {
+              continue;
+            }
+            trivial &= same == nullptr;
+            same = val;
+          }
+        }
+        if (trivial && same) {
+          mapping[param] = same;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  std::unordered_set<const BasicBlock *> live; ///< Blocks reached from entry.
+  Value *sample = nullptr;
+
+private:
+  Module &module;
+  const std::unordered_map<BasicBlock *, std::vector<BasicBlock *>> &preds;
+  std::unordered_map<const BasicBlock *, Value *> defs;
+  std::unordered_map<const BasicBlock *, Value *> entries;
+  std::vector<Value *> params;
+
+  auto sampleType() const { return sample->ty; }
+  auto reachable(const BasicBlock *bb) const -> bool {
+    return live.contains(bb);
+  }
+
+  static auto unique(const std::vector<BasicBlock *> &blocks)
+      -> std::vector<BasicBlock *> {
+    std::vector<BasicBlock *> res;
+    std::unordered_set<BasicBlock *> seen;
+    for (auto bb : blocks) {
+      if (seen.insert(bb).second) {
+        res.push_back(bb);
+      }
+    }
+    return res;
+  }
+};
+
+} // namespace
+
+auto opt::eliminatePartialRedundancies(Function &func, AnalysisManager &am)
+    -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  bool changed = mergeLocalCopies(func);
+  const auto &loops = am.loops(func);
+  Graph graph(func);
+
+  // expressions in order of first appearance, with their computations
+  std::map<ExprKey, int> ids;
+  std::vector<std::unordered_map<int, Value *>> occs;
+  for (int b = 0; b < std::ssize(graph.blocks); ++b) {
+    for (auto &inst : graph.blocks[b]->insts) {
+      if (!isCandidate(inst.get())) {
+        continue;
+      }
+      auto [it, added] = ids.try_emplace(keyOf(inst.get()), occs.size());
+      if (added) {
+        occs.emplace_back();
+      }
+      occs[it->second][b] = inst.get();
+    }
+  }
+
+  std::vector<Motion> motions;
+  for (const auto &occ : occs) {
+    // a lone computation outside loops is redundant with nothing
+    auto [b, inst] = *occ.begin();
+    if (occ.size() == 1 && !loops.loopFor(graph.blocks[b])) {
+      continue;
+    }
+    auto motion = placeExpression(graph, occ);
+    if (!motion.deleted.empty()) {
+      motions.push_back(std::move(motion));
+    }
+  }
+  if (motions.empty()) {
+    return changed;
+  }
+
+  // split the edges that receive code, once for all expressions
+  std::map<std::pair<int, int>, BasicBlock *> splits;
+  auto insertionBlock = [&](std::pair<int, int> edge) -> BasicBlock * {
+    auto src = graph.blocks[edge.first];
+    if (src->terminator()->op == Op::Jump) {
+      return src;
+    }
+    auto &block = splits[edge];
+    if (!block) {
+      auto &out = src->terminator()->edges[edge.second];
+      block = func.newBlock("pre_edge", out.target);
+      block->append(makeJump(out.target, std::move(out.args)));
+      out = Edge{block, {}};
+    }
+    return block;
+  };
+  std::vector<std::vector<BasicBlock *>> targets;
+  for (const auto &motion : motions) {
+    auto &blocks = targets.emplace_back();
+    for (auto edge : motion.edges) {
+      blocks.push_back(insertionBlock(edge));
+    }
+  }
+
+  auto preds = func.preds();
+  std::unordered_set<const BasicBlock *> live(graph.blocks.begin(),
+                                              graph.blocks.end());
+  for (auto [_, block] : splits) {
+    live.insert(block);
+  }
+  std::unordered_map<Value *, Value *> replaced;
+  for (size_t m = 0; m < motions.size(); ++m) {
+    const auto &motion = motions[m];
+    std::unordered_set<const Value *> deleted(motion.deleted.begin(),
+                                              motion.deleted.end());
+    // the computations that remain, plus the inserted ones
+    std::unordered_map<const BasicBlock *, Value *> defs;
+    auto key = keyOf(motion.sample);
+    for (auto bb : graph.blocks) {
+      for (auto &inst : bb->insts) {
+        if (isCandidate(inst.get()) && keyOf(inst.get()) == key &&
+            !deleted.contains(inst.get())) {
+          defs[bb] = inst.get();
+        }
+      }
+    }
+    for (auto bb : targets[m]) {
+      defs[bb] = bb->insertBeforeTerminator(cloneInst(*motion.sample));
+    }
+
+    ValueBuilder builder(*func.parent, preds, std::move(defs));
+    builder.live = live;
+    builder.sample = motion.sample;
+    for (auto inst : motion.deleted) {
+      replaced[inst] = builder.valueIn(inst->parent);
+    }
+    builder.trivialParams(replaced);
+  }
+
+  replaceAllUses(func, replaced);
+  for (auto [inst, _] : replaced) {
+    if (inst->op != Op::BlockArg) {
+      inst->parent->erase(inst);
+    }
+  }
+  return true;
+}
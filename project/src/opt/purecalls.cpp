@@ -0,0 +1,117 @@
+/**
+ * @file purecalls.cpp
+ * @brief Removal of redundant calls to functions without side effects.
+ *
+ * `SideEffectInfo` tells which callees can neither write memory nor perform
+ * I/O. For those:
+ * - A call whose result is unused is deleted (pure and read-only callees).
+ * - A call to a pure callee with the same arguments as a call dominating it
+ *   reuses that call's result. The dominator tree is walked depth-first with
+ *   a scoped table, so only calls on the path from the entry are visible.
+ */
+
+module;
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+class PureCallElimination {
+public:
+  PureCallElimination(Function &_func, const SideEffectInfo &_effects)
+      : func(_func), effects(_effects) {}
+
+  auto run() -> bool {
+    DominatorTree domTree(func);
+    visit(domTree, func.entry());
+
+    auto users = collectUsers(func);
+    for (auto &bb : func.blocks) {
+      std::erase_if(bb->insts, [&](const auto &inst) {
+        bool dead = inst->op == Op::Call &&
+                    !effects.writesMemory(inst->callee) &&
+                    !users.contains(inst.get());
+        changed |= dead;
+        return dead;
+      });
+    }
+    return changed;
+  }
+
+private:
+  using Key = std::pair<const Function *, std::vector<Value *>>;
+
+  Function &func;
+  const SideEffectInfo &effects;
+  std::map<Key, Value *> available;
+  std::vector<std::unique_ptr<Value>> erased;
+  bool changed = false;
+
+  auto visit(const DominatorTree &domTree, BasicBlock *bb) -> void {
+    std::vector<Key> scope;
+    // arguments are usually fresh loads of the same variable, so a reload of
+    // an address not written since is keyed as the first load in the block
+    std::unordered_map<Value *, Value *> loads;
+    std::unordered_map<Value *, Value *> same;
+    for (auto it = bb->insts.begin(); it != bb->insts.end();) {
+      auto inst = (it++)->get();
+      if (inst->op == Op::Load) {
+        auto [pos, inserted] = loads.try_emplace(inst->operands[0], inst);
+        same[inst] = pos->second;
+        continue;
+      }
+      if (inst->op == Op::Store ||
+          (inst->op == Op::Call && effects.writesMemory(inst->callee))) {
+        loads.clear();
+      }
+      if (inst->op != Op::Call || !effects.isPure(inst->callee)) {
+        continue;
+      }
+      Key key{inst->callee, {}};
+      for (auto arg : inst->operands) {
+        auto pos = same.find(arg);
+        key.second.push_back(pos == same.end() ? arg : pos->second);
+      }
+      auto [pos, inserted] = available.try_emplace(key, inst);
+      if (inserted) {
+        scope.push_back(std::move(key));
+        continue;
+      }
+      replaceAllUses(func, inst, pos->second);
+      erased.push_back(bb->detach(inst));
+      changed = true;
+    }
+
+    for (auto child : domTree.children(bb)) {
+      visit(domTree, child);
+    }
+    for (const auto &key : scope) {
+      available.erase(key);
+    }
+  }
+};
+
+} // namespace
+
+auto opt::eliminatePureCalls(Module &module) -> bool {
+  CallGraph calls(module);
+  SideEffectInfo effects(calls);
+  bool changed = false;
+  for (auto &func : module.funcs) {
+    if (!func->isDecl()) {
+      changed |= PureCallElimination(*func, effects).run();
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,253 @@
+/**
+ * @file reader.cpp
+ * @brief Lifts a libkoopa raw program into the mutable optimizer IR.
+ *
+ * The raw program is a read-only graph of C structs. Lifting happens in two
+ * rounds so that forward references (calls to later functions, jumps to later
+ * blocks) resolve naturally:
+ * 1. Create shells for globals, functions, parameters, blocks and
+ *    instructions, recording the raw -> lifted mapping.
+ * 2. Fill in operands, edges and callees through that mapping.
+ */
+
+module;
+
+#include "koopa.h"
+#include <cassert>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+module opt.ir;
+
+import ir.type;
+import log;
+
+using namespace opt;
+
+namespace {
+
+template <typename ptrType> auto make_span(const koopa_raw_slice_t &slice) {
+  return std::span<const ptrType>(
+      reinterpret_cast<const ptrType *>(slice.buffer), slice.len);
+}
+
+auto liftType(koopa_raw_type_t ty) -> std::shared_ptr<type::Type> {
+  switch (ty->tag) {
+  case KOOPA_RTT_INT32: return type::IntType::get();
+  case KOOPA_RTT_UNIT: return type::VoidType::get();
+  case KOOPA_RTT_ARRAY:
+    return type::ArrayType::get(liftType(ty->data.array.base),
+                                static_cast<int>(ty->data.array.len));
+  case KOOPA_RTT_POINTER:
+    return type::PtrType::get(liftType(ty->data.pointer.base));
+  default: Log::panic("Optimizer Error: unexpected function type in value");
+  }
+  return nullptr;
+}
+
+auto liftBinOp(koopa_raw_binary_op_t op) -> BinOp {
+  // clang-format off
+  switch (op) {
+  case KOOPA_RBO_NOT_EQ: return BinOp::Ne;
+  case KOOPA_RBO_EQ:     return BinOp::Eq;
+  case KOOPA_RBO_GT:     return BinOp::Gt;
+  case KOOPA_RBO_LT:     return BinOp::Lt;
+  case KOOPA_RBO_GE:     return BinOp::Ge;
+  case KOOPA_RBO_LE:     return BinOp::Le;
+  case KOOPA_RBO_ADD:    return BinOp::Add;
+  case KOOPA_RBO_SUB:    return BinOp::Sub;
+  case KOOPA_RBO_MUL:    return BinOp::Mul;
+  case KOOPA_RBO_DIV:    return BinOp::Div;
+  case KOOPA_RBO_MOD:    return BinOp::Mod;
+  case KOOPA_RBO_AND:    return BinOp::And;
+  case KOOPA_RBO_OR:     return BinOp::Or;
+  case KOOPA_RBO_XOR:    return BinOp::Xor;
+  case KOOPA_RBO_SHL:    return BinOp::Shl;
+  case KOOPA_RBO_SHR:    return BinOp::Shr;
+  case KOOPA_RBO_SAR:    return BinOp::Sar;
+  }
+  // clang-format on
+  return BinOp::Add;
+}
+
+/**
+ * @brief Holds the raw -> lifted mappings while a program is being lifted.
+ */
+class Lifter {
+public:
+  explicit Lifter(Module &_module) : module(_module) {}
+
+  auto run(const koopa_raw_program_t &raw) -> void {
+    for (const auto value : make_span<koopa_raw_value_t>(raw.values)) {
+      auto global =
+          std::make_unique<Value>(Op::GlobalAlloc, liftType(value->ty));
+      global->name = value->name;
+      values[value] = global.get();
+      module.globals.push_back(std::move(global));
+    }
+    for (const auto value : make_span<koopa_raw_value_t>(raw.values)) {
+      values[value]->operands = {lift(value->kind.data.global_alloc.init)};
+    }
+
+    for (const auto func : make_span<koopa_raw_function_t>(raw.funcs)) {
+      createShell(func);
+    }
+    for (const auto func : make_span<koopa_raw_function_t>(raw.funcs)) {
+      fillBody(func);
+    }
+  }
+
+private:
+  Module &module;
+  std::unordered_map<koopa_raw_value_t, Value *> values;
+  std::unordered_map<koopa_raw_basic_block_t, BasicBlock *> blocks;
+  std::unordered_map<koopa_raw_function_t, Function *> funcs;
+
+  auto createShell(koopa_raw_function_t raw) -> void {
+    const auto &fty = raw->ty->data.function;
+    auto func = std::make_unique<Function>(raw->name, liftType(fty.ret));
+    func->parent = &module;
+
+    // declarations carry no parameter values, only parameter types
+    if (raw->bbs.len == 0) {
+      for (const auto ty : make_span<koopa_raw_type_t>(fty.params)) {
+        func->params.push_back(std::make_unique<Value>(Op::FuncArg, liftType(ty)));
+      }
+    }
+    for (const auto param : make_span<koopa_raw_value_t>(raw->params)) {
+      auto arg = std::make_unique<Value>(Op::FuncArg, liftType(param->ty));
+      arg->name = param->name ? param->name : "";
+      arg->imm = static_cast<int>(param->kind.data.func_arg_ref.index);
+      values[param] = arg.get();
+      func->params.push_back(std::move(arg));
+    }
+
+    for (const auto bb : make_span<koopa_raw_basic_block_t>(raw->bbs)) {
+      auto block = std::make_unique<BasicBlock>(bb->name ? bb->name : "");
+      block->parent = func.get();
+      for (const auto param : make_span<koopa_raw_value_t>(bb->params)) {
+        values[param] = block->addParam(liftType(param->ty));
+      }
+      for (const auto inst : make_span<koopa_raw_value_t>(bb->insts)) {
+        values[inst] = block->append(createInst(inst));
+      }
+      blocks[bb] = block.get();
+      func->blocks.push_back(std::move(block));
+    }
+
+    funcs[raw] = func.get();
+    module.funcs.push_back(std::move(func));
+  }
+
+  auto createInst(koopa_raw_value_t raw) -> std::unique_ptr<Value> {
+    Op op = Op::Integer;
+    // clang-format off
+    switch (raw->kind.tag) {
+    case KOOPA_RVT_ALLOC:        op = Op::Alloc;      break;
+    case KOOPA_RVT_LOAD:         op = Op::Load;       break;
+    case KOOPA_RVT_STORE:        op = Op::Store;      break;
+    case KOOPA_RVT_GET_PTR:      op = Op::GetPtr;     break;
+    case KOOPA_RVT_GET_ELEM_PTR: op = Op::GetElemPtr; break;
+    case KOOPA_RVT_BINARY:       op = Op::Binary;     break;
+    case KOOPA_RVT_CALL:         op = Op::Call;       break;
+    case KOOPA_RVT_BRANCH:       op = Op::Branch;     break;
+    case KOOPA_RVT_JUMP:         op = Op::Jump;       break;
+    case KOOPA_RVT_RETURN:       op = Op::Return;     break;
+    default: Log::panic("Optimizer Error: unexpected value in instruction list");
+    }
+    // clang-format on
+    auto inst = std::make_unique<Value>(op, liftType(raw->ty));
+    inst->name = raw->name ? raw->name : "";
+    return inst;
+  }
+
+  auto fillBody(koopa_raw_function_t raw) -> void {
+    for (const auto bb : make_span<koopa_raw_basic_block_t>(raw->bbs)) {
+      for (const auto inst : make_span<koopa_raw_value_t>(bb->insts)) {
+        fillInst(values[inst], inst->kind);
+      }
+    }
+  }
+
+  auto fillInst(Value *inst, const koopa_raw_value_kind_t &kind) -> void {
+    const auto &data = kind.data;
+    switch (kind.tag) {
+    case KOOPA_RVT_LOAD: inst->operands = {lift(data.load.src)}; break;
+    case KOOPA_RVT_STORE:
+      inst->operands = {lift(data.store.value), lift(data.store.dest)};
+      break;
+    case KOOPA_RVT_GET_PTR:
+      inst->operands = {lift(data.get_ptr.src), lift(data.get_ptr.index)};
+      break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+      inst->operands = {lift(data.get_elem_ptr.src),
+                        lift(data.get_elem_ptr.index)};
+      break;
+    case KOOPA_RVT_BINARY:
+      inst->binop = liftBinOp(data.binary.op);
+      inst->operands = {lift(data.binary.lhs), lift(data.binary.rhs)};
+      break;
+    case KOOPA_RVT_CALL:
+      inst->callee = funcs.at(data.call.callee);
+      inst->operands = liftAll(data.call.args);
+      break;
+    case KOOPA_RVT_BRANCH:
+      inst->operands = {lift(data.branch.cond)};
+      inst->edges = {
+          Edge{blocks.at(data.branch.true_bb), liftAll(data.branch.true_args)},
+          Edge{blocks.at(data.branch.false_bb),
+               liftAll(data.branch.false_args)}};
+      break;
+    case KOOPA_RVT_JUMP:
+      inst->edges = {
+          Edge{blocks.at(data.jump.target), liftAll(data.jump.args)}};
+      break;
+    case KOOPA_RVT_RETURN:
+      if (data.ret.value) {
+        inst->operands = {lift(data.ret.value)};
+      }
+      break;
+    default: break;
+    }
+  }
+
+  auto liftAll(const koopa_raw_slice_t &slice) -> std::vector<Value *> {
+    std::vector<Value *> res;
+    for (const auto value : make_span<koopa_raw_value_t>(slice)) {
+      res.push_back(lift(value));
+    }
+    return res;
+  }
+
+  /**
+   * @brief Maps a raw operand to its lifted value, creating constants on
+   * demand.
+   */
+  auto lift(koopa_raw_value_t raw) -> Value * {
+    if (auto it = values.find(raw); it != values.end()) {
+      return it->second;
+    }
+    const auto &kind = raw->kind;
+    switch (kind.tag) {
+    case KOOPA_RVT_INTEGER: return module.getInt(kind.data.integer.value);
+    case KOOPA_RVT_ZERO_INIT: return module.getZeroInit(liftType(raw->ty));
+    case KOOPA_RVT_UNDEF: return module.getUndef(liftType(raw->ty));
+    case KOOPA_RVT_AGGREGATE:
+      return module.getAggregate(liftType(raw->ty),
+                                 liftAll(kind.data.aggregate.elems));
+    default:
+      Log::panic("Optimizer Error: operand refers to an unknown value");
+    }
+    return nullptr;
+  }
+};
+
+} // namespace
+
+auto Module::fromRaw(const koopa_raw_program_t &raw) -> std::unique_ptr<Module> {
+  auto module = std::make_unique<Module>();
+  Lifter(*module).run(raw);
+  return module;
+}
@@ -0,0 +1,320 @@
+/**
+ * @file simplifycfg.cpp
+ * @brief CFG simplification and jump threading.
+ *
+ * The front end lays out control flow very literally: every `if` gets an
+ * `%end_N` block, nested statements produce chains of blocks that contain
+ * nothing but a `jump`, and the result of `&&` / `||` is stored to memory
+ * only to be reloaded and branched on right away. This pass cleans that up
+ * with four rewrites, repeated until a fixpoint is reached:
+ *
+ * 1. **Branch folding**: `br 1, %a, %b` and `br %c, %a, %a` become `jump`.
+ * 2. **Forwarding**: an edge into a block that only holds `jump %t(...)` is
+ *    redirected to `%t` directly.
+ * 3. **Jump threading**: if a block only computes its branch condition
+ *    (from block arguments or loads) and that condition is a known constant
+ *    on some incoming edge, the edge is redirected to the branch target.
+ * 4. **Merging**: a block whose single successor has no other predecessor
+ *    absorbs that successor.
+ */
+
+module;
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Turns `br` with a constant condition or with two identical edges
+ * into `jump`.
+ */
+auto foldBranches(Function &func) -> bool {
+  bool changed = false;
+  for (auto &bb : func.blocks) {
+    auto term = bb->terminator();
+    if (!term || term->op != Op::Branch) {
+      continue;
+    }
+
+    std::optional<size_t> taken;
+    if (auto cond = term->operands[0]; cond->isInt()) {
+      taken = cond->imm != 0 ? 0 : 1;
+    } else if (term->edges[0].target == term->edges[1].target &&
+               term->edges[0].args == term->edges[1].args) {
+      taken = 0;
+    }
+    if (!taken) {
+      continue;
+    }
+
+    auto edge = std::move(term->edges[*taken]);
+    bb->erase(term);
+    bb->append(makeJump(edge.target, std::move(edge.args)));
+    changed = true;
+  }
+  return changed;
+}
+
+/**
+ * @brief Redirects `edge` past its target, continuing along `next` (an edge
+ * leaving that target). Arguments referring to the skipped block's
+ * parameters are replaced by the values `edge` binds to them.
+ */
+auto bypass(Edge &edge, const Edge &next) -> void {
+  std::vector<Value *> args;
+  for (auto arg : next.args) {
+    if (arg->op == Op::BlockArg && arg->parent == edge.target) {
+      args.push_back(edge.args[arg->imm]);
+    } else {
+      args.push_back(arg);
+    }
+  }
+  edge = Edge{next.target, std::move(args)};
+}
+
+auto forwardEmptyBlocks(Function &func) -> bool {
+  // bounds the walk through cycles of empty blocks
+  constexpr int max_hops = 8;
+
+  bool changed = false;
+  for (auto &bb : func.blocks) {
+    auto term = bb->terminator();
+    if (!term) {
+      continue;
+    }
+    for (auto &edge : term->edges) {
+      for (int hop = 0; hop < max_hops; ++hop) {
+        auto &target = edge.target->insts;
+        if (target.size() != 1 || target.front()->op != Op::Jump) {
+          break;
+        }
+        const auto &next = target.front()->edges[0];
+        if (next.target == edge.target) {
+          break;
+        }
+        bypass(edge, next);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+/**
+ * @brief Finds the constant most recently stored to `ptr` at the end of
+ * `bb`, giving up at anything that might write it in between.
+ */
+auto storedConstant(BasicBlock *bb, Value *ptr) -> std::optional<int> {
+  auto isObject = [](Value *val) {
+    return val->op == Op::Alloc || val->op == Op::GlobalAlloc;
+  };
+  for (auto it = bb->insts.rbegin(); it != bb->insts.rend(); ++it) {
+    auto inst = it->get();
+    if (inst->op == Op::Call) {
+      return std::nullopt;
+    }
+    if (inst->op != Op::Store) {
+      continue;
+    }
+    auto dest = inst->operands[1];
+    if (dest == ptr) {
+      auto val = inst->operands[0];
+      return val->isInt() ? std::optional(val->imm) : std::nullopt;
+    }
+    // distinct allocations never overlap; anything else might
+    if (!isObject(dest) || !isObject(ptr)) {
+      return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Evaluates `val` as if control entered `edge.target` through `edge`
+ * coming from `pred`.
+ */
+auto evalOnEdge(Value *val, BasicBlock *pred, const Edge &edge)
+    -> std::optional<int> {
+  if (val->isInt()) {
+    return val->imm;
+  }
+  if (val->parent != edge.target) {
+    return std::nullopt;
+  }
+  if (val->op == Op::BlockArg) {
+    auto arg = edge.args[val->imm];
+    return arg->isInt() ? std::optional(arg->imm) : std::nullopt;
+  }
+  if (val->op == Op::Load) {
+    return storedConstant(pred, val->operands[0]);
+  }
+  if (val->op == Op::Binary) {
+    auto lhs = evalOnEdge(val->operands[0], pred, edge);
+    auto rhs = evalOnEdge(val->operands[1], pred, edge);
+    int res = 0;
+    if (lhs && rhs && foldBinary(val->binop, *lhs, *rhs, res)) {
+      return res;
+    }
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief Whether `bb` only computes its branch condition, judging by its
+ * instructions alone.
+ */
+auto isThreadable(BasicBlock *bb, Function &func) -> bool {
+  // keeps the duplicated evaluation cheap
+  constexpr size_t max_insts = 4;
+
+  auto term = bb->terminator();
+  if (bb == func.entry() || !term || term->op != Op::Branch ||
+      bb->insts.size() > max_insts) {
+    return false;
+  }
+  for (const auto &edge : term->edges) {
+    if (edge.target == bb) {
+      return false;
+    }
+    for (auto arg : edge.args) {
+      if (arg->isInst() && arg->parent == bb) {
+        return false;
+      }
+    }
+  }
+  for (const auto &inst : bb->insts) {
+    if (inst.get() != term && inst->op != Op::Load &&
+        inst->op != Op::Binary) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Finds the blocks that can be skipped on some incoming edges: they
+ * only compute their branch condition, and no value computed there is needed
+ * past the block.
+ */
+auto findThreadableBlocks(Function &func) -> std::unordered_set<BasicBlock *> {
+  std::unordered_set<BasicBlock *> res;
+  for (auto &bb : func.blocks) {
+    if (isThreadable(bb.get(), func)) {
+      res.insert(bb.get());
+    }
+  }
+  if (res.empty()) {
+    return res;
+  }
+  for (auto &bb : func.blocks) {
+    for (auto &inst : bb->insts) {
+      inst->forEachUse([&](Value *use) {
+        bool local = use->isInst() || use->op == Op::BlockArg;
+        if (local && use->parent != bb.get()) {
+          res.erase(use->parent);
+        }
+      });
+    }
+  }
+  return res;
+}
+
+auto threadJumps(Function &func) -> bool {
+  auto threadable = findThreadableBlocks(func);
+  if (threadable.empty()) {
+    return false;
+  }
+
+  bool changed = false;
+  for (auto &pred : func.blocks) {
+    auto term = pred->terminator();
+    if (!term) {
+      continue;
+    }
+    for (auto &edge : term->edges) {
+      auto bb = edge.target;
+      if (bb == pred.get() || !threadable.contains(bb)) {
+        continue;
+      }
+      auto branch = bb->terminator();
+      auto cond = evalOnEdge(branch->operands[0], pred.get(), edge);
+      if (!cond) {
+        continue;
+      }
+      bypass(edge, branch->edges[*cond != 0 ? 0 : 1]);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+auto mergeBlocks(Function &func) -> bool {
+  auto preds = func.preds();
+
+  bool changed = false;
+  for (auto &bb : func.blocks) {
+    while (true) {
+      auto term = bb->terminator();
+      if (!term || term->op != Op::Jump) {
+        break;
+      }
+      auto succ = term->edges[0].target;
+      if (succ == bb.get() || succ == func.entry() || preds[succ].size() != 1) {
+        break;
+      }
+
+      std::unordered_map<Value *, Value *> mapping;
+      for (const auto &param : succ->params) {
+        mapping[param.get()] = term->edges[0].args[param->imm];
+      }
+      bb->erase(term);
+      for (auto &inst : succ->insts) {
+        inst->parent = bb.get();
+      }
+      bb->insts.splice(bb->insts.end(), succ->insts);
+      if (!mapping.empty()) {
+        replaceAllUses(func, mapping);
+      }
+
+      for (auto next : bb->succs()) {
+        std::ranges::replace(preds[next], succ, bb.get());
+      }
+      func.eraseBlock(succ);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+} // namespace
+
+auto opt::simplifyCFG(Function &func) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+
+  bool changed = false;
+  while (true) {
+    bool round = foldBranches(func);
+    round |= forwardEmptyBlocks(func);
+    round |= threadJumps(func);
+    // merging relies on exact predecessor counts
+    round |= removeUnreachableBlocks(func);
+    round |= mergeBlocks(func);
+    if (!round) {
+      break;
+    }
+    changed = true;
+  }
+  return changed;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file sroa.cpp
+ * @brief Scalar replacement of aggregates.
+ *
+ * A local array whose elements are only reached through `getelemptr`s with
+ * constant, in-bounds indices is never addressed as a whole, so each of its
+ * elements can live in an `alloc i32` of its own. Every element address is
+ * replaced by the matching scalar, and the array and its address
+ * computations are erased, so running the pass again finds nothing to do.
+ *
+ * Arrays with a dynamic index or whose address reaches anything but a
+ * `load` / `store` (a `call`, a `getptr`, a block argument) stay in memory,
+ * and so do arrays with more than `max_elements` elements. Arrays that are
+ * never loaded from or stored to are left for DCE.
+ */
+
+module;
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+constexpr int max_elements = 16;
+
+class ScalarReplacement {
+public:
+  explicit ScalarReplacement(Function &_func)
+      : func(_func), users(collectUsers(_func)) {}
+
+  auto run() -> bool {
+    std::vector<Value *> arrays;
+    for (auto &bb : func.blocks) {
+      for (auto &inst : bb->insts) {
+        if (inst->op == Op::Alloc && isSplittable(inst.get())) {
+          arrays.push_back(inst.get());
+        }
+      }
+    }
+
+    std::unordered_map<Value *, Value *> scalars;
+    for (auto array : arrays) {
+      const auto &slots = addresses.at(array);
+      auto bb = array->parent;
+      auto pos = bb->find(array);
+      for (size_t i = 0; i < slots.size(); ++i) {
+        auto scalar = bb->insert(pos, makeAlloc(type::IntType::get(),
+                                                array->name + "_" +
+                                                    std::to_string(i)));
+        for (auto addr : slots[i]) {
+          scalars[addr] = scalar;
+        }
+      }
+    }
+    replaceAllUses(func, scalars);
+    for (auto array : arrays) {
+      for (auto addr : derived.at(array)) {
+        addr->parent->erase(addr);
+      }
+      array->parent->erase(array);
+    }
+    return !arrays.empty();
+  }
+
+private:
+  Function &func;
+  std::unordered_map<Value *, std::vector<Value *>> users;
+  /// Element addresses of each array, by flat element index.
+  std::unordered_map<const Value *, std::vector<std::vector<Value *>>>
+      addresses;
+  /// The `getelemptr`s derived from each array, users before operands.
+  std::unordered_map<const Value *, std::vector<Value *>> derived;
+
+  auto isSplittable(Value *array) -> bool {
+    auto ty = pointee(array->ty);
+    if (!ty->is_array() || sizeOf(ty) / 4 > max_elements) {
+      return false;
+    }
+    auto &slots = addresses[array];
+    slots.assign(static_cast<size_t>(sizeOf(ty) / 4), {});
+    if (!collect(array, 0, slots, derived[array])) {
+      return false;
+    }
+    return std::ranges::any_of(slots, [&](const auto &addrs) {
+      return std::ranges::any_of(
+          addrs, [&](Value *addr) { return !users[addr].empty(); });
+    });
+  }
+
+  /**
+   * @brief Records the element addresses derived from `ptr`, which points
+   * at flat element `offset` of the array, and appends every address
+   * computation to `geps` after those derived from it.
+   *
+   * @return false if some use of `ptr` needs the array in memory.
+   */
+  auto collect(Value *ptr, int offset,
+               std::vector<std::vector<Value *>> &slots,
+               std::vector<Value *> &geps) -> bool {
+    auto ty = pointee(ptr->ty);
+    for (auto user : users[ptr]) {
+      if (ty->is_int()) {
+        bool access = (user->op == Op::Load) ||
+                      (user->op == Op::Store && user->operands[0] != ptr);
+        if (!access) {
+          return false;
+        }
+        continue;
+      }
+      auto arr = std::dynamic_pointer_cast<type::ArrayType>(ty);
+      auto index = user->operands.size() > 1 ? user->operands[1] : nullptr;
+      if (user->op != Op::GetElemPtr || user->operands[0] != ptr ||
+          !index->isInt() || index->imm < 0 || index->imm >= arr->len) {
+        return false;
+      }
+      int stride = sizeOf(arr->base) / 4;
+      if (!collect(user, offset + index->imm * stride, slots, geps)) {
+        return false;
+      }
+      geps.push_back(user);
+    }
+    if (ty->is_int()) {
+      slots[offset].push_back(ptr);
+    }
+    return true;
+  }
+};
+
+} // namespace
+
+auto opt::splitLocalArrays(Function &func) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  return ScalarReplacement(func).run();
+}
@@ -0,0 +1,131 @@
+/**
+ * @file tailrec.cpp
+ * @brief Tail-recursion elimination.
+ *
+ * A call of a function to itself is in tail position when its result (if
+ * any) is returned right away, either by the next instruction or by a block
+ * that does nothing but return. Such a call can reuse the current frame:
+ *
+ * - Everything in the entry block except the `alloc`s moves to a new loop
+ *   header whose block parameters take the place of the function parameters
+ *   (Koopa forbids predecessors of the entry block).
+ * - The entry block jumps to the header, passing the incoming arguments.
+ * - Every tail call becomes a jump to the header, passing its arguments.
+ *
+ * Locals are shared between iterations, so a call is left alone if it
+ * passes the address of one of them: the callee would overwrite the memory
+ * its argument points to.
+ */
+
+module;
+
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief Whether `val` is (an address into) a local of the function.
+ */
+auto isLocalAddress(const Value *val) -> bool {
+  while (val->op == Op::GetPtr || val->op == Op::GetElemPtr) {
+    val = val->operands[0];
+  }
+  return val->op == Op::Alloc;
+}
+
+/**
+ * @brief The `ret` completing the tail call `call`, or nullptr if `call` is
+ * not in tail position.
+ */
+auto tailReturn(const Function &func, Value *call) -> Value * {
+  auto bb = call->parent;
+  auto next = std::next(bb->find(call));
+  if (next == bb->insts.end()) {
+    return nullptr;
+  }
+  auto term = next->get();
+  if (term->op == Op::Jump && term->edges[0].args.empty()) {
+    auto target = term->edges[0].target;
+    if (!target->params.empty() || target->insts.size() != 1) {
+      return nullptr;
+    }
+    term = target->terminator();
+  }
+  if (term->op != Op::Return) {
+    return nullptr;
+  }
+  bool returnsCall = !term->operands.empty() && term->operands[0] == call;
+  return func.retTy->is_void() || returnsCall ? term : nullptr;
+}
+
+} // namespace
+
+auto opt::eliminateTailCalls(Function &func) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+
+  std::vector<Value *> calls;
+  for (auto &bb : func.blocks) {
+    for (auto &inst : bb->insts) {
+      if (inst->op != Op::Call || inst->callee != &func ||
+          !tailReturn(func, inst.get())) {
+        continue;
+      }
+      bool local = false;
+      for (auto arg : inst->operands) {
+        local |= isLocalAddress(arg);
+      }
+      if (!local) {
+        calls.push_back(inst.get());
+      }
+    }
+  }
+  if (calls.empty()) {
+    return false;
+  }
+
+  // the entry keeps its allocs; the rest becomes the loop header
+  auto entry = func.entry();
+  auto header = func.newBlock("tail_entry", func.blocks.size() > 1
+                                                ? std::next(func.blocks.begin())->get()
+                                                : nullptr);
+  std::unordered_map<Value *, Value *> params;
+  std::vector<Value *> args;
+  for (auto &param : func.params) {
+    params[param.get()] = header->addParam(param->ty);
+    args.push_back(param.get());
+  }
+  for (auto it = entry->insts.begin(); it != entry->insts.end();) {
+    auto next = std::next(it);
+    if ((*it)->op != Op::Alloc) {
+      (*it)->parent = header;
+      header->insts.splice(header->insts.end(), entry->insts, it);
+    }
+    it = next;
+  }
+  replaceAllUses(func, params);
+  entry->append(makeJump(header, std::move(args)));
+
+  // a shared return block may still use a call until it becomes unreachable
+  std::vector<std::unique_ptr<Value>> erased;
+  for (auto call : calls) {
+    auto bb = call->parent;
+    auto jump = makeJump(header, call->operands);
+    bb->erase(bb->terminator());
+    erased.push_back(bb->detach(call));
+    bb->append(std::move(jump));
+  }
+  removeUnreachableBlocks(func);
+  return true;
+}
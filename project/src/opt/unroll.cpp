@@ -0,0 +1,527 @@
+/**
+ * @file unroll.cpp
+ * @brief Unrolling of counted loops.
+ *
+ * The front end keeps every variable in memory, so the counter of
+ * `while (i < n) { ...; i = i + 1; }` is an `alloc` that the loop loads and
+ * stores. A loop is *counted* when:
+ * - it is innermost, with a single latch and a single exiting `br`, and its
+ *   header takes no block parameters;
+ * - the exit test is `load @i` (or the value just stored to `@i`) compared
+ *   against a loop-invariant bound;
+ * - `@i` is a private scalar (only loaded and stored) and the loop stores it
+ *   exactly once per iteration, as `load @i` plus a constant step.
+ *
+ * Every transformation is built from *iteration copies*: clones of all loop
+ * blocks whose exit test is either kept or, when its outcome is known,
+ * replaced by a jump to the in-loop successor.
+ * - **Full unrolling**: with a constant start value and bound, the number of
+ *   tests `H` is simulated. If the loop is small enough, `H - 1` iterations
+ *   are peeled and the last test jumps straight out.
+ * - **Partial unrolling**: otherwise `H % factor` iterations are peeled and
+ *   the loop body is replicated `factor` times, keeping only the last test.
+ * - **Runtime unrolling**: with an unknown trip count, a guarded copy runs
+ *   `factor` iterations at a time while `i + (factor - 1) * step` still
+ *   passes the test; the original loop finishes the remaining iterations.
+ */
+
+module;
+
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+namespace {
+
+/// Trip counts beyond this are treated as unknown.
+constexpr int max_simulated_tests = 1 << 16;
+
+/**
+ * @brief A loop whose exit test compares a counter against a bound.
+ */
+struct CountedLoop {
+  // clang-format off
+  const Loop *loop;
+  BasicBlock *preheader;
+  Value *counter;            ///< The `alloc` of the loop counter.
+  Value *branch;             ///< The exit test.
+  size_t exitEdge;           ///< Index of the edge leaving the loop.
+  BinOp pred;                ///< The test reads `counter pred bound`.
+  Value *bound;              ///< Loop invariant.
+  int step;                  ///< Added to the counter once per iteration.
+  bool stepBeforeTest;       ///< The test sees the incremented counter.
+  std::optional<int> init;   ///< Counter value on entry, if constant.
+  size_t size;               ///< Instructions in the loop.
+  // clang-format on
+};
+
+/**
+ * @brief The blocks and values of one iteration copy.
+ */
+struct LoopCopy {
+  std::unordered_map<const BasicBlock *, BasicBlock *> blocks;
+  std::unordered_map<const Value *, Value *> values;
+};
+
+auto swapOperands(BinOp op) -> BinOp {
+  // clang-format off
+  switch (op) {
+  case BinOp::Lt: return BinOp::Gt;
+  case BinOp::Gt: return BinOp::Lt;
+  case BinOp::Le: return BinOp::Ge;
+  case BinOp::Ge: return BinOp::Le;
+  default:        return op;
+  }
+  // clang-format on
+}
+
+auto isComparison(BinOp op) -> bool {
+  return op == BinOp::Ne || op == BinOp::Eq || op == BinOp::Lt ||
+         op == BinOp::Gt || op == BinOp::Le || op == BinOp::Ge;
+}
+
+/**
+ * @brief Evaluates arithmetic on constants, which may not be folded yet.
+ */
+auto constantValue(const Value *val) -> std::optional<int> {
+  if (val->isInt()) {
+    return val->imm;
+  }
+  if (val->op != Op::Binary) {
+    return std::nullopt;
+  }
+  auto lhs = constantValue(val->operands[0]);
+  auto rhs = constantValue(val->operands[1]);
+  int res = 0;
+  if (!lhs || !rhs || !foldBinary(val->binop, *lhs, *rhs, res)) {
+    return std::nullopt;
+  }
+  return res;
+}
+
+/**
+ * @brief Moves the `alloc`s of innermost loops into the entry block, so that
+ * clones of loop blocks keep sharing the same stack slots (the backend gives
+ * each `alloc` one slot per frame anyway).
+ */
+auto hoistAllocs(Function &func, const LoopInfo &loops) -> bool {
+  auto entry = func.entry();
+  bool changed = false;
+  for (auto loop : loops.postOrder()) {
+    if (!loop->subLoops.empty()) {
+      continue;
+    }
+    for (auto bb : loop->blocks) {
+      for (auto it = bb->insts.begin(); it != bb->insts.end();) {
+        auto next = std::next(it);
+        if ((*it)->op == Op::Alloc) {
+          (*it)->parent = entry;
+          entry->insts.splice(entry->insts.begin(), bb->insts, it);
+          changed = true;
+        }
+        it = next;
+      }
+    }
+  }
+  return changed;
+}
+
+class LoopUnroller {
+public:
+  LoopUnroller(Function &_func, AnalysisManager &_am, const Options &_options)
+      : func(_func), am(_am), options(_options) {}
+
+  auto run() -> bool {
+    if (am.loops(func).empty()) {
+      return false;
+    }
+    bool changed = hoistAllocs(func, am.loops(func));
+    auto blocks = func.blocks.size();
+    for (auto loop : am.loops(func).postOrder()) {
+      if (loop->subLoops.empty()) {
+        getOrInsertPreheader(func, *loop);
+      }
+    }
+    if (func.blocks.size() != blocks) {
+      changed = true;
+      am.invalidate(func);
+    }
+
+    const auto &domTree = am.domTree(func);
+    const auto &loops = am.loops(func);
+    InductionInfo ivs(func, loops, domTree);
+    std::vector<CountedLoop> candidates;
+    for (auto loop : loops.postOrder()) {
+      if (!loop->subLoops.empty()) {
+        continue;
+      }
+      if (auto info = analyze(*loop, domTree, ivs)) {
+        candidates.push_back(*info);
+      }
+    }
+    dropEscapingLoops(candidates);
+
+    // innermost loops are disjoint, so they can be rewritten one by one
+    for (const auto &info : candidates) {
+      changed |= unroll(info);
+    }
+    return changed;
+  }
+
+private:
+  Function &func;
+  AnalysisManager &am;
+  const Options &options;
+
+  auto analyze(const Loop &loop, const DominatorTree &domTree,
+               const InductionInfo &ivs) -> std::optional<CountedLoop> {
+    auto exiting = loop.exitingBlocks();
+    auto latches = loop.latches();
+    // the guard and the copies enter the header without arguments
+    if (exiting.size() != 1 || latches.size() != 1 ||
+        !domTree.dominates(exiting[0], latches[0]) ||
+        !loop.header->params.empty()) {
+      return std::nullopt;
+    }
+
+    CountedLoop info{};
+    info.loop = &loop;
+    info.preheader = getOrInsertPreheader(func, loop);
+
+    auto test = exiting[0];
+    info.branch = test->terminator();
+    if (info.branch->op != Op::Branch) {
+      return std::nullopt;
+    }
+    info.exitEdge = loop.contains(info.branch->edges[0].target) ? 1 : 0;
+    if (!loop.contains(info.branch->edges[1 - info.exitEdge].target)) {
+      return std::nullopt;
+    }
+
+    // the test: `load @i` compared against an invariant bound
+    auto cond = info.branch->operands[0];
+    if (cond->op != Op::Binary || cond->parent != test ||
+        !isComparison(cond->binop)) {
+      return std::nullopt;
+    }
+    // the counter slot read by `val`: a load of it, or the stepped value
+    // that was just stored to it
+    auto counterOf = [&](Value *val) -> const InductionVariable * {
+      if (val->op == Op::Load && val->parent == test) {
+        return ivs.find(&loop, val->operands[0]);
+      }
+      for (const auto &iv : ivs.of(&loop)) {
+        if (iv.update->operands[0] == val) {
+          return &iv;
+        }
+      }
+      return nullptr;
+    };
+    Value *load = nullptr;
+    const InductionVariable *iv = nullptr;
+    if ((iv = counterOf(cond->operands[0])) &&
+        loop.isInvariant(cond->operands[1])) {
+      load = cond->operands[0];
+      info.pred = cond->binop;
+      info.bound = cond->operands[1];
+    } else if ((iv = counterOf(cond->operands[1])) &&
+               loop.isInvariant(cond->operands[0])) {
+      load = cond->operands[1];
+      info.pred = swapOperands(cond->binop);
+      info.bound = cond->operands[0];
+    } else {
+      return std::nullopt;
+    }
+    info.counter = iv->slot;
+
+    auto update = iv->update;
+    info.step = iv->step;
+    if (std::abs(info.step) > (1 << 16)) {
+      return std::nullopt;
+    }
+    for (auto bb : loop.blocks) {
+      info.size += bb->insts.size();
+    }
+
+    // does the test run before or after the update within an iteration?
+    if (load == update->operands[0]) {
+      info.stepBeforeTest = true;
+      if (update->parent != test && !domTree.dominates(update->parent, test)) {
+        return std::nullopt;
+      }
+    } else if (update->parent == test) {
+      info.stepBeforeTest = false;
+      for (const auto &inst : test->insts) {
+        if (inst.get() == load) {
+          break;
+        }
+        info.stepBeforeTest |= inst.get() == update;
+      }
+    } else if (domTree.dominates(update->parent, test)) {
+      info.stepBeforeTest = true;
+    } else if (!domTree.dominates(test, update->parent)) {
+      return std::nullopt;
+    }
+
+    if (auto init = entryValue(info.preheader, info.counter)) {
+      info.init = constantValue(init);
+    }
+    return info;
+  }
+
+  /**
+   * @brief Drops loops defining values that are used after the loop;
+   * iteration copies could not provide them.
+   */
+  auto dropEscapingLoops(std::vector<CountedLoop> &candidates) -> void {
+    std::unordered_map<const BasicBlock *, size_t> owner;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      for (auto bb : candidates[i].loop->blocks) {
+        owner[bb] = i;
+      }
+    }
+    std::vector<bool> escapes(candidates.size());
+    for (auto &bb : func.blocks) {
+      auto self = owner.find(bb.get());
+      for (auto &inst : bb->insts) {
+        inst->forEachUse([&](Value *use) {
+          if (!use->isInst() && use->op != Op::BlockArg) {
+            return;
+          }
+          auto it = owner.find(use->parent);
+          if (it != owner.end() && (self == owner.end() || self->second != it->second)) {
+            escapes[it->second] = true;
+          }
+        });
+      }
+    }
+    std::vector<CountedLoop> kept;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      if (!escapes[i]) {
+        kept.push_back(candidates[i]);
+      }
+    }
+    candidates = std::move(kept);
+  }
+
+  /**
+   * @brief Number of exit tests the loop executes, counting the last one.
+   */
+  auto countTests(const CountedLoop &info) const -> std::optional<int> {
+    auto bound = constantValue(info.bound);
+    if (!info.init || !bound) {
+      return std::nullopt;
+    }
+    int val = *info.init;
+    for (int tests = 1; tests <= max_simulated_tests; ++tests) {
+      if (info.stepBeforeTest) {
+        foldBinary(BinOp::Add, val, info.step, val);
+      }
+      int res = 0;
+      foldBinary(info.pred, val, *bound, res);
+      bool exits = (res != 0) == (info.exitEdge == 0);
+      if (exits) {
+        return tests;
+      }
+      if (!info.stepBeforeTest) {
+        foldBinary(BinOp::Add, val, info.step, val);
+      }
+    }
+    return std::nullopt;
+  }
+
+  auto unroll(const CountedLoop &info) -> bool {
+    const int factor = options.unrollFactor;
+    const auto limit = static_cast<size_t>(options.unrollLimit);
+
+    if (auto tests = countTests(info)) {
+      if (static_cast<size_t>(*tests) * info.size <= limit) {
+        peel(info, *tests - 1);
+        auto exit = info.branch->edges[info.exitEdge];
+        auto test = info.branch->parent;
+        test->erase(info.branch);
+        test->append(makeJump(exit.target, exit.args));
+        return true;
+      }
+      if (factor > 1 && *tests >= 2 * factor &&
+          static_cast<size_t>(factor) * info.size <= limit) {
+        peel(info, *tests % factor);
+        replicate(info, factor);
+        return true;
+      }
+      return false;
+    }
+
+    bool rising = info.step > 0 && (info.pred == BinOp::Lt || info.pred == BinOp::Le);
+    bool falling = info.step < 0 && (info.pred == BinOp::Gt || info.pred == BinOp::Ge);
+    if (factor > 1 && (rising || falling) && info.exitEdge == 1 &&
+        info.branch->parent == info.loop->header && !info.stepBeforeTest &&
+        static_cast<size_t>(factor) * info.size <= limit) {
+      unrollWithRemainder(info, factor);
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Copies all loop blocks, placing them before the header.
+   */
+  auto cloneLoop(const Loop &loop) -> LoopCopy {
+    LoopCopy copy;
+    auto where = func.find(loop.header);
+    std::vector<Value *> copied;
+    for (auto bb : loop.blocks) {
+      auto clone = std::make_unique<BasicBlock>(bb->name);
+      clone->parent = &func;
+      for (const auto &param : bb->params) {
+        copy.values[param.get()] = clone->addParam(param->ty);
+      }
+      for (const auto &inst : bb->insts) {
+        auto inserted = clone->append(cloneInst(*inst));
+        copy.values[inst.get()] = inserted;
+        copied.push_back(inserted);
+      }
+      copy.blocks[bb] = clone.get();
+      func.blocks.insert(where, std::move(clone));
+    }
+    for (auto inst : copied) {
+      inst->forEachUse([&](Value *&use) {
+        if (auto it = copy.values.find(use); it != copy.values.end()) {
+          use = it->second;
+        }
+      });
+      for (auto &edge : inst->edges) {
+        if (auto it = copy.blocks.find(edge.target); it != copy.blocks.end()) {
+          edge.target = it->second;
+        }
+      }
+    }
+    return copy;
+  }
+
+  /**
+   * @brief Replaces the exit test of a copy (or of the loop itself when
+   * `copy` is nullptr) by a jump to its in-loop successor.
+   */
+  auto dropTest(const CountedLoop &info, const LoopCopy *copy) -> void {
+    auto branch = copy ? copy->values.at(info.branch) : info.branch;
+    auto stay = branch->edges[1 - info.exitEdge];
+    auto test = branch->parent;
+    test->erase(branch);
+    test->append(makeJump(stay.target, std::move(stay.args)));
+  }
+
+  /**
+   * @brief Redirects the back edge of an iteration (copy) to `next`.
+   */
+  auto linkBackEdge(const CountedLoop &info, const LoopCopy *copy,
+                    BasicBlock *next) -> void {
+    auto header = copy ? copy->blocks.at(info.loop->header) : info.loop->header;
+    for (auto bb : info.loop->blocks) {
+      auto block = copy ? copy->blocks.at(bb) : bb;
+      for (auto &edge : block->terminator()->edges) {
+        if (edge.target == header) {
+          edge.target = next;
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Runs `count` iterations, with their exit tests removed, before
+   * the loop is entered.
+   */
+  auto peel(const CountedLoop &info, int count) -> void {
+    auto header = info.loop->header;
+    Value *into = info.preheader->terminator();
+    for (int i = 0; i < count; ++i) {
+      auto copy = cloneLoop(*info.loop);
+      dropTest(info, &copy);
+      into->edges[0].target = copy.blocks.at(header);
+      linkBackEdge(info, &copy, header);
+      into = copy.blocks.at(info.loop->latches()[0])->terminator();
+      // the latch may hold several edges; only the back edge is redirected
+      for (auto &edge : into->edges) {
+        if (edge.target == header) {
+          std::swap(edge, into->edges[0]);
+          break;
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Replicates the loop body `factor` times, keeping only the exit
+   * test of the last copy.
+   */
+  auto replicate(const CountedLoop &info, int factor) -> void {
+    std::vector<LoopCopy> copies;
+    for (int i = 1; i < factor; ++i) {
+      copies.push_back(cloneLoop(*info.loop));
+    }
+    dropTest(info, nullptr);
+    linkBackEdge(info, nullptr, copies[0].blocks.at(info.loop->header));
+    for (size_t i = 0; i + 1 < copies.size(); ++i) {
+      dropTest(info, &copies[i]);
+      linkBackEdge(info, &copies[i], copies[i + 1].blocks.at(info.loop->header));
+    }
+    linkBackEdge(info, &copies.back(), info.loop->header);
+  }
+
+  /**
+   * @brief Adds an unrolled copy of the loop that runs while `factor`
+   * more iterations are certain; the original loop runs the rest.
+   */
+  auto unrollWithRemainder(const CountedLoop &info, int factor) -> void {
+    auto module = func.parent;
+    auto header = info.loop->header;
+    std::vector<LoopCopy> copies;
+    for (int i = 0; i < factor; ++i) {
+      copies.push_back(cloneLoop(*info.loop));
+    }
+
+    // guard: lim = bound - (factor - 1) * step must not wrap around
+    auto guard = func.newBlock("unroll_guard", header);
+    auto check = func.newBlock("unroll_header", header);
+    auto lim = guard->append(makeBinary(
+        BinOp::Sub, info.bound, module->getInt((factor - 1) * info.step)));
+    auto ok = guard->append(makeBinary(info.step > 0 ? BinOp::Lt : BinOp::Gt,
+                                       lim, info.bound));
+    guard->append(makeBranch(ok, check, header));
+    for (auto &edge : info.preheader->terminator()->edges) {
+      if (edge.target == header) {
+        edge.target = guard;
+      }
+    }
+
+    auto val = check->append(makeLoad(info.counter));
+    auto more = check->append(makeBinary(info.pred, val, lim));
+    check->append(makeBranch(more, copies[0].blocks.at(header), header));
+
+    for (size_t i = 0; i < copies.size(); ++i) {
+      dropTest(info, &copies[i]);
+      auto next = i + 1 < copies.size() ? copies[i + 1].blocks.at(header) : check;
+      linkBackEdge(info, &copies[i], next);
+    }
+  }
+};
+
+} // namespace
+
+auto opt::unrollLoops(Function &func, AnalysisManager &am,
+                      const Options &options) -> bool {
+  if (func.isDecl() || options.unrollFactor < 1) {
+    return false;
+  }
+  return LoopUnroller(func, am, options).run();
+}
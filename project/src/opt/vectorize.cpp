@@ -0,0 +1,452 @@
+/**
+ * @file vectorize.cpp
+ * @brief Loop vectorization for the RISC-V vector extension.
+ *
+ * Koopa IR has no vector types, so a vectorized loop becomes a call to one
+ * of a few *vector routines*, declared as `@__rvv_<name>`. The backend emits
+ * the bodies of the routines a program calls, strip-mined with `vsetvli`.
+ *
+ * | Routine | Computes |
+ * | :--- | :--- |
+ * | `vv_<op>(dst, a, b, n)` | `dst[k] = a[k] op b[k]` |
+ * | `vx_<op>(dst, a, x, n)` | `dst[k] = a[k] op x` (`rsub`: `x - a[k]`) |
+ * | `redsum(a, n)` | `a[0] + ... + a[n - 1]` |
+ * | `dot(a, b, n)` | `a[0] * b[0] + ... + a[n - 1] * b[n - 1]` |
+ * | `disjoint(p, q, n)` | whether `p[0..n)` and `q[0..n)` are equal or apart |
+ *
+ * with `op` one of `add`, `sub` and `mul`.
+ *
+ * ### Vectorizable Loops
+ * An innermost loop of one block (rotated) or two (header test plus body)
+ * whose counter `i` steps by 1 while below a loop-invariant bound, and
+ * whose body is exactly one of
+ * ```
+ * c[i] = a[i] op b[i];   c[i] = a[i] op x;   c[i] = a[i];
+ * s = s + a[i];          s = s + a[i] * b[i];
+ * ```
+ * with `x` loop-invariant and every `a[i]` addressed by the counter from a
+ * loop-invariant base. The loop is replaced by a call in its preheader over
+ * `n = bound - i` elements, followed by the final values of `i` and `s`.
+ *
+ * ### Aliasing
+ * An elementwise loop reads each source element before writing the same
+ * element of `c`. Vectorizing it keeps that order only if no source
+ * overlaps `c` at another offset. Sources at the very address of `c`, or
+ * that `AliasAnalysis` keeps apart from it, are fine; for the others a
+ * `disjoint` check (which also accepts the very address) picks between the
+ * call and the original loop at run time.
+ */
+
+module;
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+import ir.type;
+
+using namespace opt;
+
+namespace {
+
+/**
+ * @brief A loop reduced to one vector routine call.
+ */
+struct VectorLoop {
+  const Loop *loop;
+  const InductionVariable *iv;
+  BasicBlock *exit;
+  Value *bound;
+  bool bottomTested; ///< Runs once before its first test.
+  /// Routine name without the `@__rvv_` prefix.
+  std::string routine;
+  /// Addresses (indexed by the counter) and invariants passed to it.
+  std::vector<Value *> args;
+  /// `dst` and the sources whose overlap is only known at run time.
+  std::vector<Value *> checks;
+  Value *sum = nullptr; ///< The reduction scalar, for `redsum` and `dot`.
+};
+
+auto vectorRoutine(Module &module, const std::string &name,
+                   std::shared_ptr<type::Type> retTy,
+                   const std::vector<std::shared_ptr<type::Type>> &params)
+    -> Function * {
+  auto fullName = "@__rvv_" + name;
+  if (auto func = module.findFunc(fullName)) {
+    return func;
+  }
+  auto func = std::make_unique<Function>(fullName, std::move(retTy));
+  func->parent = &module;
+  for (const auto &ty : params) {
+    func->params.push_back(std::make_unique<Value>(Op::FuncArg, ty));
+  }
+  // declarations go first, ahead of their callers
+  auto pos = std::ranges::find_if(module.funcs, [](const auto &other) {
+    return !other->isDecl();
+  });
+  return module.funcs.insert(pos, std::move(func))->get();
+}
+
+class Vectorizer {
+public:
+  Vectorizer(Function &_func, AnalysisManager &am)
+      : func(_func), domTree(am.domTree(_func)), loops(am.loops(_func)),
+        ivs(_func, loops, domTree), aa(_func) {}
+
+  auto run() -> bool {
+    std::vector<VectorLoop> found;
+    for (auto loop : loops.postOrder()) {
+      if (loop->subLoops.empty()) {
+        if (auto vector = analyze(*loop)) {
+          found.push_back(std::move(*vector));
+        }
+      }
+    }
+    for (auto &vector : found) {
+      rewrite(vector);
+    }
+    if (!found.empty()) {
+      removeUnreachableBlocks(func);
+    }
+    return !found.empty();
+  }
+
+private:
+  Function &func;
+  const DominatorTree &domTree;
+  const LoopInfo &loops;
+  InductionInfo ivs;
+  AliasAnalysis aa;
+
+  /**
+   * @brief The loop-invariant base of an address indexed by the counter,
+   * or nullptr.
+   */
+  auto streamBase(const Loop &loop, const Value *addr,
+                  const std::unordered_set<const Value *> &counters) const
+      -> Value * {
+    if ((addr->op != Op::GetElemPtr && addr->op != Op::GetPtr) ||
+        !loop.contains(addr->parent) || !loop.isInvariant(addr->operands[0]) ||
+        !counters.contains(addr->operands[1]) || !pointee(addr->ty)->is_int()) {
+      return nullptr;
+    }
+    return addr->operands[0];
+  }
+
+  auto analyze(const Loop &loop) -> std::optional<VectorLoop> {
+    auto exiting = loop.exitingBlocks();
+    auto exits = loop.exitBlocks();
+    auto latches = loop.latches();
+    if (loop.blocks.size() > 2 || exiting.size() != 1 || exits.size() != 1 ||
+        latches.size() != 1 || !exits[0]->params.empty() ||
+        !loop.header->params.empty()) {
+      return std::nullopt;
+    }
+    auto test = exiting[0];
+    auto latch = latches[0];
+    auto branch = test->terminator();
+    bool bottomTested = loop.blocks.size() == 1;
+    if (test != (bottomTested ? latch : loop.header) ||
+        branch->op != Op::Branch || !loop.contains(branch->edges[0].target) ||
+        !branch->edges[0].args.empty() || !branch->edges[1].args.empty()) {
+      return std::nullopt;
+    }
+    auto cond = branch->operands[0];
+    if (cond->op != Op::Binary || cond->binop != BinOp::Lt ||
+        !loop.isInvariant(cond->operands[1])) {
+      return std::nullopt;
+    }
+
+    // the counter: a top-tested loop tests its value, a rotated one the
+    // value it is stepped to
+    const InductionVariable *iv = nullptr;
+    for (const auto &other : ivs.of(&loop)) {
+      auto tested = bottomTested ? other.update->operands[0] : cond->operands[0];
+      bool matches = bottomTested ? cond->operands[0] == tested
+                                  : tested->op == Op::Load &&
+                                        tested->operands[0] == other.slot;
+      if (matches && other.step == 1 && other.update->parent == latch) {
+        iv = &other;
+      }
+    }
+    if (!iv) {
+      return std::nullopt;
+    }
+    auto stepped = iv->update->operands[0];
+    std::unordered_set<const Value *> counters;
+    std::unordered_set<const Value *> bookkeeping{cond, iv->update, stepped};
+    for (auto bb : loop.blocks) {
+      bool updated = false;
+      for (auto &inst : bb->insts) {
+        updated |= inst.get() == iv->update;
+        if (inst->op == Op::Load && inst->operands[0] == iv->slot) {
+          if (updated) {
+            return std::nullopt;
+          }
+          counters.insert(inst.get());
+          bookkeeping.insert(inst.get());
+        }
+      }
+    }
+    if (stepped->op != Op::Binary || !counters.contains(stepped->operands[0])) {
+      return std::nullopt;
+    }
+
+    // every other instruction belongs to the one pattern the body computes
+    auto users = collectUsers(func);
+    auto usedOnceBy = [&](const Value *val, const Value *user) {
+      auto it = users.find(const_cast<Value *>(val));
+      return it != users.end() && it->second.size() == 1 &&
+             it->second[0] == user;
+    };
+    Value *store = nullptr;
+    std::vector<Value *> body;
+    for (auto bb : loop.blocks) {
+      for (auto &inst : bb->insts) {
+        if (inst->isTerminator() || bookkeeping.contains(inst.get())) {
+          continue;
+        }
+        if (inst->op == Op::Store) {
+          if (store) {
+            return std::nullopt;
+          }
+          store = inst.get();
+        }
+        body.push_back(inst.get());
+      }
+    }
+    // a top-tested loop runs its header once more than its body
+    if (!store || store->parent != latch) {
+      return std::nullopt;
+    }
+    // loads of the counter only feed addresses, the test and the step
+    for (auto counter : counters) {
+      for (auto user : users[const_cast<Value *>(counter)]) {
+        if (user != cond && user != stepped &&
+            !streamBase(loop, user, counters)) {
+          return std::nullopt;
+        }
+      }
+    }
+
+    VectorLoop res{&loop, iv, exits[0], cond->operands[1], bottomTested};
+    std::unordered_set<const Value *> matched{store};
+    // a load of `a[i]` used only by `user`
+    auto stream = [&](Value *val, const Value *user) -> Value * {
+      if (val->op != Op::Load || !usedOnceBy(val, user) ||
+          !streamBase(loop, val->operands[0], counters)) {
+        return nullptr;
+      }
+      matched.insert(val);
+      matched.insert(val->operands[0]);
+      return val->operands[0];
+    };
+
+    auto val = store->operands[0];
+    auto dest = store->operands[1];
+    if (streamBase(loop, dest, counters)) {
+      // c[i] = a[i] op b[i], c[i] = a[i] op x or c[i] = a[i]
+      matched.insert(dest);
+      res.args.push_back(dest);
+      if (auto src = stream(val, store)) {
+        res.routine = "vx_add";
+        res.args.insert(res.args.end(), {src, func.parent->getInt(0)});
+      } else if (val->op == Op::Binary && usedOnceBy(val, store) &&
+                 (val->binop == BinOp::Add || val->binop == BinOp::Sub ||
+                  val->binop == BinOp::Mul)) {
+        matched.insert(val);
+        auto lhs = val->operands[0];
+        auto rhs = val->operands[1];
+        auto name = std::string(binOpName(val->binop));
+        auto left = stream(lhs, val);
+        auto right = lhs == rhs ? nullptr : stream(rhs, val);
+        if (left && right) {
+          res.routine = "vv_" + name;
+          res.args.insert(res.args.end(), {left, right});
+        } else if (left && loop.isInvariant(rhs)) {
+          res.routine = "vx_" + name;
+          res.args.insert(res.args.end(), {left, rhs});
+        } else if (right && loop.isInvariant(lhs)) {
+          res.routine = val->binop == BinOp::Sub ? "vx_rsub" : "vx_" + name;
+          res.args.insert(res.args.end(), {right, lhs});
+        } else {
+          return std::nullopt;
+        }
+      } else {
+        return std::nullopt;
+      }
+      for (size_t k = 1; k < 3; ++k) {
+        auto src = res.args[k];
+        if (src->ty->is_ptr() && src != dest &&
+            aa.alias(dest, src) != AliasResult::NoAlias) {
+          res.checks.push_back(src);
+        }
+      }
+    } else if (isIdentifiedObject(dest) && pointee(dest->ty)->is_int() &&
+               dest != iv->slot && val->op == Op::Binary &&
+               val->binop == BinOp::Add && usedOnceBy(val, store)) {
+      // s = s + a[i] or s = s + a[i] * b[i]
+      matched.insert(val);
+      auto old = val->operands[0];
+      auto term = val->operands[1];
+      if (old->op != Op::Load || old->operands[0] != dest) {
+        std::swap(old, term);
+      }
+      if (old->op != Op::Load || old->operands[0] != dest ||
+          !usedOnceBy(old, val)) {
+        return std::nullopt;
+      }
+      matched.insert(old);
+      res.sum = dest;
+      if (auto src = stream(term, val)) {
+        res.routine = "redsum";
+        res.args.push_back(src);
+      } else if (term->op == Op::Binary && term->binop == BinOp::Mul &&
+                 usedOnceBy(term, val)) {
+        matched.insert(term);
+        auto left = stream(term->operands[0], term);
+        auto right = term->operands[0] == term->operands[1]
+                         ? nullptr
+                         : stream(term->operands[1], term);
+        if (!left || !right) {
+          return std::nullopt;
+        }
+        res.routine = "dot";
+        res.args.insert(res.args.end(), {left, right});
+      } else {
+        return std::nullopt;
+      }
+      for (auto src : res.args) {
+        if (aa.mayShareObject(dest, aa.location(src).base)) {
+          return std::nullopt;
+        }
+      }
+    } else {
+      return std::nullopt;
+    }
+    if (!std::ranges::all_of(body, [&](Value *inst) {
+          return matched.contains(inst);
+        })) {
+      return std::nullopt;
+    }
+
+    // nothing computed in the loop is used after it
+    if (loop.hasOutsideUses()) {
+      return std::nullopt;
+    }
+
+    // a rotated loop runs at least once, which a call over
+    // `bound - i` elements only matches for a constant trip count
+    if (bottomTested) {
+      auto preds = func.preds();
+      std::vector<BasicBlock *> entering;
+      for (auto pred : preds[loop.header]) {
+        if (!loop.contains(pred)) {
+          entering.push_back(pred);
+        }
+      }
+      auto start =
+          entering.size() == 1 ? entryValue(entering[0], iv->slot) : nullptr;
+      if (!start || !start->isInt() || !res.bound->isInt() ||
+          res.bound->imm <= start->imm) {
+        return std::nullopt;
+      }
+    }
+    return res;
+  }
+
+  auto rewrite(const VectorLoop &vector) -> void {
+    auto module = func.parent;
+    std::shared_ptr<type::Type> intTy = type::IntType::get();
+    std::shared_ptr<type::Type> ptrTy = type::PtrType::get(intTy);
+    auto preheader = getOrInsertPreheader(func, *vector.loop);
+    auto slot = vector.iv->slot;
+
+    // the first element of every stream, and the element count
+    auto start = preheader->insertBeforeTerminator(makeLoad(slot));
+    auto count = preheader->insertBeforeTerminator(
+        makeBinary(BinOp::Sub, vector.bound, start));
+    std::unordered_map<Value *, Value *> first;
+    auto firstOf = [&](Value *val) -> Value * {
+      if (!val->ty->is_ptr()) {
+        return val;
+      }
+      auto &res = first[val];
+      if (!res) {
+        auto inst = cloneInst(*val);
+        inst->operands[1] = start;
+        res = preheader->insertBeforeTerminator(std::move(inst));
+      }
+      return res;
+    };
+    std::vector<Value *> args;
+    std::vector<std::shared_ptr<type::Type>> params;
+    for (auto arg : vector.args) {
+      args.push_back(firstOf(arg));
+      params.push_back(arg->ty->is_ptr() ? ptrTy : intTy);
+    }
+    args.push_back(count);
+    params.push_back(intTy);
+
+    // the call runs in the preheader, or behind a run-time overlap check
+    auto body = preheader;
+    if (!vector.checks.empty()) {
+      auto disjoint = vectorRoutine(*module, "disjoint", intTy,
+                                    {ptrTy, ptrTy, intTy});
+      Value *ok = nullptr;
+      for (auto src : vector.checks) {
+        auto check = preheader->insertBeforeTerminator(
+            makeCall(disjoint, {args[0], firstOf(src), count}));
+        ok = ok ? preheader->insertBeforeTerminator(
+                      makeBinary(BinOp::And, ok, check))
+                : check;
+      }
+      body = func.newBlock("vector", vector.loop->header);
+      body->append(makeJump(vector.exit));
+      preheader->erase(preheader->terminator());
+      preheader->append(makeBranch(ok, body, vector.loop->header));
+    } else {
+      preheader->terminator()->edges[0].target = vector.exit;
+    }
+
+    auto retTy = vector.sum ? intTy : type::VoidType::get();
+    auto call = body->insertBeforeTerminator(
+        makeCall(vectorRoutine(*module, vector.routine, retTy, params), args));
+    if (vector.sum) {
+      auto old = body->insertBeforeTerminator(makeLoad(vector.sum));
+      auto sum = body->insertBeforeTerminator(
+          makeBinary(BinOp::Add, old, call));
+      body->insertBeforeTerminator(makeStore(sum, vector.sum));
+    }
+
+    // the counter ends at the bound, unless the loop never ran
+    Value *end = vector.bound;
+    if (!vector.bottomTested) {
+      auto ran = body->insertBeforeTerminator(
+          makeBinary(BinOp::Gt, count, module->getInt(0)));
+      auto steps = body->insertBeforeTerminator(
+          makeBinary(BinOp::Mul, count, ran));
+      end = body->insertBeforeTerminator(
+          makeBinary(BinOp::Add, start, steps));
+    }
+    body->insertBeforeTerminator(makeStore(end, slot));
+  }
+};
+
+} // namespace
+
+auto opt::vectorizeLoops(Function &func, AnalysisManager &am,
+                         const Options &options) -> bool {
+  if (!options.vectorize || func.isDecl()) {
+    return false;
+  }
+  return Vectorizer(func, am).run();
+}
@@ -0,0 +1,76 @@
+/**
+ * @file vrp.cpp
+ * @brief Value range propagation.
+ *
+ * `ValueRanges` bounds every integer value of the function. The pass then
+ * rewrites arithmetic whose operands are known to be in range:
+ * - a value with a single possible result becomes that constant, which
+ *   decides comparisons such as the `i < n` of a loop body;
+ * - `x / 2^k` and `x % 2^k` become `sar` and `and` when `x >= 0`, where
+ *   signed division would otherwise need a rounding fix-up;
+ * - `x % c` becomes `x` when `0 <= x < c`.
+ */
+
+module;
+
+#include <bit>
+#include <unordered_map>
+#include <vector>
+
+module opt.passes;
+
+import opt.ir;
+import opt.analysis;
+
+using namespace opt;
+
+auto opt::simplifyWithRanges(Function &func, AnalysisManager &am) -> bool {
+  if (func.isDecl()) {
+    return false;
+  }
+  const auto &domTree = am.domTree(func);
+  ValueRanges ranges(func, domTree);
+  auto module = func.parent;
+
+  bool changed = false;
+  std::unordered_map<Value *, Value *> replaced;
+  for (auto bb : domTree.order()) {
+    for (auto &inst : bb->insts) {
+      if (inst->op != Op::Binary) {
+        continue;
+      }
+      auto res = ranges.result(inst.get());
+      if (res.isConstant()) {
+        replaced[inst.get()] = module->getInt(static_cast<int>(res.lo));
+        continue;
+      }
+      auto lhs = ranges.operand(inst.get(), 0);
+      auto rhs = inst->operands[1];
+      bool divides = inst->binop == BinOp::Div || inst->binop == BinOp::Mod;
+      if (!divides || !rhs->isInt() || rhs->imm <= 1 || !lhs.isNonNegative()) {
+        continue;
+      }
+      if (inst->binop == BinOp::Mod && lhs.hi < rhs->imm) {
+        replaced[inst.get()] = inst->operands[0];
+      } else if (std::has_single_bit(static_cast<unsigned>(rhs->imm))) {
+        auto shift = std::countr_zero(static_cast<unsigned>(rhs->imm));
+        if (inst->binop == BinOp::Div) {
+          inst->binop = BinOp::Sar;
+          inst->operands[1] = module->getInt(shift);
+        } else {
+          inst->binop = BinOp::And;
+          inst->operands[1] = module->getInt(rhs->imm - 1);
+        }
+        changed = true;
+      }
+    }
+  }
+  if (replaced.empty()) {
+    return changed;
+  }
+  replaceAllUses(func, replaced);
+  for (auto [inst, _] : replaced) {
+    inst->parent->erase(inst);
+  }
+  return true;
+}